@@ -0,0 +1,317 @@
+#include "biginteger.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mal {
+
+namespace {
+
+void trim(std::vector<uint32_t>& magnitude)
+{
+    while (!magnitude.empty() && magnitude.back() == 0) {
+        magnitude.pop_back();
+    }
+}
+
+void multiplyAddSmall(std::vector<uint32_t>& magnitude, uint32_t multiplier, uint32_t addend)
+{
+    uint64_t carry = addend;
+    for (auto& digit : magnitude) {
+        const uint64_t current = static_cast<uint64_t>(digit) * multiplier + carry;
+        digit = static_cast<uint32_t>(current);
+        carry = current >> 32;
+    }
+    if (carry) {
+        magnitude.push_back(static_cast<uint32_t>(carry));
+    }
+}
+
+} // namespace
+
+BigInteger::BigInteger(int64_t value)
+    : m_negative(value < 0)
+{
+    // NOTE: negate in unsigned arithmetic, so INT64_MIN doesn't overflow
+    uint64_t magnitude = m_negative ? ~static_cast<uint64_t>(value) + 1 : static_cast<uint64_t>(value);
+    while (magnitude) {
+        m_magnitude.push_back(static_cast<uint32_t>(magnitude));
+        magnitude >>= 32;
+    }
+}
+
+BigInteger::BigInteger(bool negative, Magnitude magnitude)
+    : m_negative(negative)
+    , m_magnitude(std::move(magnitude))
+{
+    normalize();
+}
+
+void BigInteger::normalize()
+{
+    trim(m_magnitude);
+    if (m_magnitude.empty()) {
+        m_negative = false;
+    }
+}
+
+std::optional<BigInteger> BigInteger::fromString(std::string_view number)
+{
+    bool negative = false;
+    if (!number.empty() && (number.front() == '-' || number.front() == '+')) {
+        negative = number.front() == '-';
+        number.remove_prefix(1);
+    }
+    if (number.empty()) {
+        return std::nullopt;
+    }
+
+    Magnitude magnitude;
+    // consume up to nine decimal digits at a time, they always fit into one base 2^32 digit
+    constexpr size_t chunkSize = 9;
+    for (size_t chunkStart = 0; chunkStart < number.size(); chunkStart += chunkSize) {
+        const auto chunk = number.substr(chunkStart, chunkSize);
+        uint32_t chunkValue = 0;
+        uint32_t multiplier = 1;
+        for (const char digit : chunk) {
+            if (digit < '0' || digit > '9') {
+                return std::nullopt;
+            }
+            chunkValue = chunkValue * 10 + static_cast<uint32_t>(digit - '0');
+            multiplier *= 10;
+        }
+        multiplyAddSmall(magnitude, multiplier, chunkValue);
+    }
+    return BigInteger(negative, std::move(magnitude));
+}
+
+std::string BigInteger::toString() const
+{
+    if (isZero()) {
+        return "0";
+    }
+
+    auto magnitude = m_magnitude;
+    std::string digits;
+    while (!magnitude.empty()) {
+        auto chunk = divideBySmall(magnitude, 1'000'000'000);
+        for (size_t digitIndex = 0; digitIndex < 9 && (chunk || !magnitude.empty()); ++digitIndex) {
+            digits += static_cast<char>('0' + chunk % 10);
+            chunk /= 10;
+        }
+    }
+    if (m_negative) {
+        digits += '-';
+    }
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+double BigInteger::toDouble() const
+{
+    double result = 0;
+    for (auto digit = m_magnitude.rbegin(); digit != m_magnitude.rend(); ++digit) {
+        result = std::ldexp(result, 32) + *digit;
+    }
+    return m_negative ? -result : result;
+}
+
+bool BigInteger::fitsInt64() const
+{
+    if (m_magnitude.size() > 2) {
+        return false;
+    }
+    const uint64_t magnitude = m_magnitude.size() == 2
+        ? (static_cast<uint64_t>(m_magnitude[1]) << 32) | m_magnitude[0]
+        : m_magnitude.empty() ? 0 : m_magnitude[0];
+    constexpr uint64_t int64Max = static_cast<uint64_t>(INT64_MAX);
+    return m_negative ? magnitude <= int64Max + 1 : magnitude <= int64Max;
+}
+
+int64_t BigInteger::toInt64() const
+{
+    uint64_t magnitude = 0;
+    for (size_t digitIndex = 0; digitIndex < m_magnitude.size() && digitIndex < 2; ++digitIndex) {
+        magnitude |= static_cast<uint64_t>(m_magnitude[digitIndex]) << (32 * digitIndex);
+    }
+    return static_cast<int64_t>(m_negative ? ~magnitude + 1 : magnitude);
+}
+
+bool BigInteger::isZero() const
+{
+    return m_magnitude.empty();
+}
+
+bool BigInteger::isNegative() const
+{
+    return m_negative;
+}
+
+int BigInteger::compare(const BigInteger& other) const
+{
+    if (m_negative != other.m_negative) {
+        return m_negative ? -1 : 1;
+    }
+    const auto magnitudeOrder = compareMagnitudes(m_magnitude, other.m_magnitude);
+    return m_negative ? -magnitudeOrder : magnitudeOrder;
+}
+
+bool BigInteger::operator==(const BigInteger& other) const
+{
+    return m_negative == other.m_negative && m_magnitude == other.m_magnitude;
+}
+
+size_t BigInteger::hash() const
+{
+    size_t result = m_negative;
+    for (const auto digit : m_magnitude) {
+        result = result * 31 + digit;
+    }
+    return result;
+}
+
+BigInteger operator+(const BigInteger& lhs, const BigInteger& rhs)
+{
+    if (lhs.m_negative == rhs.m_negative) {
+        return BigInteger(lhs.m_negative, BigInteger::addMagnitudes(lhs.m_magnitude, rhs.m_magnitude));
+    }
+    if (BigInteger::compareMagnitudes(lhs.m_magnitude, rhs.m_magnitude) >= 0) {
+        return BigInteger(lhs.m_negative, BigInteger::subtractMagnitudes(lhs.m_magnitude, rhs.m_magnitude));
+    }
+    return BigInteger(rhs.m_negative, BigInteger::subtractMagnitudes(rhs.m_magnitude, lhs.m_magnitude));
+}
+
+BigInteger operator-(const BigInteger& lhs, const BigInteger& rhs)
+{
+    return lhs + BigInteger(!rhs.m_negative, rhs.m_magnitude);
+}
+
+BigInteger operator*(const BigInteger& lhs, const BigInteger& rhs)
+{
+    return BigInteger(lhs.m_negative != rhs.m_negative, BigInteger::multiplyMagnitudes(lhs.m_magnitude, rhs.m_magnitude));
+}
+
+BigInteger operator/(const BigInteger& lhs, const BigInteger& rhs)
+{
+    return BigInteger(lhs.m_negative != rhs.m_negative, BigInteger::divideMagnitudes(lhs.m_magnitude, rhs.m_magnitude));
+}
+
+int BigInteger::compareMagnitudes(const Magnitude& lhs, const Magnitude& rhs)
+{
+    if (lhs.size() != rhs.size()) {
+        return lhs.size() < rhs.size() ? -1 : 1;
+    }
+    for (size_t digitIndex = lhs.size(); digitIndex-- > 0;) {
+        if (lhs[digitIndex] != rhs[digitIndex]) {
+            return lhs[digitIndex] < rhs[digitIndex] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+BigInteger::Magnitude BigInteger::addMagnitudes(const Magnitude& lhs, const Magnitude& rhs)
+{
+    const auto& longer = lhs.size() >= rhs.size() ? lhs : rhs;
+    const auto& shorter = lhs.size() >= rhs.size() ? rhs : lhs;
+
+    Magnitude result;
+    result.reserve(longer.size() + 1);
+    uint64_t carry = 0;
+    for (size_t digitIndex = 0; digitIndex < longer.size(); ++digitIndex) {
+        const uint64_t sum = static_cast<uint64_t>(longer[digitIndex])
+            + (digitIndex < shorter.size() ? shorter[digitIndex] : 0) + carry;
+        result.push_back(static_cast<uint32_t>(sum));
+        carry = sum >> 32;
+    }
+    if (carry) {
+        result.push_back(static_cast<uint32_t>(carry));
+    }
+    return result;
+}
+
+// NOTE: expects |lhs| >= |rhs|
+BigInteger::Magnitude BigInteger::subtractMagnitudes(const Magnitude& lhs, const Magnitude& rhs)
+{
+    Magnitude result;
+    result.reserve(lhs.size());
+    int64_t borrow = 0;
+    for (size_t digitIndex = 0; digitIndex < lhs.size(); ++digitIndex) {
+        int64_t difference = static_cast<int64_t>(lhs[digitIndex])
+            - (digitIndex < rhs.size() ? rhs[digitIndex] : 0) - borrow;
+        borrow = difference < 0;
+        if (borrow) {
+            difference += int64_t { 1 } << 32;
+        }
+        result.push_back(static_cast<uint32_t>(difference));
+    }
+    trim(result);
+    return result;
+}
+
+BigInteger::Magnitude BigInteger::multiplyMagnitudes(const Magnitude& lhs, const Magnitude& rhs)
+{
+    if (lhs.empty() || rhs.empty()) {
+        return {};
+    }
+
+    Magnitude result(lhs.size() + rhs.size(), 0);
+    for (size_t lhsIndex = 0; lhsIndex < lhs.size(); ++lhsIndex) {
+        uint64_t carry = 0;
+        for (size_t rhsIndex = 0; rhsIndex < rhs.size(); ++rhsIndex) {
+            const uint64_t current = static_cast<uint64_t>(lhs[lhsIndex]) * rhs[rhsIndex]
+                + result[lhsIndex + rhsIndex] + carry;
+            result[lhsIndex + rhsIndex] = static_cast<uint32_t>(current);
+            carry = current >> 32;
+        }
+        result[lhsIndex + rhs.size()] = static_cast<uint32_t>(carry);
+    }
+    trim(result);
+    return result;
+}
+
+uint32_t BigInteger::divideBySmall(Magnitude& magnitude, uint32_t divisor)
+{
+    uint64_t remainder = 0;
+    for (size_t digitIndex = magnitude.size(); digitIndex-- > 0;) {
+        const uint64_t current = (remainder << 32) | magnitude[digitIndex];
+        magnitude[digitIndex] = static_cast<uint32_t>(current / divisor);
+        remainder = current % divisor;
+    }
+    trim(magnitude);
+    return static_cast<uint32_t>(remainder);
+}
+
+BigInteger::Magnitude BigInteger::divideMagnitudes(const Magnitude& lhs, const Magnitude& rhs)
+{
+    if (compareMagnitudes(lhs, rhs) < 0) {
+        return {};
+    }
+    if (rhs.size() == 1) {
+        auto quotient = lhs;
+        divideBySmall(quotient, rhs.front());
+        return quotient;
+    }
+
+    // plain shift-and-subtract long division, one bit of the dividend at a time
+    Magnitude quotient(lhs.size(), 0);
+    Magnitude remainder;
+    for (size_t bitIndex = lhs.size() * 32; bitIndex-- > 0;) {
+        uint32_t carry = (lhs[bitIndex / 32] >> (bitIndex % 32)) & 1;
+        for (auto& digit : remainder) {
+            const uint32_t nextCarry = digit >> 31;
+            digit = (digit << 1) | carry;
+            carry = nextCarry;
+        }
+        if (carry) {
+            remainder.push_back(carry);
+        }
+        if (compareMagnitudes(remainder, rhs) >= 0) {
+            remainder = subtractMagnitudes(remainder, rhs);
+            quotient[bitIndex / 32] |= uint32_t { 1 } << (bitIndex % 32);
+        }
+    }
+    trim(quotient);
+    return quotient;
+}
+
+} // namespace mal
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mal {
+
+// Arbitrary precision integer, magnitude is stored as little endian base 2^32 digits
+class BigInteger {
+public:
+    BigInteger() = default;
+    BigInteger(int64_t value);
+
+    static std::optional<BigInteger> fromString(std::string_view number);
+
+    std::string toString() const;
+    double toDouble() const;
+
+    bool fitsInt64() const;
+    int64_t toInt64() const;
+
+    bool isZero() const;
+    bool isNegative() const;
+
+    int compare(const BigInteger& other) const;
+
+    friend BigInteger operator+(const BigInteger& lhs, const BigInteger& rhs);
+    friend BigInteger operator-(const BigInteger& lhs, const BigInteger& rhs);
+    friend BigInteger operator*(const BigInteger& lhs, const BigInteger& rhs);
+    // NOTE: truncates toward zero as integer division of fixnums does, divisor must not be zero
+    friend BigInteger operator/(const BigInteger& lhs, const BigInteger& rhs);
+
+    bool operator==(const BigInteger& other) const;
+    size_t hash() const;
+
+private:
+    using Magnitude = std::vector<uint32_t>;
+
+    BigInteger(bool negative, Magnitude magnitude);
+    void normalize();
+
+    static int compareMagnitudes(const Magnitude& lhs, const Magnitude& rhs);
+    static Magnitude addMagnitudes(const Magnitude& lhs, const Magnitude& rhs);
+    static Magnitude subtractMagnitudes(const Magnitude& lhs, const Magnitude& rhs);
+    static Magnitude multiplyMagnitudes(const Magnitude& lhs, const Magnitude& rhs);
+    static Magnitude divideMagnitudes(const Magnitude& lhs, const Magnitude& rhs);
+    static uint32_t divideBySmall(Magnitude& magnitude, uint32_t divisor);
+
+private:
+    bool m_negative { false };
+    Magnitude m_magnitude;
+};
+
+} // namespace mal
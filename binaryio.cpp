@@ -0,0 +1,69 @@
+#include "binaryio.h"
+
+#include "maltypes.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include <unistd.h>
+
+namespace mal {
+
+uint32_t SymbolTableWriter::indexOf(MalSymbol* symbol)
+{
+    const auto [entry, isNew] = m_indexes.try_emplace(symbol, static_cast<uint32_t>(m_symbols.size()));
+    if (isNew) {
+        m_symbols.push_back(symbol);
+    }
+    return entry->second;
+}
+
+uint32_t SymbolTableWriter::size() const
+{
+    return static_cast<uint32_t>(m_symbols.size());
+}
+
+void SymbolTableWriter::write(BinaryWriter& writer) const
+{
+    for (const auto symbol : m_symbols) {
+        writer.put(static_cast<uint8_t>(symbol->getType() == MalSymbol::SymbolType::KEYWORD));
+        writer.putString(symbol->name());
+    }
+}
+
+bool readSymbolTable(BinaryReader& reader, uint32_t count, std::vector<std::shared_ptr<MalSymbol>>& symbols)
+{
+    // a symbol takes its type byte and the length of its name at least
+    if (!reader.hasRoomFor(count, sizeof(uint8_t) + sizeof(uint32_t))) {
+        return false;
+    }
+    symbols.reserve(count);
+    for (uint32_t symbolIndex = 0; symbolIndex < count; ++symbolIndex) {
+        uint8_t isKeyword = 0;
+        std::string_view name;
+        if (!reader.get(isKeyword) || !reader.getString(name)) {
+            return false;
+        }
+        symbols.push_back(MalSymbol::intern(name, isKeyword ? MalSymbol::SymbolType::KEYWORD : MalSymbol::SymbolType::REGULAR_SYMBOL));
+    }
+    return true;
+}
+
+bool writeFileAtomically(const std::string& path, std::string_view data)
+{
+    const auto temporaryPath = path + "." + std::to_string(getpid());
+    {
+        std::ofstream output(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!output.write(data.data(), data.size()) || !output.flush()) {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace mal
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace mal {
+class MalSymbol;
+
+// Appends trivially copyable values and length prefixed strings in host byte order
+class BinaryWriter {
+public:
+    template <typename T>
+    void put(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        m_data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void putString(std::string_view str)
+    {
+        put(static_cast<uint32_t>(str.size()));
+        m_data += str;
+    }
+
+    const std::string& data() const { return m_data; }
+
+private:
+    std::string m_data;
+};
+
+// Reads what BinaryWriter wrote. Every read is bounds checked, a damaged file fails to read
+// instead of reading past its end.
+class BinaryReader {
+public:
+    BinaryReader(std::string_view data)
+        : m_data(data)
+    {
+    }
+
+    template <typename T>
+    bool get(T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (m_data.size() - m_position < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, m_data.data() + m_position, sizeof(T));
+        m_position += sizeof(T);
+        return true;
+    }
+
+    // str views the data
+    bool getString(std::string_view& str)
+    {
+        uint32_t size = 0;
+        if (!get(size) || m_data.size() - m_position < size) {
+            return false;
+        }
+        str = m_data.substr(m_position, size);
+        m_position += size;
+        return true;
+    }
+
+    bool isEnd() const { return m_position == m_data.size(); }
+    // Data not read yet
+    std::string_view rest() const { return m_data.substr(m_position); }
+    // Whether count items of at least itemSize bytes each could still be in the data. Counts read from
+    // a damaged file are checked with it before anything is allocated for them.
+    bool hasRoomFor(uint64_t count, size_t itemSize) const { return count <= (m_data.size() - m_position) / itemSize; }
+
+private:
+    std::string_view m_data;
+    size_t m_position { 0 };
+};
+
+// Symbols and keywords of a binary file are stored once, values refer to them by index
+class SymbolTableWriter {
+public:
+    uint32_t indexOf(MalSymbol* symbol);
+    uint32_t size() const;
+    void write(BinaryWriter& writer) const;
+
+private:
+    std::vector<MalSymbol*> m_symbols;
+    std::unordered_map<MalSymbol*, uint32_t> m_indexes;
+};
+
+// Interns count symbols written by SymbolTableWriter, false if the table is damaged
+bool readSymbolTable(BinaryReader& reader, uint32_t count, std::vector<std::shared_ptr<MalSymbol>>& symbols);
+
+// Writes data aside and renames it to path, readers see either the old file or the whole new one
+bool writeFileAtomically(const std::string& path, std::string_view data);
+
+} // namespace mal
@@ -1,110 +1,540 @@
 #include "buildins.h"
 
 #include "eval_ast.h"
+#include "formcache.h"
+#include "json.h"
+#include "mappedfile.h"
 #include "maltypes.h"
+#include "ports.h"
+#include "printer.h"
 #include "reader.h"
+#include "simd.h"
 
+#include <algorithm>
 #include <fstream>
 #include <functional>
-#include <iostream>
-#include <sstream>
+#include <iterator>
+#include <optional>
 
 namespace mal {
 
+bool isNumber(MalType* value)
+{
+    return value->is<MalNumber>() || value->is<MalBigInteger>() || value->is<MalDouble>();
+}
+
+double toDouble(MalType* number)
+{
+    if (auto fixnum = number->as<MalNumber>(); fixnum) {
+        return static_cast<double>(fixnum->getValue());
+    } else if (auto bigNumber = number->as<MalBigInteger>(); bigNumber) {
+        return bigNumber->getValue().toDouble();
+    }
+    return number->as<MalDouble>()->getValue();
+}
+
+BigInteger toBigInteger(MalType* number)
+{
+    if (auto fixnum = number->as<MalNumber>(); fixnum) {
+        return fixnum->getValue();
+    }
+    return number->as<MalBigInteger>()->getValue();
+}
+
+template <typename T>
+bool compareWith(const T& lhs, const T& rhs, char op, bool equal)
+{
+    if (op == '>') {
+        return equal ? lhs >= rhs : lhs > rhs;
+    }
+    return equal ? lhs <= rhs : lhs < rhs;
+}
+
 std::shared_ptr<MalType> compareNumbers(MalContainer* numbers, char op, bool equal = false)
 {
     if (numbers->size() <= 1) {
         return MalException::throwException("Not enough arguments");
     }
 
-    auto lhs = numbers->at(0)->asMalNumber();
-    auto rhs = numbers->at(1)->asMalNumber();
+    auto lhs = numbers->at(0).get();
+    auto rhs = numbers->at(1).get();
 
-    if (lhs && rhs) {
-        bool res = false;
-        if (op == '>') {
-            res = equal ? lhs->operator>=(rhs) : lhs->operator>(rhs);
-        } else if (op == '<') {
-            res = equal ? lhs->operator<=(rhs) : lhs->operator<(rhs);
-        }
-        return std::make_shared<MalBoolean>(res);
+    if (lhs->is<MalNumber>() && rhs->is<MalNumber>()) {
+        return std::make_shared<MalBoolean>(compareWith(lhs->as<MalNumber>()->getValue(), rhs->as<MalNumber>()->getValue(), op, equal));
+    } else if (!isNumber(lhs) || !isNumber(rhs)) {
+        return MalException::throwException("Could compare only numbers");
+    } else if (lhs->is<MalDouble>() || rhs->is<MalDouble>()) {
+        return std::make_shared<MalBoolean>(compareWith(toDouble(lhs), toDouble(rhs), op, equal));
     }
-    return MalException::throwException("Could compare only numbers");
+    const auto order = toBigInteger(lhs).compare(toBigInteger(rhs));
+    return std::make_shared<MalBoolean>(compareWith(order, 0, op, equal));
 }
 
-std::shared_ptr<MalType> applyArithmeticOperations(MalContainer* arguments, std::function<int(int, int)> op)
+// Every operation provides fixnum, big integer and double flavours,
+// fixnum one reports failure on overflow (or division by zero) so result could be promoted.
+struct PlusOperation {
+    static bool fixnum(int64_t lhs, int64_t rhs, int64_t& result) { return !__builtin_add_overflow(lhs, rhs, &result); }
+    static BigInteger bigInteger(const BigInteger& lhs, const BigInteger& rhs) { return lhs + rhs; }
+    static double flonum(double lhs, double rhs) { return lhs + rhs; }
+};
+
+struct MinusOperation {
+    static bool fixnum(int64_t lhs, int64_t rhs, int64_t& result) { return !__builtin_sub_overflow(lhs, rhs, &result); }
+    static BigInteger bigInteger(const BigInteger& lhs, const BigInteger& rhs) { return lhs - rhs; }
+    static double flonum(double lhs, double rhs) { return lhs - rhs; }
+};
+
+struct MultipliesOperation {
+    static bool fixnum(int64_t lhs, int64_t rhs, int64_t& result) { return !__builtin_mul_overflow(lhs, rhs, &result); }
+    static BigInteger bigInteger(const BigInteger& lhs, const BigInteger& rhs) { return lhs * rhs; }
+    static double flonum(double lhs, double rhs) { return lhs * rhs; }
+};
+
+struct DividesOperation {
+    static bool fixnum(int64_t lhs, int64_t rhs, int64_t& result)
+    {
+        if (rhs == 0 || (lhs == INT64_MIN && rhs == -1)) {
+            return false;
+        }
+        result = lhs / rhs;
+        return true;
+    }
+    static BigInteger bigInteger(const BigInteger& lhs, const BigInteger& rhs) { return lhs / rhs; }
+    static double flonum(double lhs, double rhs) { return lhs / rhs; }
+};
+
+template <typename Operation>
+std::shared_ptr<MalType> applyArithmeticOperations(MalContainer* arguments)
 {
     if (arguments->isEmpty() || arguments->size() == 1) {
         return MalException::throwException("Not enough arguments");
     }
-    if (const auto baseNumber = arguments->head()->asMalNumber(); !baseNumber) {
+    if (!isNumber(arguments->head().get())) {
         return MalException::throwException("Couldn't apply arithmetic operation to not a number");
-    } else {
-        int res = baseNumber->getValue();
-        for (size_t i = 1; i < arguments->size(); ++i) {
-            const auto currentNumber = arguments->at(i)->asMalNumber()->getValue();
-            res = op(res, currentNumber);
+    }
+
+    auto accumulator = arguments->head();
+    size_t i = 1;
+
+    // fast path, fold fixnums unboxed until overflow or other kind of number shows up
+    if (accumulator->is<MalNumber>()) {
+        int64_t fixnumResult = accumulator->as<MalNumber>()->getValue();
+        for (int64_t result = 0; i < arguments->size(); ++i) {
+            const auto currentNumber = arguments->at(i)->as<MalNumber>();
+            if (!currentNumber || !Operation::fixnum(fixnumResult, currentNumber->getValue(), result)) {
+                break;
+            }
+            fixnumResult = result;
+        }
+        if (i == arguments->size()) {
+            return std::make_shared<MalNumber>(fixnumResult);
+        }
+        accumulator = std::make_shared<MalNumber>(fixnumResult);
+    }
+
+    // the accumulator is promoted fixnum -> big integer -> double and never demoted while folding
+    for (; i < arguments->size(); ++i) {
+        const auto currentNumber = arguments->at(i).get();
+        if (!isNumber(currentNumber)) {
+            return MalException::throwException("Couldn't apply arithmetic operation to not a number");
+        }
+
+        if (accumulator->is<MalDouble>() || currentNumber->is<MalDouble>()) {
+            accumulator = std::make_shared<MalDouble>(Operation::flonum(toDouble(accumulator.get()), toDouble(currentNumber)));
+        } else if (std::is_same_v<Operation, DividesOperation> && toBigInteger(currentNumber).isZero()) {
+            return MalException::throwException("Division by zero");
+        } else {
+            accumulator = MalBigInteger::normalized(Operation::bigInteger(toBigInteger(accumulator.get()), toBigInteger(currentNumber)));
         }
-        return std::make_shared<MalNumber>(res);
     }
+    return accumulator;
 }
 
-std::string joinTypeStrings(MalContainer* args, bool withSpace = true)
+void printTypes(MalContainer* args, Printer& printer)
 {
-    std::string outStr;
-    if (!args->isEmpty()) {
-        for (const auto& element : *args) {
-            outStr += element->asString() + (args->back() != element  && withSpace ? " " : "");
+    for (size_t elementIndex = 0; elementIndex < args->size(); ++elementIndex) {
+        if (elementIndex != 0) {
+            printer.write(' ');
         }
+        printer.print(*args->at(elementIndex));
     }
-    return outStr;
 }
 
-std::shared_ptr<MalType> prn(MalContainer* args)
+// Clojure's *print-length* and *print-level*, when they are bound to non-negative numbers
+Printer::Limits printLimits(const Env& env)
 {
-    std::cout << joinTypeStrings(args) <<  std::endl;
-    return std::make_shared<MalNil>();
+    static const auto* lengthSymbol = MalSymbol::intern("*print-length*").get();
+    static const auto* levelSymbol = MalSymbol::intern("*print-level*").get();
+    auto limitOf = [&env](const MalSymbol* symbol) -> std::optional<size_t> {
+        if (auto limit = env.find(symbol); limit && limit->is<MalNumber>() && limit->as<MalNumber>()->getValue() >= 0) {
+            return static_cast<size_t>(limit->as<MalNumber>()->getValue());
+        }
+        return std::nullopt;
+    };
+    return { limitOf(lengthSymbol), limitOf(levelSymbol) };
 }
 
-std::shared_ptr<MalType> printString(MalContainer* args)
+namespace {
+void printResult(const MalType& result, Env& env)
 {
-    return std::make_shared<MalString>('"' + MalString::escapeString(joinTypeStrings(args)) + '"');
+    Printer printer(*OutputPort::standardOutput(), true, printLimits(env));
+    printer.print(result);
+    printer.write('\n');
+}
 }
 
-std::shared_ptr<MalType> str(MalContainer* args)
+bool isTruthy(MalType* value)
 {
-    std::string outStr = joinTypeStrings(args, false);
+    const auto boolean = value->as<MalBoolean>();
+    return !value->is<MalNil>() && !(boolean && !boolean->getValue());
+}
+
+// Calls the same function over and over with one argument list, its slots are overwritten in place
+// unless the callee kept the list (see MalContainer::set), so a call doesn't allocate arguments
+class FunctionCall {
+public:
+    FunctionCall(MalCallable* function, Env& env, size_t arity)
+        : m_function(function)
+        , m_env(env)
+    {
+        for (size_t argumentIndex = 0; argumentIndex < arity; ++argumentIndex) {
+            m_arguments.append(std::make_shared<MalNil>());
+        }
+    }
+
+    std::shared_ptr<MalType> operator()(std::shared_ptr<MalType> argument)
+    {
+        m_arguments.set(0, std::move(argument));
+        return m_function->evaluate(&m_arguments, m_env);
+    }
 
-    // remove quotes
-    std::string withoutQuotes;
-    if (!outStr.empty() && outStr[0] != '"') {
-        withoutQuotes += outStr[0];
+    std::shared_ptr<MalType> operator()(std::shared_ptr<MalType> first, std::shared_ptr<MalType> second)
+    {
+        m_arguments.set(0, std::move(first));
+        m_arguments.set(1, std::move(second));
+        return m_function->evaluate(&m_arguments, m_env);
     }
 
-    for (size_t i = 1; i < outStr.size(); ++i) {
-        if (outStr[i - 1] != '\\' && outStr[i] == '"') {
-            continue;
+private:
+    MalCallable* m_function;
+    Env& m_env;
+    MalList m_arguments;
+};
+
+// Runs elements through transducer steps, element that passes all of them goes to the sink
+class Pipeline {
+public:
+    Pipeline(const MalTransducer& transducer, Env& env)
+    {
+        m_steps.reserve(transducer.steps().size());
+        for (const auto& step : transducer.steps()) {
+            m_steps.emplace_back(step.type, FunctionCall(step.function->as<MalCallable>(), env, 1));
         }
-        withoutQuotes += outStr[i];
     }
-    return std::make_shared<MalString>('"' + withoutQuotes + '"');
+
+    // Returns exception of the step or the sink that failed, nullptr otherwise
+    template <typename Sink>
+    std::shared_ptr<MalType> feed(std::shared_ptr<MalType> element, Sink&& sink)
+    {
+        for (auto& [type, call] : m_steps) {
+            std::shared_ptr<MalType> result = call(element);
+            if (result->is<MalException>()) {
+                return result;
+            }
+            switch (type) {
+            case MalTransducer::StepType::MAP:
+                element = std::move(result);
+                break;
+            case MalTransducer::StepType::FILTER:
+                if (!isTruthy(result.get())) {
+                    return nullptr;
+                }
+                break;
+            case MalTransducer::StepType::REMOVE:
+                if (isTruthy(result.get())) {
+                    return nullptr;
+                }
+                break;
+            case MalTransducer::StepType::KEEP:
+                if (result->is<MalNil>()) {
+                    return nullptr;
+                }
+                element = std::move(result);
+                break;
+            }
+        }
+        return sink(std::move(element));
+    }
+
+private:
+    std::vector<std::pair<MalTransducer::StepType, FunctionCall>> m_steps;
+};
+
+bool isSequence(MalType* value)
+{
+    return value->is<MalContainer>() || value->is<MalLazySeq>() || value->is<MalNumericVector>() || value->is<MalNil>();
 }
 
-std::shared_ptr<MalType> println(MalContainer* args)
+// Lists and vectors are walked chunk by chunk, the same way lazy sequences are
+std::shared_ptr<MalLazySeq> containerChunks(std::shared_ptr<MalContainer> container)
 {
-    std::string outStr = joinTypeStrings(args);
-    std::string withoutQuotes;
-    for (size_t i = 0; i + 1 < outStr.size(); ++i) {
-        if (outStr[i] == '"') {
-            continue;
+    if (container->isEmpty()) {
+        return nullptr;
+    }
+    return std::make_shared<MalLazySeq>([container](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        const auto chunkSize = std::min(container->size(), MalLazySeq::chunkSize);
+        auto element = container->begin();
+        for (size_t elementIndex = 0; elementIndex < chunkSize; ++elementIndex, ++element) {
+            chunk.push_back(*element);
         }
-        if (outStr[i] == '\\' && outStr[i + 1] == '"') {
-            withoutQuotes += '"';
-            continue;
+        return containerChunks(container->slice(chunkSize, container->size() - chunkSize));
+    });
+}
+
+// Numeric vectors are walked chunk by chunk too, elements of a chunk are boxed once it is realized
+std::shared_ptr<MalLazySeq> numericVectorChunks(std::shared_ptr<MalNumericVector> vector, size_t offset)
+{
+    if (offset == vector->size()) {
+        return nullptr;
+    }
+    return std::make_shared<MalLazySeq>([vector, offset](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        const auto chunkEnd = std::min(vector->size(), offset + MalLazySeq::chunkSize);
+        for (auto elementIndex = offset; elementIndex < chunkEnd; ++elementIndex) {
+            chunk.push_back(vector->at(elementIndex));
+        }
+        return numericVectorChunks(vector, chunkEnd);
+    });
+}
+
+// NOTE: expects isSequence(), nil and empty containers become nullptr.
+// Takes the sequence by value, so passing takeAt() result doesn't keep the head alive until the end of full expression
+std::shared_ptr<MalLazySeq> toLazySeq(std::shared_ptr<MalType> sequence)
+{
+    if (sequence->is<MalLazySeq>()) {
+        return std::static_pointer_cast<MalLazySeq>(std::move(sequence));
+    } else if (sequence->is<MalContainer>()) {
+        return containerChunks(std::static_pointer_cast<MalContainer>(sequence));
+    } else if (sequence->is<MalNumericVector>()) {
+        return numericVectorChunks(std::static_pointer_cast<MalNumericVector>(std::move(sequence)), 0);
+    }
+    return nullptr;
+}
+
+std::shared_ptr<MalLazySeq> lazyTransform(std::shared_ptr<MalTransducer> transducer, std::shared_ptr<MalLazySeq> source, std::shared_ptr<Env> env)
+{
+    return std::make_shared<MalLazySeq>([transducer, source, env](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        // NOTE: chunk could end up empty, walkers skip such nodes
+        auto node = MalLazySeq::firstNonEmpty(source);
+        if (!node || node->is<MalException>()) {
+            return node;
+        }
+        auto sequence = std::static_pointer_cast<MalLazySeq>(node);
+        Pipeline pipeline(*transducer, *env);
+        for (const auto& element : sequence->chunk()) {
+            auto error = pipeline.feed(element, [&chunk](std::shared_ptr<MalType> result) -> std::shared_ptr<MalType> {
+                chunk.push_back(std::move(result));
+                return nullptr;
+            });
+            if (error) {
+                return error;
+            }
+        }
+        return sequence->next() ? lazyTransform(transducer, sequence->next(), env) : nullptr;
+    });
+}
+
+std::shared_ptr<MalLazySeq> lazyTakeWhile(std::shared_ptr<MalType> predicate, std::shared_ptr<MalLazySeq> source, std::shared_ptr<Env> env)
+{
+    return std::make_shared<MalLazySeq>([predicate, source, env](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        auto node = MalLazySeq::firstNonEmpty(source);
+        if (!node || node->is<MalException>()) {
+            return node;
+        }
+        auto sequence = std::static_pointer_cast<MalLazySeq>(node);
+        FunctionCall call(predicate->as<MalCallable>(), *env, 1);
+        for (const auto& element : sequence->chunk()) {
+            auto matches = call(element);
+            if (matches->is<MalException>()) {
+                return matches;
+            }
+            if (!isTruthy(matches.get())) {
+                return nullptr;
+            }
+            chunk.push_back(element);
+        }
+        return sequence->next() ? lazyTakeWhile(predicate, sequence->next(), env) : nullptr;
+    });
+}
+
+std::shared_ptr<MalLazySeq> lazyTake(size_t count, std::shared_ptr<MalLazySeq> source)
+{
+    return std::make_shared<MalLazySeq>([count, source](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        auto node = MalLazySeq::firstNonEmpty(source);
+        if (!node || node->is<MalException>()) {
+            return node;
         }
-        withoutQuotes += outStr[i];
+        auto sequence = std::static_pointer_cast<MalLazySeq>(node);
+        const auto taken = std::min(count, sequence->chunk().size());
+        chunk.assign(sequence->chunk().begin(), sequence->chunk().begin() + taken);
+        return taken < count && sequence->next() ? lazyTake(count - taken, sequence->next()) : nullptr;
+    });
+}
+
+std::shared_ptr<MalLazySeq> lazyDrop(size_t count, std::shared_ptr<MalLazySeq> source)
+{
+    return std::make_shared<MalLazySeq>([count, source](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        auto sequence = source;
+        auto toDrop = count;
+        while (sequence) {
+            if (auto error = sequence->realize(); error) {
+                return error;
+            }
+            if (toDrop < sequence->chunk().size()) {
+                chunk.assign(sequence->chunk().begin() + toDrop, sequence->chunk().end());
+                return sequence->next();
+            }
+            toDrop -= sequence->chunk().size();
+            sequence = sequence->next();
+        }
+        return nullptr;
+    });
+}
+
+std::shared_ptr<MalLazySeq> lazyConcat(std::vector<std::shared_ptr<MalLazySeq>> sources, size_t sourceIndex)
+{
+    return std::make_shared<MalLazySeq>([sources = std::move(sources), sourceIndex](MalLazySeq::Elements& chunk) mutable -> std::shared_ptr<MalType> {
+        for (; sourceIndex < sources.size(); ++sourceIndex) {
+            auto node = MalLazySeq::firstNonEmpty(sources[sourceIndex]);
+            if (node && node->is<MalException>()) {
+                return node;
+            } else if (node) {
+                auto sequence = std::static_pointer_cast<MalLazySeq>(node);
+                chunk = sequence->chunk();
+                sources[sourceIndex] = sequence->next();
+                return lazyConcat(std::move(sources), sourceIndex);
+            }
+        }
+        return nullptr;
+    });
+}
+
+std::shared_ptr<MalLazySeq> lazyRange(int64_t start, std::optional<int64_t> end, int64_t step)
+{
+    return std::make_shared<MalLazySeq>([start, end, step](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        auto current = start;
+        while (chunk.size() < MalLazySeq::chunkSize) {
+            if (end && (step > 0 ? current >= *end : current <= *end)) {
+                return nullptr;
+            }
+            chunk.push_back(std::make_shared<MalNumber>(current));
+            if (__builtin_add_overflow(current, step, &current)) {
+                return nullptr;
+            }
+        }
+        return lazyRange(current, end, step);
+    });
+}
+
+std::shared_ptr<MalLazySeq> lazyIterate(std::shared_ptr<MalType> function, std::shared_ptr<MalType> value, std::shared_ptr<Env> env)
+{
+    return std::make_shared<MalLazySeq>([function, value, env](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        auto current = value;
+        FunctionCall call(function->as<MalCallable>(), *env, 1);
+        for (size_t elementIndex = 0; elementIndex < MalLazySeq::chunkSize; ++elementIndex) {
+            chunk.push_back(current);
+            current = call(current);
+            if (current->is<MalException>()) {
+                return current;
+            }
+        }
+        return lazyIterate(function, current, env);
+    });
+}
+
+std::shared_ptr<MalTransducer> singleStep(MalTransducer::StepType type, std::shared_ptr<MalType> function)
+{
+    return std::make_shared<MalTransducer>(std::vector { MalTransducer::Step { type, std::move(function) } });
+}
+
+// (filter p coll) is lazy sequence, (filter p) is a transducer, same for remove and keep
+std::shared_ptr<MalType> transformSequence(MalTransducer::StepType type, const std::string& name, MalContainer* args, Env& env)
+{
+    if (args->isEmpty() || !args->at(0)->is<MalCallable>()) {
+        return MalException::throwException(name + " expects function as first argument");
+    } else if (args->size() == 1) {
+        return singleStep(type, args->at(0));
+    } else if (!isSequence(args->at(1).get())) {
+        return MalException::throwException(name + " expects sequence as second argument");
+    }
+    return lazyTransform(singleStep(type, args->at(0)), toLazySeq(args->takeAt(1)), env.captured());
+}
+
+// Walks list, vector, numeric vector, lazy sequence or nil, stops on the first exception visit returns
+template <typename Visitor>
+std::shared_ptr<MalType> walkSequence(std::shared_ptr<MalType> sequence, Visitor&& visit)
+{
+    if (auto container = sequence->as<MalContainer>(); container) {
+        for (const auto& element : *container) {
+            if (auto error = visit(element); error) {
+                return error;
+            }
+        }
+        return nullptr;
+    }
+    std::shared_ptr<MalType> error;
+    auto realizeError = MalLazySeq::forEach(toLazySeq(std::move(sequence)), [&](const auto& element) {
+        error = visit(element);
+        return !error;
+    });
+    return realizeError ? realizeError : error;
+}
+
+std::shared_ptr<MalType> prn(MalContainer* args, Env& env)
+{
+    Printer printer(*OutputPort::standardOutput(), true, printLimits(env));
+    printTypes(args, printer);
+    printer.write('\n');
+    return std::make_shared<MalNil>();
+}
+
+std::shared_ptr<MalType> printString(MalContainer* args, Env& env)
+{
+    auto outStr = std::make_shared<std::string>();
+    {
+        Printer printer(*outStr, true, printLimits(env));
+        printTypes(args, printer);
     }
-    std::cout << MalString::unEscapeString(withoutQuotes) << std::endl;
+    return std::make_shared<MalString>(outStr, outStr->size());
+}
+
+std::shared_ptr<MalType> str(MalContainer* args)
+{
+    // NOTE: strings are usually built piece by piece with (str acc piece),
+    // so if the accumulator ends its buffer, the rest is appended right into it
+    // and the result shares the buffer, that keeps building amortized linear.
+    size_t firstPiece = 0;
+    std::shared_ptr<std::string> outStr;
+    if (auto accumulator = args->isEmpty() ? nullptr : args->at(0)->as<MalString>(); accumulator) {
+        if ((outStr = accumulator->appendableBuffer())) {
+            firstPiece = 1;
+        }
+    }
+    if (!outStr) {
+        outStr = std::make_shared<std::string>();
+    }
+
+    Printer printer(*outStr, false);
+    for (size_t pieceIndex = firstPiece; pieceIndex < args->size(); ++pieceIndex) {
+        printer.print(*args->at(pieceIndex));
+    }
+    return std::make_shared<MalString>(outStr, outStr->size());
+}
+
+std::shared_ptr<MalType> println(MalContainer* args, Env& env)
+{
+    Printer printer(*OutputPort::standardOutput(), false, printLimits(env));
+    printTypes(args, printer);
+    printer.write('\n');
     return std::make_shared<MalNil>();
 }
 
@@ -130,10 +560,23 @@ std::shared_ptr<MalType> vec(MalContainer* args)
 {
     auto vector = std::make_shared<MalVector>();
     if (!args->isEmpty()) {
-        if (!args->at(0)->asMalContainer()) {
+        if (args->at(0)->is<MalLazySeq>()) {
+            auto error = MalLazySeq::forEach(toLazySeq(args->takeAt(0)), [&vector](const auto& element) { vector->append(element); return true; });
+            return error ? error : vector;
+        }
+        if (auto numericVector = args->at(0)->as<MalNumericVector>(); numericVector) {
+            for (size_t elementIndex = 0; elementIndex < numericVector->size(); ++elementIndex) {
+                vector->append(numericVector->at(elementIndex));
+            }
+            return vector;
+        }
+        if (!args->at(0)->is<MalContainer>()) {
             return MalException::throwException("Could only be applied to list or vectors");
         }
-        for (const auto& obj : *args->at(0)->asMalContainer()) {
+        if (args->at(0)->as<MalContainer>()->type() == MalContainer::ContainerType::VECTOR) {
+            return args->at(0)->clone();
+        }
+        for (const auto& obj : *args->at(0)->as<MalContainer>()) {
             vector->append(obj);
         }
     }
@@ -142,27 +585,41 @@ std::shared_ptr<MalType> vec(MalContainer* args)
 
 std::shared_ptr<MalType> isList(MalContainer* args)
 {
-    const auto list = args->head()->asMalContainer();
+    const auto list = args->head()->as<MalContainer>();
     return std::make_shared<MalBoolean>(list != nullptr && list->type() == MalContainer::ContainerType::LIST);
 }
 
 std::shared_ptr<MalType> isEmpty(MalContainer* args)
 {
-    auto ls = args->head()->asMalContainer();
+    if (args->head()->is<MalLazySeq>()) {
+        auto node = MalLazySeq::firstNonEmpty(toLazySeq(args->head()));
+        return node && node->is<MalException>() ? node : std::make_shared<MalBoolean>(node == nullptr);
+    }
+    if (auto vector = args->head()->as<MalNumericVector>(); vector) {
+        return std::make_shared<MalBoolean>(vector->size() == 0);
+    }
+    auto ls = args->head()->as<MalContainer>();
     return std::make_shared<MalBoolean>(ls && ls->size() == 0);
 }
 
 std::shared_ptr<MalType> isAtom(MalContainer *args)
 {
-    return std::make_shared<MalBoolean>(args->head()->asMalAtom() != nullptr);
+    return std::make_shared<MalBoolean>(args->head()->is<MalAtom>());
 }
 
 std::shared_ptr<MalType> count(MalContainer* args)
 {
-    if (auto first = args->head(); first->asMalContainer()) {
-        return std::make_shared<MalNumber>(first->asMalContainer()->size());
-    } else if (first->asMalNil()) {
+    if (auto first = args->head(); first->is<MalContainer>()) {
+        return std::make_shared<MalNumber>(first->as<MalContainer>()->size());
+    } else if (auto vector = first->as<MalNumericVector>(); vector) {
+        return std::make_shared<MalNumber>(vector->size());
+    } else if (first->is<MalNil>()) {
         return std::make_shared<MalNumber>(0);
+    } else if (first->is<MalLazySeq>()) {
+        first.reset();
+        int64_t elementsCount = 0;
+        auto error = MalLazySeq::forEach(toLazySeq(args->takeAt(0)), [&elementsCount](const auto&) { ++elementsCount; return true; });
+        return error ? error : std::make_shared<MalNumber>(elementsCount);
     }
     return std::make_shared<MalNil>();
 }
@@ -208,43 +665,281 @@ std::shared_ptr<MalType> malNot(MalContainer* args)
 
 std::shared_ptr<MalType> plus(MalContainer* args)
 {
-    return applyArithmeticOperations(args, std::plus<int>());
+    return applyArithmeticOperations<PlusOperation>(args);
 }
 
 std::shared_ptr<MalType> minus(MalContainer* args)
 {
-    return applyArithmeticOperations(args, std::minus<int>());
+    return applyArithmeticOperations<MinusOperation>(args);
 }
 
 std::shared_ptr<MalType> divides(MalContainer* args)
 {
-    return applyArithmeticOperations(args, std::divides<int>());
+    return applyArithmeticOperations<DividesOperation>(args);
 }
 
 std::shared_ptr<MalType> multiplies(MalContainer* args)
 {
-    return applyArithmeticOperations(args, std::multiplies<int>());
+    return applyArithmeticOperations<MultipliesOperation>(args);
+}
+
+// Operand of numeric vector builtin as contiguous array, number is repeated to the length of the other operand
+template <typename T>
+class NumericOperand {
+public:
+    NumericOperand(MalType* operand, size_t size)
+    {
+        auto vector = operand->as<MalNumericVector>();
+        if constexpr (std::is_same_v<T, double>) {
+            if (vector && vector->isDouble()) {
+                m_data = vector->doubles().data();
+                return;
+            }
+            m_elements = vector ? std::vector<double>(vector->integers().begin(), vector->integers().end()) : std::vector<double>(size, toDouble(operand));
+        } else {
+            if (vector) {
+                m_data = vector->integers().data();
+                return;
+            }
+            m_elements = std::vector<int64_t>(size, operand->as<MalNumber>()->getValue());
+        }
+        m_data = m_elements.data();
+    }
+
+    const T* data() const { return m_data; }
+
+private:
+    std::vector<T> m_elements;
+    const T* m_data { nullptr };
+};
+
+// Both operands are ivec, dvec or number, at least one is a vector and vectors are of the same length.
+// Doubles are used if any operand holds them.
+std::shared_ptr<MalType> checkNumericOperands(MalContainer* args, const std::string& name, size_t& size, bool& useDoubles)
+{
+    if (args->size() != 2) {
+        return MalException::throwException(name + " expects two arguments");
+    }
+    std::optional<size_t> vectorSize;
+    useDoubles = false;
+    for (const auto& operand : *args) {
+        if (auto vector = operand->as<MalNumericVector>(); vector) {
+            if (vectorSize && *vectorSize != vector->size()) {
+                return MalException::throwException(name + " expects vectors of the same length");
+            }
+            vectorSize = vector->size();
+            useDoubles |= vector->isDouble();
+        } else if (operand->is<MalNumber>() || operand->is<MalDouble>()) {
+            useDoubles |= operand->is<MalDouble>();
+        } else {
+            return MalException::throwException(name + " expects ivec, dvec or number");
+        }
+    }
+    if (!vectorSize) {
+        return MalException::throwException(name + " expects at least one ivec or dvec");
+    }
+    size = *vectorSize;
+    return nullptr;
+}
+
+using IntegerKernel = bool (*)(const int64_t*, const int64_t*, int64_t*, size_t);
+using DoubleKernel = void (*)(const double*, const double*, double*, size_t);
+
+std::shared_ptr<MalType> elementwise(MalContainer* args, const std::string& name, IntegerKernel integerKernel, DoubleKernel doubleKernel)
+{
+    size_t size = 0;
+    bool useDoubles = false;
+    if (auto error = checkNumericOperands(args, name, size, useDoubles); error) {
+        return error;
+    }
+    if (useDoubles) {
+        MalNumericVector::Doubles result(size);
+        doubleKernel(NumericOperand<double>(args->at(0).get(), size).data(), NumericOperand<double>(args->at(1).get(), size).data(), result.data(), size);
+        return std::make_shared<MalNumericVector>(std::move(result));
+    }
+    MalNumericVector::Integers result(size);
+    if (!integerKernel(NumericOperand<int64_t>(args->at(0).get(), size).data(), NumericOperand<int64_t>(args->at(1).get(), size).data(), result.data(), size)) {
+        return MalException::throwException(name + " overflowed ivec element, dvec could be used instead");
+    }
+    return std::make_shared<MalNumericVector>(std::move(result));
+}
+
+std::shared_ptr<MalType> compareElements(MalContainer* args, const std::string& name, simd::Comparison comparison)
+{
+    size_t size = 0;
+    bool useDoubles = false;
+    if (auto error = checkNumericOperands(args, name, size, useDoubles); error) {
+        return error;
+    }
+    MalNumericVector::Integers mask(size);
+    if (useDoubles) {
+        simd::compare(NumericOperand<double>(args->at(0).get(), size).data(), NumericOperand<double>(args->at(1).get(), size).data(), mask.data(), size, comparison);
+    } else {
+        simd::compare(NumericOperand<int64_t>(args->at(0).get(), size).data(), NumericOperand<int64_t>(args->at(1).get(), size).data(), mask.data(), size, comparison);
+    }
+    return std::make_shared<MalNumericVector>(std::move(mask));
+}
+
+const MalNumericVector* numericVectorArgument(MalContainer* args)
+{
+    return args->size() == 1 ? args->at(0)->as<MalNumericVector>() : nullptr;
+}
+
+std::shared_ptr<MalType> makeIntegerVector(MalContainer* args)
+{
+    // (ivec [1 2 3]) -> [1 2 3] stored as unboxed int64
+    if (args->size() != 1 || !isSequence(args->at(0).get())) {
+        return MalException::throwException("ivec expects sequence of integers");
+    }
+    MalNumericVector::Integers elements;
+    if (auto vector = numericVectorArgument(args); vector && !vector->isDouble()) {
+        return args->at(0);
+    } else if (vector) {
+        return MalException::throwException("ivec expects sequence of integers");
+    }
+    auto error = walkSequence(args->takeAt(0), [&elements](const auto& element) -> std::shared_ptr<MalType> {
+        if (!element->template is<MalNumber>()) {
+            return MalException::throwException("ivec expects sequence of integers");
+        }
+        elements.push_back(element->template as<MalNumber>()->getValue());
+        return nullptr;
+    });
+    return error ? error : std::make_shared<MalNumericVector>(std::move(elements));
+}
+
+std::shared_ptr<MalType> makeDoubleVector(MalContainer* args)
+{
+    // (dvec [1 2.5]) -> [1.0 2.5] stored as unboxed doubles
+    if (args->size() != 1 || !isSequence(args->at(0).get())) {
+        return MalException::throwException("dvec expects sequence of numbers");
+    }
+    if (auto vector = numericVectorArgument(args); vector) {
+        return vector->isDouble() ? args->at(0) : std::make_shared<MalNumericVector>(MalNumericVector::Doubles(vector->integers().begin(), vector->integers().end()));
+    }
+    MalNumericVector::Doubles elements;
+    auto error = walkSequence(args->takeAt(0), [&elements](const auto& element) -> std::shared_ptr<MalType> {
+        if (!isNumber(element.get())) {
+            return MalException::throwException("dvec expects sequence of numbers");
+        }
+        elements.push_back(toDouble(element.get()));
+        return nullptr;
+    });
+    return error ? error : std::make_shared<MalNumericVector>(std::move(elements));
+}
+
+std::shared_ptr<MalType> vectorPlus(MalContainer* args)
+{
+    return elementwise(args, "v+", simd::add, simd::add);
+}
+
+std::shared_ptr<MalType> vectorMultiplies(MalContainer* args)
+{
+    return elementwise(args, "v*", simd::multiply, simd::multiply);
+}
+
+std::shared_ptr<MalType> vectorLess(MalContainer* args)
+{
+    return compareElements(args, "v<", simd::Comparison::LESS);
+}
+
+std::shared_ptr<MalType> vectorGreater(MalContainer* args)
+{
+    return compareElements(args, "v>", simd::Comparison::GREATER);
+}
+
+std::shared_ptr<MalType> vectorEqual(MalContainer* args)
+{
+    return compareElements(args, "v=", simd::Comparison::EQUAL);
+}
+
+std::shared_ptr<MalType> sum(MalContainer* args)
+{
+    auto vector = numericVectorArgument(args);
+    if (!vector) {
+        return MalException::throwException("sum expects ivec or dvec");
+    } else if (vector->isDouble()) {
+        return std::make_shared<MalDouble>(simd::sum(vector->doubles().data(), vector->size()));
+    } else if (auto result = simd::sum(vector->integers().data(), vector->size()); result) {
+        return std::make_shared<MalNumber>(*result);
+    }
+    // sum doesn't fit into fixnum
+    BigInteger result;
+    for (auto element : vector->integers()) {
+        result = result + BigInteger(element);
+    }
+    return MalBigInteger::normalized(std::move(result));
+}
+
+std::shared_ptr<MalType> dot(MalContainer* args)
+{
+    size_t size = 0;
+    bool useDoubles = false;
+    if (auto error = checkNumericOperands(args, "dot", size, useDoubles); error) {
+        return error;
+    }
+    if (useDoubles) {
+        return std::make_shared<MalDouble>(simd::dot(NumericOperand<double>(args->at(0).get(), size).data(), NumericOperand<double>(args->at(1).get(), size).data(), size));
+    }
+    const NumericOperand<int64_t> lhs(args->at(0).get(), size);
+    const NumericOperand<int64_t> rhs(args->at(1).get(), size);
+    if (auto result = simd::dot(lhs.data(), rhs.data(), size); result) {
+        return std::make_shared<MalNumber>(*result);
+    }
+    BigInteger result;
+    for (size_t elementIndex = 0; elementIndex < size; ++elementIndex) {
+        result = result + BigInteger(lhs.data()[elementIndex]) * BigInteger(rhs.data()[elementIndex]);
+    }
+    return MalBigInteger::normalized(std::move(result));
+}
+
+template <bool isMin>
+std::shared_ptr<MalType> vectorExtremum(MalContainer* args)
+{
+    auto vector = numericVectorArgument(args);
+    if (!vector || vector->size() == 0) {
+        return MalException::throwException(std::string(isMin ? "vmin" : "vmax") + " expects non empty ivec or dvec");
+    } else if (vector->isDouble()) {
+        const auto* elements = vector->doubles().data();
+        return std::make_shared<MalDouble>(isMin ? simd::min(elements, vector->size()) : simd::max(elements, vector->size()));
+    }
+    const auto* elements = vector->integers().data();
+    return std::make_shared<MalNumber>(isMin ? simd::min(elements, vector->size()) : simd::max(elements, vector->size()));
+}
+
+std::shared_ptr<MalType> vectorMin(MalContainer* args)
+{
+    return vectorExtremum<true>(args);
+}
+
+std::shared_ptr<MalType> vectorMax(MalContainer* args)
+{
+    return vectorExtremum<false>(args);
 }
 
 std::shared_ptr<MalType> readString(MalType* args, Env&)
 {
-    const auto progWithQuotes = args->asMalContainer() ? args->asMalContainer()->at(0)->asString() : args->asString();
-    const auto prog = progWithQuotes.substr(1, progWithQuotes.size() - 2);
-    return mal::readStr(prog);
+    auto program = args;
+    if (auto container = args->as<MalContainer>(); container) {
+        if (container->isEmpty()) {
+            return MalException::throwException("read-string expects a string");
+        }
+        program = container->at(0).get();
+    }
+    if (!program->is<MalString>()) {
+        return MalException::throwException("read-string expects a string");
+    }
+    return mal::readStr(program->as<MalString>()->value());
 }
 
-std::optional<std::string> readFile(const std::string& filePath)
+std::optional<std::string> readFile(MalType* filePath)
 {
-    if (filePath.empty()) {
+    if (!filePath->is<MalString>()) {
         return std::nullopt;
     }
 
-    const auto fileName = filePath.front() == '"' ? filePath.substr(1, filePath.size() - 2) : filePath;
-    std::ifstream is(fileName, std::ios::in);
+    std::ifstream is(std::string(filePath->as<MalString>()->value()), std::ios::in | std::ios::binary);
     if (is.is_open()) {
-        std::stringstream buffer;
-        buffer << is.rdbuf();
-        return buffer.str();
+        return std::string(std::istreambuf_iterator<char>(is), {});
     }
 
     return std::nullopt;
@@ -256,14 +951,272 @@ std::shared_ptr<MalType> slurp(MalContainer* args, Env&)
         return MalException::throwException("slurp expect file name");
     }
 
-    auto fileContent = readFile(args->at(0)->asString());
+    if (const auto path = args->at(0)->as<MalString>(); path) {
+        // the content is copied out of the mapping, the file could change or shrink while the string lives
+        if (const auto file = MappedFile::open(std::string(path->value())); file) {
+            auto content = std::make_shared<std::string>(file->view());
+            return std::make_shared<MalString>(content, content->size());
+        }
+    }
+
+    // pipes and devices can't be mapped, they are read into a buffer
+    auto fileContent = readFile(args->at(0).get());
     if (fileContent.has_value()){
-        return std::make_shared<MalSymbol>('"' + MalString::escapeString(fileContent.value()) + '"');
+        auto content = std::make_shared<std::string>(std::move(fileContent.value()));
+        return std::make_shared<MalString>(content, content->size());
+    }
+
+    return MalException::throwException("Couldn't open the file");
+}
+
+// (read-all "1 (2) [3]") -> [1 (2) [3]], forms of big texts are read on all cores
+std::shared_ptr<MalType> readAllForms(MalContainer* args)
+{
+    if (args->isEmpty() || !args->at(0)->is<MalString>()) {
+        return MalException::throwException("read-all expects a string");
     }
+    return mal::readAll(args->at(0)->as<MalString>()->value());
+}
 
+// (load-data "dump.edn") reads top level forms of a data file without evaluating them
+std::shared_ptr<MalType> loadData(MalContainer* args)
+{
+    if (args->isEmpty() || !args->at(0)->is<MalString>()) {
+        return MalException::throwException("load-data expects a file name");
+    }
+    if (const auto file = MappedFile::open(std::string(args->at(0)->as<MalString>()->value())); file) {
+        return mal::readAll(file->view());
+    }
+    if (const auto fileContent = readFile(args->at(0).get()); fileContent) {
+        return mal::readAll(*fileContent);
+    }
     return MalException::throwException("Couldn't open the file");
 }
 
+namespace {
+// Open port of the given direction, nullptr for anything else
+OutputPort* outputPortOf(MalType* value)
+{
+    if (const auto port = value->as<MalPort>(); port && port->output() && !port->output()->isClosed()) {
+        return port->output();
+    }
+    return nullptr;
+}
+
+std::shared_ptr<InputPort> inputPortOf(MalType* value)
+{
+    if (const auto port = value->as<MalPort>(); port && port->input() && !port->input()->isClosed()) {
+        return port->input();
+    }
+    return nullptr;
+}
+
+// Prints values from firstValue on like str does
+void writeValues(MalContainer* args, size_t firstValue, OutputPort& port)
+{
+    Printer printer(port, false);
+    for (size_t valueIndex = firstValue; valueIndex < args->size(); ++valueIndex) {
+        printer.print(*args->at(valueIndex));
+    }
+}
+
+std::shared_ptr<MalLazySeq> lazyLines(std::shared_ptr<InputPort> port)
+{
+    return std::make_shared<MalLazySeq>([port](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        while (chunk.size() < MalLazySeq::chunkSize) {
+            const auto line = port->readLine();
+            if (!line) {
+                return nullptr;
+            }
+            chunk.push_back(std::make_shared<MalString>(*line));
+        }
+        return lazyLines(port);
+    });
+}
+
+std::shared_ptr<MalType> spitInto(MalContainer* args, bool append, const std::string& name)
+{
+    if (args->isEmpty() || !args->at(0)->is<MalString>()) {
+        return MalException::throwException(name + " expects a file name");
+    }
+    const auto port = OutputPort::open(std::string(args->at(0)->as<MalString>()->value()), append);
+    if (!port) {
+        return MalException::throwException(name + ": couldn't open the file");
+    }
+    writeValues(args, 1, *port);
+    if (!port->close()) {
+        return MalException::throwException(name + ": couldn't write the file");
+    }
+    return std::make_shared<MalNil>();
+}
+}
+
+std::shared_ptr<MalType> standardOutput(MalContainer*)
+{
+    static const auto port = std::make_shared<MalPort>(OutputPort::standardOutput());
+    return port;
+}
+
+std::shared_ptr<MalType> standardError(MalContainer*)
+{
+    static const auto port = std::make_shared<MalPort>(OutputPort::standardError());
+    return port;
+}
+
+std::shared_ptr<MalType> standardInput(MalContainer*)
+{
+    static const auto port = std::make_shared<MalPort>(InputPort::standardInput());
+    return port;
+}
+
+// (open-output "log.txt") truncates the file, (open-output "log.txt" :append) appends to it
+std::shared_ptr<MalType> openOutput(MalContainer* args)
+{
+    static const auto* appendKeyword = MalSymbol::intern(":append", MalSymbol::SymbolType::KEYWORD).get();
+    if (args->isEmpty() || !args->at(0)->is<MalString>()) {
+        return MalException::throwException("open-output expects a file name");
+    }
+    const bool append = args->size() > 1 && args->at(1).get() == appendKeyword;
+    if (auto port = OutputPort::open(std::string(args->at(0)->as<MalString>()->value()), append); port) {
+        return std::make_shared<MalPort>(std::move(port));
+    }
+    return MalException::throwException("open-output: couldn't open the file");
+}
+
+std::shared_ptr<MalType> openInput(MalContainer* args)
+{
+    if (args->isEmpty() || !args->at(0)->is<MalString>()) {
+        return MalException::throwException("open-input expects a file name");
+    }
+    if (auto port = InputPort::open(std::string(args->at(0)->as<MalString>()->value())); port) {
+        return std::make_shared<MalPort>(std::move(port));
+    }
+    return MalException::throwException("open-input: couldn't open the file");
+}
+
+// (write port "a" 1) prints values like str does, they go out once the port buffer fills up
+std::shared_ptr<MalType> writePort(MalContainer* args)
+{
+    const auto port = args->isEmpty() ? nullptr : outputPortOf(args->at(0).get());
+    if (!port) {
+        return MalException::throwException("write expects an open output port");
+    }
+    writeValues(args, 1, *port);
+    return std::make_shared<MalNil>();
+}
+
+// (flush) flushes stdout, (flush port) the port
+std::shared_ptr<MalType> flushPort(MalContainer* args)
+{
+    const auto port = args->isEmpty() ? OutputPort::standardOutput().get() : outputPortOf(args->at(0).get());
+    if (!port) {
+        return MalException::throwException("flush expects an open output port");
+    }
+    if (!port->flush()) {
+        return MalException::throwException("flush: couldn't write " + port->name());
+    }
+    return std::make_shared<MalNil>();
+}
+
+std::shared_ptr<MalType> closePort(MalContainer* args)
+{
+    const auto port = args->isEmpty() ? nullptr : args->at(0)->as<MalPort>();
+    if (!port) {
+        return MalException::throwException("close expects a port");
+    }
+    if (port->input()) {
+        port->input()->close();
+    } else if (!port->output()->close()) {
+        return MalException::throwException("close: couldn't write " + port->output()->name());
+    }
+    return std::make_shared<MalNil>();
+}
+
+// (read-line) reads stdin, (read-line port) the port, nil at the end of input
+std::shared_ptr<MalType> readLine(MalContainer* args)
+{
+    const auto port = args->isEmpty() ? InputPort::standardInput() : inputPortOf(args->at(0).get());
+    if (!port) {
+        return MalException::throwException("read-line expects an open input port");
+    }
+    if (const auto line = port->readLine(); line) {
+        return std::make_shared<MalString>(*line);
+    }
+    return std::make_shared<MalNil>();
+}
+
+// (line-seq port) or (line-seq "file.log") is a lazy sequence of lines, read a buffer at a time
+std::shared_ptr<MalType> lineSeq(MalContainer* args)
+{
+    if (args->isEmpty()) {
+        return MalException::throwException("line-seq expects an input port or a file name");
+    }
+    if (const auto path = args->at(0)->as<MalString>(); path) {
+        if (auto port = InputPort::open(std::string(path->value())); port) {
+            return lazyLines(std::move(port));
+        }
+        return MalException::throwException("line-seq: couldn't open the file");
+    }
+    if (auto port = inputPortOf(args->at(0).get()); port) {
+        return lazyLines(std::move(port));
+    }
+    return MalException::throwException("line-seq expects an input port or a file name");
+}
+
+// (spit "out.txt" "a" 1) writes values like str does, spit-append appends them
+std::shared_ptr<MalType> spit(MalContainer* args)
+{
+    return spitInto(args, false, "spit");
+}
+
+std::shared_ptr<MalType> spitAppend(MalContainer* args)
+{
+    return spitInto(args, true, "spit-append");
+}
+
+// (json-read "{\"a\": [1, 2]}") -> {:a [1 2]}
+// (json-read text ["a" 1]) -> 2, only the value at the path is built, nil if there is none
+std::shared_ptr<MalType> jsonRead(MalContainer* args)
+{
+    if (args->isEmpty() || !args->at(0)->is<MalString>()) {
+        return MalException::throwException("json-read expects a string");
+    }
+    const auto text = args->at(0)->as<MalString>()->value();
+    if (args->size() < 2) {
+        return json::read(text);
+    }
+
+    const auto path = args->at(1)->as<MalContainer>();
+    if (!path) {
+        return MalException::throwException("json-read expects a path of keys and indexes");
+    }
+    std::vector<json::PathStep> steps;
+    for (const auto& step : *path) {
+        if (auto keyword = step->as<MalSymbol>(); keyword && keyword->getType() == MalSymbol::SymbolType::KEYWORD) {
+            steps.push_back({ .key = keyword->name().substr(1) });
+        } else if (auto key = step->as<MalString>(); key) {
+            steps.push_back({ .key = key->value() });
+        } else if (auto index = step->as<MalNumber>(); index && index->getValue() >= 0) {
+            steps.push_back({ .key = {}, .index = static_cast<size_t>(index->getValue()), .isIndex = true });
+        } else {
+            return MalException::throwException("json-read path steps are keys and indexes, got " + step->asString());
+        }
+    }
+    return json::read(text, steps);
+}
+
+std::shared_ptr<MalType> jsonWrite(MalContainer* args)
+{
+    if (args->isEmpty()) {
+        return MalException::throwException("json-write expects a value");
+    }
+    auto out = std::make_shared<std::string>();
+    if (auto error = json::write(args->at(0).get(), *out); error) {
+        return error;
+    }
+    return std::make_shared<MalString>(out, out->size());
+}
+
 std::shared_ptr<MalType> eval(MalContainer* args, Env& env)
 {
     if (args->isEmpty()) {
@@ -284,14 +1237,56 @@ std::shared_ptr<MalType> eval(MalContainer* args, Env& env)
 
 std::shared_ptr<MalType> loadFile(MalContainer* args, Env& env)
 {
-    auto fileContent = readFile(args->at(0)->asString());
-    if (fileContent.has_value()) {
-        auto program = std::make_shared<MalSymbol>("\"(do " + fileContent.value() + "\n)\"");
-        auto ast = readString(program.get(), env);
-        std::cout << eval(ast->asMalContainer(), env)->asString() << std::endl;
-        return std::make_shared<MalNil>();
+    if (args->isEmpty() || !args->at(0)->is<MalString>()) {
+        return std::make_shared<MalException>("Failed to load file");
+    }
+    // regular files are read right from the mapping, pipes and devices are streamed
+    const std::string path(args->at(0)->as<MalString>()->value());
+    const auto file = MappedFile::open(path);
+    std::ifstream input;
+    if (!file) {
+        input.open(path, std::ios::in | std::ios::binary);
+        if (!input.is_open()) {
+            return std::make_shared<MalException>("Failed to load file");
+        }
     }
-    return std::make_shared<MalException>("Failed to load file");
+
+    // forms read from a regular file are cached next to it, an unchanged file is not parsed again
+    std::shared_ptr<MalType> result = std::make_shared<MalNil>();
+    if (file) {
+        if (const auto cachedForms = formcache::Reader::open(path, file->view()); cachedForms) {
+            while (auto form = cachedForms->next()) {
+                if (result = EVAL(form, env); result->is<MalException>()) {
+                    break;
+                }
+            }
+            if (cachedForms->isDamaged()) {
+                return MalException::throwException("load-file: damaged cache " + formcache::cachePath(path));
+            }
+            printResult(*result, env);
+            return std::make_shared<MalNil>();
+        }
+    }
+
+    // forms are evaluated as they are read, like (do ...) of the whole file would, it stops on exception.
+    // They are encoded into the cache right away, no more than one form of the file is held at a time
+    auto reader = file ? FormReader(file->view()) : FormReader(input);
+    formcache::Writer cache;
+    bool isReadToEnd = true;
+    while (auto form = reader.next()) {
+        if (file) {
+            cache.add(form.get());
+        }
+        if (result = EVAL(form, env); result->is<MalException>()) {
+            isReadToEnd = false;
+            break;
+        }
+    }
+    if (file && isReadToEnd) {
+        cache.store(path, file->view());
+    }
+    printResult(*result, env);
+    return std::make_shared<MalNil>();
 }
 
 std::shared_ptr<MalType> deref(MalContainer* args)
@@ -300,8 +1295,8 @@ std::shared_ptr<MalType> deref(MalContainer* args)
         return MalException::throwException("Not enough arguments");
     }
 
-    if (const auto malAtom = args->at(0); malAtom->asMalAtom()) {
-        return malAtom->asMalAtom()->deref();
+    if (const auto malAtom = args->at(0); malAtom->is<MalAtom>()) {
+        return malAtom->as<MalAtom>()->deref();
     }
     return MalException::throwException("Value is not an atom");;
 }
@@ -316,17 +1311,44 @@ std::shared_ptr<MalType> cons(MalContainer *args)
     if (args->size() < 2) {
         return MalException::throwException("Not enough arguments");
     }
-    if (auto originalContainer = args->at(1)->asMalContainer(); originalContainer) {
-        auto list = std::make_shared<MalList>();
-        list->append(args->at(0));
-        for (const auto& elem : *originalContainer) {
-            list->append(elem);
-        }
-        return list;
+    if (auto originalContainer = args->at(1)->as<MalContainer>(); originalContainer) {
+        return originalContainer->cons(args->at(0));
+    } else if (args->at(1)->is<MalLazySeq>()) {
+        return std::make_shared<MalLazySeq>(MalLazySeq::Elements { args->at(0) }, toLazySeq(args->at(1)));
     }
     return MalException::throwException("Can append only to vectors and list");
 }
 
+std::shared_ptr<MalType> conj(MalContainer* args)
+{
+    // (conj [1 2] 3 4) -> [1 2 3 4], (conj (list 1 2) 3 4) -> (4 3 1 2)
+    if (!args->isEmpty() && args->at(0)->is<MalLazySeq>()) {
+        auto sequence = toLazySeq(args->at(0));
+        for (size_t elementIndex = 1; elementIndex < args->size(); ++elementIndex) {
+            sequence = std::make_shared<MalLazySeq>(MalLazySeq::Elements { args->at(elementIndex) }, sequence);
+        }
+        return sequence;
+    }
+    if (args->isEmpty() || !args->at(0)->is<MalContainer>()) {
+        return MalException::throwException("Can conj only to vectors and list");
+    }
+
+    auto originalContainer = args->at(0)->as<MalContainer>();
+    if (originalContainer->type() == MalContainer::ContainerType::VECTOR) {
+        auto vector = std::static_pointer_cast<MalContainer>(originalContainer->clone());
+        for (size_t elementIndex = 1; elementIndex < args->size(); ++elementIndex) {
+            vector->append(args->at(elementIndex));
+        }
+        return vector;
+    }
+
+    auto list = std::static_pointer_cast<MalContainer>(originalContainer->clone());
+    for (size_t elementIndex = 1; elementIndex < args->size(); ++elementIndex) {
+        list = list->cons(args->at(elementIndex));
+    }
+    return list;
+}
+
 std::shared_ptr<MalType> concat(MalContainer* args)
 {
     auto list = std::make_shared<MalList>();
@@ -334,12 +1356,26 @@ std::shared_ptr<MalType> concat(MalContainer* args)
         return list;
     }
 
+    // concatenation of lazy sequences stays lazy
+    if (std::any_of(args->begin(), args->end(), [](const auto& arg) { return arg->template is<MalLazySeq>(); })) {
+        std::vector<std::shared_ptr<MalLazySeq>> sources;
+        for (const auto& arg : *args) {
+            sources.push_back(isSequence(arg.get()) ? toLazySeq(arg) : std::make_shared<MalLazySeq>(MalLazySeq::Elements { arg }, nullptr));
+        }
+        return lazyConcat(std::move(sources), 0);
+    }
+
     //([1 2] (list 3 4) [5 6])
     for (size_t elementIndex = 0; elementIndex < args->size(); ++elementIndex) {
-        if (const auto maybeContainer = args->at(elementIndex)->asMalContainer(); maybeContainer) {
+        if (const auto maybeContainer = args->at(elementIndex)->as<MalContainer>(); maybeContainer) {
             for (const auto& elem : *maybeContainer) {
                 list->append(elem);
             }
+        } else if (args->at(elementIndex)->is<MalNumericVector>()) {
+            walkSequence(args->at(elementIndex), [&list](const auto& element) -> std::shared_ptr<MalType> {
+                list->append(element);
+                return nullptr;
+            });
         } else {
             list->append(args->at(elementIndex));
         }
@@ -349,37 +1385,96 @@ std::shared_ptr<MalType> concat(MalContainer* args)
 
 std::shared_ptr<MalType> nth(MalContainer* args)
 {
-    if (args->isEmpty() || !args->at(0)->asMalContainer()) {
+    if (args->isEmpty() || !(args->at(0)->is<MalContainer>() || args->at(0)->is<MalLazySeq>() || args->at(0)->is<MalNumericVector>())) {
         return MalException::throwException("List or vector is expected");
     }
 
-    if (args->size() == 1 || !args->at(1)->asMalNumber()) {
+    if (args->size() == 1 || !args->at(1)->is<MalNumber>()) {
         return MalException::throwException("Integer index is expected");
     }
 
-    auto container = args->at(0)->asMalContainer();
-    size_t nthElemet = args->at(1)->asMalNumber()->getValue();
+    if (auto vector = args->at(0)->as<MalNumericVector>(); vector) {
+        size_t index = args->at(1)->as<MalNumber>()->getValue();
+        return index >= vector->size() ? MalException::throwException("Index out of range") : vector->at(index);
+    }
+
+    if (args->at(0)->is<MalLazySeq>()) {
+        auto elementsToSkip = args->at(1)->as<MalNumber>()->getValue();
+        std::shared_ptr<MalType> nthElement;
+        auto error = MalLazySeq::forEach(toLazySeq(args->takeAt(0)), [&](const auto& element) {
+            if (elementsToSkip-- == 0) {
+                nthElement = element;
+            }
+            return !nthElement;
+        });
+        return error ? error : nthElement ? nthElement : MalException::throwException("Index out of range");
+    }
+
+    auto container = args->at(0)->as<MalContainer>();
+    size_t nthElemet = args->at(1)->as<MalNumber>()->getValue();
     return nthElemet >= container->size() ? MalException::throwException("Index out of range") : container->at(nthElemet);
 }
 
 std::shared_ptr<MalType> first(MalContainer* args)
 {
-    if (args->isEmpty() || !args->at(0)->asMalContainer()) {
+    if (!args->isEmpty() && args->at(0)->is<MalLazySeq>()) {
+        auto node = MalLazySeq::firstNonEmpty(toLazySeq(args->at(0)));
+        if (!node || node->is<MalException>()) {
+            return node ? node : std::make_shared<MalNil>();
+        }
+        return node->as<MalLazySeq>()->chunk().front();
+    }
+    if (auto vector = args->isEmpty() ? nullptr : args->at(0)->as<MalNumericVector>(); vector) {
+        return vector->size() == 0 ? std::make_shared<MalNil>() : vector->at(0);
+    }
+    if (args->isEmpty() || !args->at(0)->is<MalContainer>()) {
         return std::make_shared<MalNil>();
     }
 
-    auto container = args->at(0)->asMalContainer();
+    auto container = args->at(0)->as<MalContainer>();
     return container->isEmpty() ? std::make_shared<MalNil>() : container->at(0);
 }
 
-std::shared_ptr<MalType> rest(MalContainer* args) 
+// Sequence without first element, O(1) for lists and vectors, lazy sequences stay lazy.
+// Rest of a numeric vector is a lazy sequence over its elements.
+std::shared_ptr<MalType> restOfSequence(const std::shared_ptr<MalType>& sequence)
+{
+    if (sequence->is<MalNumericVector>()) {
+        const auto chunks = toLazySeq(sequence);
+        return chunks ? restOfSequence(chunks) : std::make_shared<MalList>();
+    }
+    if (sequence->is<MalLazySeq>()) {
+        auto node = MalLazySeq::firstNonEmpty(toLazySeq(sequence));
+        if (!node || node->is<MalException>()) {
+            return node ? node : std::make_shared<MalList>();
+        }
+        const auto& chunk = node->as<MalLazySeq>()->chunk();
+        return std::make_shared<MalLazySeq>(MalLazySeq::Elements(chunk.begin() + 1, chunk.end()), node->as<MalLazySeq>()->next());
+    }
+    return sequence->as<MalContainer>()->rest();
+}
+
+std::shared_ptr<MalType> rest(MalContainer* args)
 {
-    if (args->isEmpty() || !args->at(0)->asMalContainer()) {
+    if (args->isEmpty() || !isSequence(args->at(0).get()) || args->at(0)->is<MalNil>()) {
         return std::make_shared<MalList>();
     }
-    auto tail = MalContainer::tail(args->at(0)->asMalContainer());
-    tail->toList();
-    return tail;
+    return restOfSequence(args->at(0));
+}
+
+std::shared_ptr<MalType> next(MalContainer* args)
+{
+    // (next (list 1)) -> nil, unlike rest
+    if (args->isEmpty() || !isSequence(args->at(0).get()) || args->at(0)->is<MalNil>()) {
+        return std::make_shared<MalNil>();
+    }
+    auto rest = restOfSequence(args->at(0));
+    if (auto restList = rest->as<MalContainer>(); restList) {
+        return restList->isEmpty() ? std::make_shared<MalNil>() : rest;
+    } else if (auto node = MalLazySeq::firstNonEmpty(toLazySeq(rest)); !node || node->is<MalException>()) {
+        return node ? node : std::make_shared<MalNil>();
+    }
+    return rest;
 }
 
 std::shared_ptr<MalType> cond(MalContainer* args)
@@ -395,7 +1490,7 @@ std::shared_ptr<MalType> cond(MalContainer* args)
         return trueBranch;
     }
     
-    auto rest = args->tail()->tail();
+    auto rest = args->slice(2, args->size() - 2);
     return cond(rest.get());
 }
 
@@ -404,7 +1499,9 @@ std::shared_ptr<MalType> malThrow(MalContainer* args)
     if (args->isEmpty()) {
         return std::make_shared<MalNil>();
     }
-    return MalException::throwException(args->at(0)->asString());
+    std::string message;
+    Printer(message, false).print(*args->at(0));
+    return MalException::throwException(message);
 }
 
 std::shared_ptr<MalType> apply(MalContainer* args, Env& env)
@@ -413,98 +1510,329 @@ std::shared_ptr<MalType> apply(MalContainer* args, Env& env)
         return MalException::throwException("not enough argumetns for apply");
     }
 
-    auto function = MalCallable::builinOrCallable(args->at(0).get());
+    auto function = args->at(0)->as<MalCallable>();
     if (!function) {
         return MalException::throwException("function is expected");
     }
 
-    auto arguments = concat(args->tail()->asMalContainer());
-    return function->evaluate(arguments->asMalContainer(), env);
+    if (args->back()->is<MalLazySeq>()) {
+        auto lastArguments = MalLazySeq::toList(toLazySeq(args->back()));
+        if (lastArguments->is<MalException>()) {
+            return lastArguments;
+        }
+        auto arguments = args->slice(0, args->size() - 1);
+        arguments->append(lastArguments);
+        return apply(arguments.get(), env);
+    }
+
+    // (apply f (list 1 2)) passes the list itself, without flattening it into a new one. It is not an owned
+    // argument list, so buildins share its elements instead of taking them (see takeAt)
+    if (auto arguments = args->at(1)->as<MalContainer>(); arguments && args->size() == 2) {
+        return function->evaluate(arguments, env);
+    }
+    auto arguments = concat(args->tail().get());
+    return function->evaluate(arguments->as<MalContainer>(), env);
 }
 
 std::shared_ptr<MalType> map(MalContainer* args, Env& env)
 {
-    if (args->size() < 2) {
+    if (args->isEmpty()) {
         return MalException::throwException("not enough argumetns for map");
     }
 
-    auto function = MalCallable::builinOrCallable(args->at(0).get());
+    auto function = args->at(0)->as<MalCallable>();
     if (!function) {
         return MalException::throwException("function as first argument is expected");
     }
 
-    auto lisToMapped = args->at(1)->asMalContainer();
-    if (!lisToMapped) {
+    // (map f) is a transducer
+    if (args->size() == 1) {
+        return singleStep(MalTransducer::StepType::MAP, args->at(0));
+    }
+
+    // mapping over lazy sequence is lazy as well, so infinite sequences could be mapped
+    if (args->at(1)->is<MalLazySeq>()) {
+        return lazyTransform(singleStep(MalTransducer::StepType::MAP, args->at(0)), toLazySeq(args->takeAt(1)), env.captured());
+    }
+
+    if (!args->at(1)->is<MalContainer>() && !args->at(1)->is<MalNumericVector>()) {
         return MalException::throwException("list or vector is expected");
     }
 
     auto mappedList = std::make_shared<MalList>();
-    for (auto element : *lisToMapped) {
-        // TODO: don't make stupid design decisions and assumptions)
-        auto elemAsList = std::make_shared<MalList>();
-        elemAsList->append(element);
-        if (auto mappedElemet = function->evaluate(elemAsList.get(), env); mappedElemet->asMalException()){
+    FunctionCall call(function, env, 1);
+    auto error = walkSequence(args->at(1), [&](const auto& element) -> std::shared_ptr<MalType> {
+        if (auto mappedElemet = call(element); mappedElemet->template is<MalException>()) {
             return mappedElemet;
         } else {
             mappedList->append(mappedElemet);
         }
+        return nullptr;
+    });
+    if (error) {
+        return error;
     }
     return mappedList;
 }
 
+std::shared_ptr<MalType> range(MalContainer* args)
+{
+    // (range) -> 0 1 2 ..., (range end), (range start end), (range start end step)
+    for (const auto& arg : *args) {
+        if (!arg->is<MalNumber>()) {
+            return MalException::throwException("range expects integer arguments");
+        }
+    }
+    auto argument = [args](size_t index) { return args->at(index)->as<MalNumber>()->getValue(); };
+    switch (args->size()) {
+    case 0:
+        return lazyRange(0, std::nullopt, 1);
+    case 1:
+        return lazyRange(0, argument(0), 1);
+    case 2:
+        return lazyRange(argument(0), argument(1), 1);
+    default:
+        if (argument(2) == 0) {
+            return MalException::throwException("range step could not be zero");
+        }
+        return lazyRange(argument(0), argument(1), argument(2));
+    }
+}
+
+std::shared_ptr<MalType> iterate(MalContainer* args, Env& env)
+{
+    // (iterate f x) -> x (f x) (f (f x)) ...
+    if (args->size() < 2 || !args->at(0)->is<MalCallable>()) {
+        return MalException::throwException("iterate expects function and initial value");
+    }
+    return lazyIterate(args->at(0), args->at(1), env.captured());
+}
+
+std::shared_ptr<MalType> take(MalContainer* args)
+{
+    if (args->size() < 2 || !args->at(0)->is<MalNumber>() || !isSequence(args->at(1).get())) {
+        return MalException::throwException("take expects count and sequence");
+    }
+    const auto count = static_cast<size_t>(std::max<int64_t>(args->at(0)->as<MalNumber>()->getValue(), 0));
+    if (auto container = args->at(1)->as<MalContainer>(); container) {
+        auto taken = container->slice(0, std::min(count, container->size()));
+        taken->toList();
+        return taken;
+    } else if (args->at(1)->is<MalNil>()) {
+        return std::make_shared<MalList>();
+    }
+    return lazyTake(count, toLazySeq(args->takeAt(1)));
+}
+
+std::shared_ptr<MalType> drop(MalContainer* args)
+{
+    if (args->size() < 2 || !args->at(0)->is<MalNumber>() || !isSequence(args->at(1).get())) {
+        return MalException::throwException("drop expects count and sequence");
+    }
+    const auto count = static_cast<size_t>(std::max<int64_t>(args->at(0)->as<MalNumber>()->getValue(), 0));
+    if (auto container = args->at(1)->as<MalContainer>(); container) {
+        const auto offset = std::min(count, container->size());
+        auto rest = container->slice(offset, container->size() - offset);
+        rest->toList();
+        return rest;
+    } else if (args->at(1)->is<MalNil>()) {
+        return std::make_shared<MalList>();
+    }
+    return lazyDrop(count, toLazySeq(args->takeAt(1)));
+}
+
+std::shared_ptr<MalType> filter(MalContainer* args, Env& env)
+{
+    return transformSequence(MalTransducer::StepType::FILTER, "filter", args, env);
+}
+
+std::shared_ptr<MalType> remove(MalContainer* args, Env& env)
+{
+    return transformSequence(MalTransducer::StepType::REMOVE, "remove", args, env);
+}
+
+std::shared_ptr<MalType> keep(MalContainer* args, Env& env)
+{
+    return transformSequence(MalTransducer::StepType::KEEP, "keep", args, env);
+}
+
+std::shared_ptr<MalType> reduce(MalContainer* args, Env& env)
+{
+    // (reduce f coll), (reduce f init coll)
+    if (args->size() < 2 || !args->at(0)->is<MalCallable>() || !isSequence(args->back().get())) {
+        return MalException::throwException("reduce expects function, optional initial value and sequence");
+    }
+    auto function = args->at(0)->as<MalCallable>();
+    auto accumulator = args->size() > 2 ? args->at(1) : nullptr;
+    FunctionCall call(function, env, 2);
+    auto error = walkSequence(args->takeAt(args->size() - 1), [&](const auto& element) -> std::shared_ptr<MalType> {
+        accumulator = accumulator ? call(accumulator, element) : element;
+        return accumulator->is<MalException>() ? accumulator : nullptr;
+    });
+    if (error) {
+        return error;
+    } else if (!accumulator) {
+        // (reduce + []) -> (+)
+        MalList noArguments;
+        return function->evaluate(&noArguments, env);
+    }
+    return accumulator;
+}
+
+std::shared_ptr<MalType> transduce(MalContainer* args, Env& env)
+{
+    // (transduce xf f coll), (transduce xf f init coll)
+    if (args->size() < 3 || !args->at(0)->is<MalTransducer>() || !args->at(1)->is<MalCallable>() || !isSequence(args->back().get())) {
+        return MalException::throwException("transduce expects transducer, function, optional initial value and sequence");
+    }
+    auto function = args->at(1)->as<MalCallable>();
+    std::shared_ptr<MalType> accumulator;
+    if (args->size() > 3) {
+        accumulator = args->at(2);
+    } else if (MalList noArguments; (accumulator = function->evaluate(&noArguments, env))->is<MalException>()) {
+        return accumulator;
+    }
+
+    Pipeline pipeline(*args->at(0)->as<MalTransducer>(), env);
+    FunctionCall call(function, env, 2);
+    auto error = walkSequence(args->takeAt(args->size() - 1), [&](const auto& element) {
+        return pipeline.feed(element, [&](std::shared_ptr<MalType> result) -> std::shared_ptr<MalType> {
+            accumulator = call(accumulator, std::move(result));
+            return accumulator->is<MalException>() ? accumulator : nullptr;
+        });
+    });
+    return error ? error : accumulator;
+}
+
+std::shared_ptr<MalType> into(MalContainer* args, Env& env)
+{
+    // (into to from), (into to xf from): vectors get elements appended, lists consed, maps take [key value] pairs
+    if (args->size() < 2 || !isSequence(args->back().get()) || (args->size() > 2 && !args->at(1)->is<MalTransducer>())) {
+        return MalException::throwException("into expects collection, optional transducer and sequence");
+    }
+    std::shared_ptr<MalContainer> container;
+    std::shared_ptr<MalHashMap> hashMap;
+    if (args->at(0)->is<MalHashMap>()) {
+        hashMap = std::static_pointer_cast<MalHashMap>(args->at(0)->clone());
+    } else if (auto target = args->at(0)->as<MalContainer>(); target && target->type() == MalContainer::ContainerType::VECTOR) {
+        container = std::static_pointer_cast<MalContainer>(target->clone());
+    } else if (target) {
+        container = std::static_pointer_cast<MalContainer>(args->at(0));
+    } else if (args->at(0)->is<MalNil>()) {
+        container = std::make_shared<MalList>();
+    } else {
+        return MalException::throwException("into expects list, vector, map or nil to add elements to");
+    }
+
+    auto add = [&](std::shared_ptr<MalType> element) -> std::shared_ptr<MalType> {
+        if (hashMap) {
+            auto entry = element->as<MalContainer>();
+            if (!entry || entry->size() != 2) {
+                return MalException::throwException("into expects [key value] pairs for map");
+            }
+            hashMap->insert(entry->at(0), entry->at(1));
+        } else if (container->type() == MalContainer::ContainerType::VECTOR) {
+            container->append(std::move(element));
+        } else {
+            container = container->cons(std::move(element));
+        }
+        return nullptr;
+    };
+
+    std::shared_ptr<MalType> error;
+    if (args->size() > 2) {
+        Pipeline pipeline(*args->at(1)->as<MalTransducer>(), env);
+        error = walkSequence(args->takeAt(2), [&](const auto& element) { return pipeline.feed(element, add); });
+    } else {
+        error = walkSequence(args->takeAt(1), add);
+    }
+    if (error) {
+        return error;
+    }
+    return hashMap ? std::static_pointer_cast<MalType>(hashMap) : container;
+}
+
+std::shared_ptr<MalType> comp(MalContainer* args)
+{
+    // (comp (map f) (filter p)) is a transducer that maps first and filters then
+    if (!args->isEmpty() && std::all_of(args->begin(), args->end(), [](const auto& arg) { return arg->template is<MalTransducer>(); })) {
+        auto transducer = std::static_pointer_cast<MalTransducer>(args->at(0));
+        for (size_t argIndex = 1; argIndex < args->size(); ++argIndex) {
+            transducer = transducer->then(*args->at(argIndex)->as<MalTransducer>());
+        }
+        return transducer;
+    }
+
+    // ((comp f g) x) -> (f (g x)), (comp) is identity
+    if (!std::all_of(args->begin(), args->end(), [](const auto& arg) { return arg->template is<MalCallable>(); })) {
+        return MalException::throwException("comp expects functions or transducers");
+    }
+    auto functions = args->slice(0, args->size());
+    return std::make_shared<MalBuildin>(MalBuildin::BuildinWithEnv([functions](MalContainer* arguments, Env& env) -> std::shared_ptr<MalType> {
+        if (functions->isEmpty()) {
+            return arguments->isEmpty() ? std::make_shared<MalNil>() : arguments->at(0);
+        }
+        auto result = functions->back()->as<MalCallable>()->evaluate(arguments, env);
+        for (size_t functionIndex = functions->size() - 1; functionIndex-- > 0 && !result->is<MalException>();) {
+            result = FunctionCall(functions->at(functionIndex)->as<MalCallable>(), env, 1)(result);
+        }
+        return result;
+    }));
+}
+
+std::shared_ptr<MalType> takeWhile(MalContainer* args, Env& env)
+{
+    if (args->size() < 2 || !args->at(0)->is<MalCallable>() || !isSequence(args->at(1).get())) {
+        return MalException::throwException("take-while expects predicate and sequence");
+    }
+    return lazyTakeWhile(args->at(0), toLazySeq(args->takeAt(1)), env.captured());
+}
+
 std::shared_ptr<MalType> isNil(MalContainer* args)
 {
-    return std::make_shared<MalBoolean>(args->head()->asMalNil() != nullptr);
+    return std::make_shared<MalBoolean>(args->head()->is<MalNil>());
 }
 
 std::shared_ptr<MalType> isSymbol(MalContainer* args)
 {
-    auto symbol = args->head()->asMalSymbol();
+    auto symbol = args->head()->as<MalSymbol>();
     return std::make_shared<MalBoolean>(symbol && symbol->getType() != MalSymbol::SymbolType::KEYWORD);
 }
 
 std::shared_ptr<MalType> isTrue(MalContainer* args)
 {
-    auto boolean = args->head()->asMalBoolean() ;
+    auto boolean = args->head()->as<MalBoolean>() ;
     return std::make_shared<MalBoolean>(boolean && boolean->asString() == "true");
 }
 
 std::shared_ptr<MalType> isFalse(MalContainer* args)
 {
-    auto boolean = args->head()->asMalBoolean() ;
+    auto boolean = args->head()->as<MalBoolean>() ;
     return std::make_shared<MalBoolean>(boolean && boolean->asString() == "false");
 }
 
 std::shared_ptr<MalType> isVector(MalContainer* args)
 {
-    const auto list = args->head()->asMalContainer();
-    return std::make_shared<MalBoolean>(list != nullptr && list->type() == MalContainer::ContainerType::VECTOR);
+    const auto list = args->head()->as<MalContainer>();
+    return std::make_shared<MalBoolean>((list != nullptr && list->type() == MalContainer::ContainerType::VECTOR) || args->head()->is<MalNumericVector>());
 }
 
 std::shared_ptr<MalType> isSequential(MalContainer* args)
 {
-    return std::make_shared<MalBoolean>(!args->isEmpty() && args->at(0)->asMalContainer());
+    return std::make_shared<MalBoolean>(!args->isEmpty() && (args->at(0)->is<MalContainer>() || args->at(0)->is<MalLazySeq>() || args->at(0)->is<MalNumericVector>()));
 }
 
 std::shared_ptr<MalType> isMap(MalContainer* args)
 {
-    return std::make_shared<MalBoolean>(!args->isEmpty() && args->at(0)->asMalHashMap());
+    return std::make_shared<MalBoolean>(!args->isEmpty() && args->at(0)->is<MalHashMap>());
 }
 
 std::shared_ptr<MalType> isKeyword(MalContainer* args)
 {
-    auto symbol = args->head()->asMalSymbol();
+    auto symbol = args->head()->as<MalSymbol>();
     return std::make_shared<MalBoolean>(symbol && symbol->getType() == MalSymbol::SymbolType::KEYWORD);
 }
 
-std::string removeQuotes(const std::string& str)
-{
-    if (str.size() < 2 || str.front() != '"') {
-        return str;
-    }
-    return str.substr(1, str.size() - 2);
-}
-
 std::shared_ptr<MalType> makeKeyword(MalContainer* args)
 {
     if (args->isEmpty()) {
@@ -512,16 +1840,16 @@ std::shared_ptr<MalType> makeKeyword(MalContainer* args)
     }
 
     auto toKeword = args->at(0);
-    if (toKeword->asString().front() == ':') {
+    if (auto symbol = toKeword->as<MalSymbol>(); symbol && symbol->getType() == MalSymbol::SymbolType::KEYWORD) {
         return args->at(0);
     }
 
-    if (!toKeword->asMalString()) {
+    if (!toKeword->is<MalString>()) {
         return MalException::throwException("Argument should be string or keyword");
     }
 
-    auto keyword = ':' + removeQuotes(toKeword->asString());
-    return std::make_shared<MalSymbol>(keyword, MalSymbol::SymbolType::KEYWORD);
+    auto keyword = ':' + std::string(toKeword->as<MalString>()->value());
+    return MalSymbol::intern(keyword, MalSymbol::SymbolType::KEYWORD);
 }
 
 std::shared_ptr<MalType> makeSymbol(MalContainer* args)
@@ -530,11 +1858,13 @@ std::shared_ptr<MalType> makeSymbol(MalContainer* args)
         return MalException::throwException("Not enough arguments to make symbol");
     }
 
-    if (auto argument = args->at(0); MalCallable::builinOrCallable(argument.get())){
+    if (args->at(0)->is<MalCallable>()) {
         return MalException::throwException("Symbol can't be callable object");
     }
 
-    return std::make_shared<MalSymbol>(removeQuotes(args->at(0)->asString()));
+    std::string name;
+    Printer(name, false).print(*args->at(0));
+    return MalSymbol::intern(name);
 }
 
 std::shared_ptr<MalType> makeHashMap(MalContainer* args)
@@ -545,7 +1875,7 @@ std::shared_ptr<MalType> makeHashMap(MalContainer* args)
 
     auto hashMap = std::make_shared<MalHashMap>();
     for (size_t elementIndex = 0; elementIndex  < args->size(); elementIndex += 2) {
-        hashMap->insert(args->at(elementIndex)->asString(),
+        hashMap->insert(args->at(elementIndex),
                         args->at(elementIndex + 1));
     }
     return hashMap;
@@ -558,24 +1888,32 @@ std::shared_ptr<MalType> assoc(MalContainer* args)
         return MalException::throwException("Not enought arguments to assoc");
     }
 
-    auto mapToMereIn = args->at(0)->asMalHashMap();
-
-    if (!mapToMereIn) {
-        return MalException::throwException("First argument should be hash-map");
-    }
-
     if ((args->size() - 1) % 2 != 0) {
         return MalException::throwException("Number of keys\\values should be even");
     }
 
-    auto newHashMap = std::make_shared<MalHashMap>();
+    // (assoc [1 2] 0 :a) -> [:a 2]
+    if (auto vector = args->at(0)->as<MalContainer>(); vector && vector->type() == MalContainer::ContainerType::VECTOR) {
+        auto newVector = std::static_pointer_cast<MalContainer>(vector->clone());
+        for (size_t elementIndex = 1; elementIndex < args->size(); elementIndex += 2) {
+            const auto index = args->at(elementIndex)->as<MalNumber>();
+            if (!index || index->getValue() < 0 || static_cast<size_t>(index->getValue()) > newVector->size()) {
+                return MalException::throwException("Index out of range");
+            }
+            newVector = newVector->assoc(index->getValue(), args->at(elementIndex + 1));
+        }
+        return newVector;
+    }
+
+    auto mapToMereIn = args->at(0)->as<MalHashMap>();
 
-    for (auto& [key, value] : *mapToMereIn) {
-        newHashMap->insert(key, value);
+    if (!mapToMereIn) {
+        return MalException::throwException("First argument should be hash-map or vector");
     }
 
+    auto newHashMap = std::static_pointer_cast<MalHashMap>(mapToMereIn->clone());
     for (size_t elementIndex = 1; elementIndex < args->size(); elementIndex += 2) {
-        newHashMap->insert(args->at(elementIndex)->asString(),
+        newHashMap->insert(args->at(elementIndex),
                            args->at(elementIndex + 1));
     }
     return newHashMap;
@@ -584,18 +1922,12 @@ std::shared_ptr<MalType> assoc(MalContainer* args)
 std::shared_ptr<MalType> dissoc(MalContainer* args)
 {
     // (dissoc {:cde 345 :fgh 456} :cde) -> {:fgh 465}
-    if (args->isEmpty() || !args->at(0)->asMalHashMap()) {
+    if (args->isEmpty() || !args->at(0)->is<MalHashMap>()) {
         return MalException::throwException("Hash-map is expected");
     }
-    auto oldHashMap = args->at(0)->asMalHashMap();
-    auto newHashMap = std::make_shared<MalHashMap>();
-    // TODO: make copy constructor
-    for (auto& [key, value] : *oldHashMap) {
-        newHashMap->insert(key, value);
-    }
-
+    auto newHashMap = std::static_pointer_cast<MalHashMap>(args->at(0)->clone());
     for (size_t keyToRemoveIndex = 1; keyToRemoveIndex < args->size(); ++keyToRemoveIndex) {
-        auto keyToRemove = args->at(keyToRemoveIndex)->asString();
+        const auto& keyToRemove = args->at(keyToRemoveIndex);
         newHashMap->remove(keyToRemove);
     }
     return newHashMap;
@@ -603,11 +1935,11 @@ std::shared_ptr<MalType> dissoc(MalContainer* args)
 
 std::shared_ptr<MalType> malGet(MalContainer* args)
 {
-    if (args->isEmpty() || (!args->at(0)->asMalHashMap() && !args->at(0)->asMalNil())) {
+    if (args->isEmpty() || (!args->at(0)->is<MalHashMap>() && !args->at(0)->is<MalNil>())) {
         return MalException::throwException("Hash-map is expected");
     }
 
-    if (args->at(0)->asMalNil()) {
+    if (args->at(0)->is<MalNil>()) {
         return args->at(0);
     }
 
@@ -615,18 +1947,18 @@ std::shared_ptr<MalType> malGet(MalContainer* args)
         return MalException::throwException("Key to hash-map is expected");
     }
 
-    auto hashMap = args->at(0)->asMalHashMap();
-    auto key = args->at(1)->asString();
+    auto hashMap = args->at(0)->as<MalHashMap>();
+    const auto& key = args->at(1);
 
-    if (auto relatedValue = hashMap->find(key); relatedValue != hashMap->end()) {
-        return relatedValue->second;
+    if (auto relatedValue = hashMap->find(key); relatedValue) {
+        return relatedValue;
     }
     return std::make_shared<MalNil>();
 }
 
 std::shared_ptr<MalType> contains(MalContainer* args)
 {
-    if (args->isEmpty() || !args->at(0)->asMalHashMap()) {
+    if (args->isEmpty() || !args->at(0)->is<MalHashMap>()) {
         return MalException::throwException("Hash-map is expected");
     }
 
@@ -634,27 +1966,26 @@ std::shared_ptr<MalType> contains(MalContainer* args)
         return MalException::throwException("Key to hash-map is expected");
     }
 
-    auto hashMap = args->at(0)->asMalHashMap();
-    auto key = args->at(1)->asString();
+    auto hashMap = args->at(0)->as<MalHashMap>();
+    const auto& key = args->at(1);
 
-    auto relatedValue = hashMap->find(key); 
-    return std::make_shared<MalBoolean>(relatedValue != hashMap->end());
+    return std::make_shared<MalBoolean>(hashMap->find(key) != nullptr);
 }
 
 std::shared_ptr<MalType> keys(MalContainer* args)
 {
-    if (args->isEmpty() || !args->at(0)->asMalHashMap()) {
+    if (args->isEmpty() || !args->at(0)->is<MalHashMap>()) {
         return MalException::throwException("Hash-map is expected");
     }
-    return args->at(0)->asMalHashMap()->keys();
+    return args->at(0)->as<MalHashMap>()->keys();
 }
 
 std::shared_ptr<MalType> vals(MalContainer* args)
 {
-    if (args->isEmpty() || !args->at(0)->asMalHashMap()) {
+    if (args->isEmpty() || !args->at(0)->is<MalHashMap>()) {
         return MalException::throwException("Hash-map is expected");
     }
-    return args->at(0)->asMalHashMap()->vals();
+    return args->at(0)->as<MalHashMap>()->vals();
 }
 
 std::shared_ptr<MalType> malReadline(MalContainer* args)
@@ -662,13 +1993,14 @@ std::shared_ptr<MalType> malReadline(MalContainer* args)
     if (args->isEmpty()) {
         return MalException::throwException("Except a string as first argument");
     }
-    std::cout << removeQuotes(args->at(0)->asString()) << " ";
-    std::string currentLine;
-    std::getline(std::cin, currentLine);
-    
-    if (!currentLine.empty())
+    // stdin is tied to stdout, the prompt is flushed before the read
+    Printer(*OutputPort::standardOutput(), false).print(*args->at(0));
+    OutputPort::standardOutput()->write(" ");
+    const auto currentLine = InputPort::standardInput()->readLine();
+
+    if (currentLine && !currentLine->empty())
     {
-        return std::make_shared<MalSymbol>('"' + MalString::escapeString(currentLine) + '"');
+        return std::make_shared<MalString>(*currentLine);
     }
 
     return std::make_shared<MalNil>();
@@ -676,7 +2008,7 @@ std::shared_ptr<MalType> malReadline(MalContainer* args)
 
 std::shared_ptr<MalType> hostLanguage(MalContainer*)
 {
-    return std::make_shared<MalSymbol>("C++20");
+    return MalSymbol::intern("C++20");
 }
 
 std::shared_ptr<MalType> meta(MalContainer* args)
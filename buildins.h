@@ -1,15 +1,32 @@
 #pragma once
 #include <memory>
 
+#include "printer.h"
+
 namespace mal {
 class MalType;
 class MalContainer;
 class Env;
 
-std::shared_ptr<MalType> prn(MalContainer* args);
-std::shared_ptr<MalType> printString(MalContainer* args);
+// Limits of printing from *print-length* and *print-level* of env
+Printer::Limits printLimits(const Env& env);
+
+std::shared_ptr<MalType> prn(MalContainer* args, Env& env);
+std::shared_ptr<MalType> printString(MalContainer* args, Env& env);
 std::shared_ptr<MalType> str(MalContainer* args);
-std::shared_ptr<MalType> println(MalContainer* args);
+std::shared_ptr<MalType> println(MalContainer* args, Env& env);
+std::shared_ptr<MalType> standardOutput(MalContainer* args);
+std::shared_ptr<MalType> standardError(MalContainer* args);
+std::shared_ptr<MalType> standardInput(MalContainer* args);
+std::shared_ptr<MalType> openOutput(MalContainer* args);
+std::shared_ptr<MalType> openInput(MalContainer* args);
+std::shared_ptr<MalType> writePort(MalContainer* args);
+std::shared_ptr<MalType> flushPort(MalContainer* args);
+std::shared_ptr<MalType> closePort(MalContainer* args);
+std::shared_ptr<MalType> readLine(MalContainer* args);
+std::shared_ptr<MalType> lineSeq(MalContainer* args);
+std::shared_ptr<MalType> spit(MalContainer* args);
+std::shared_ptr<MalType> spitAppend(MalContainer* args);
 std::shared_ptr<MalType> list(MalContainer* args);
 std::shared_ptr<MalType> isList(MalContainer* args);
 std::shared_ptr<MalType> isEmpty(MalContainer* args);
@@ -25,22 +42,51 @@ std::shared_ptr<MalType> plus(MalContainer* args);
 std::shared_ptr<MalType> minus(MalContainer* args);
 std::shared_ptr<MalType> divides(MalContainer* args);
 std::shared_ptr<MalType> multiplies(MalContainer* args);
+std::shared_ptr<MalType> makeIntegerVector(MalContainer* args);
+std::shared_ptr<MalType> makeDoubleVector(MalContainer* args);
+std::shared_ptr<MalType> vectorPlus(MalContainer* args);
+std::shared_ptr<MalType> vectorMultiplies(MalContainer* args);
+std::shared_ptr<MalType> vectorLess(MalContainer* args);
+std::shared_ptr<MalType> vectorGreater(MalContainer* args);
+std::shared_ptr<MalType> vectorEqual(MalContainer* args);
+std::shared_ptr<MalType> sum(MalContainer* args);
+std::shared_ptr<MalType> dot(MalContainer* args);
+std::shared_ptr<MalType> vectorMin(MalContainer* args);
+std::shared_ptr<MalType> vectorMax(MalContainer* args);
 std::shared_ptr<MalType> readString(MalType* args, Env& env);
 std::shared_ptr<MalType> slurp(MalContainer* args, Env& env);
+std::shared_ptr<MalType> readAllForms(MalContainer* args);
+std::shared_ptr<MalType> loadData(MalContainer* args);
+std::shared_ptr<MalType> jsonRead(MalContainer* args);
+std::shared_ptr<MalType> jsonWrite(MalContainer* args);
 std::shared_ptr<MalType> eval(MalContainer* args, Env& env);
 std::shared_ptr<MalType> loadFile(MalContainer* args, Env& env);
 std::shared_ptr<MalType> deref(MalContainer* args);
 std::shared_ptr<MalType> argv(MalContainer *args);
 std::shared_ptr<MalType> cons(MalContainer *args);
+std::shared_ptr<MalType> conj(MalContainer* args);
 std::shared_ptr<MalType> concat(MalContainer *args);
 std::shared_ptr<MalType> vec(MalContainer* args);
 std::shared_ptr<MalType> nth(MalContainer* args);
 std::shared_ptr<MalType> first(MalContainer* args);
 std::shared_ptr<MalType> rest(MalContainer* args);
+std::shared_ptr<MalType> next(MalContainer* args);
 std::shared_ptr<MalType> cond(MalContainer* args);
 std::shared_ptr<MalType> malThrow(MalContainer* args);
 std::shared_ptr<MalType> apply(MalContainer* args, Env& env);
 std::shared_ptr<MalType> map(MalContainer* args, Env& env);
+std::shared_ptr<MalType> range(MalContainer* args);
+std::shared_ptr<MalType> iterate(MalContainer* args, Env& env);
+std::shared_ptr<MalType> take(MalContainer* args);
+std::shared_ptr<MalType> drop(MalContainer* args);
+std::shared_ptr<MalType> filter(MalContainer* args, Env& env);
+std::shared_ptr<MalType> remove(MalContainer* args, Env& env);
+std::shared_ptr<MalType> keep(MalContainer* args, Env& env);
+std::shared_ptr<MalType> reduce(MalContainer* args, Env& env);
+std::shared_ptr<MalType> transduce(MalContainer* args, Env& env);
+std::shared_ptr<MalType> into(MalContainer* args, Env& env);
+std::shared_ptr<MalType> comp(MalContainer* args);
+std::shared_ptr<MalType> takeWhile(MalContainer* args, Env& env);
 std::shared_ptr<MalType> isNil(MalContainer* args);
 std::shared_ptr<MalType> isSymbol(MalContainer* args);
 std::shared_ptr<MalType> isTrue(MalContainer* args);
@@ -1,14 +1,15 @@
 #include "env.h"
 #include "buildins.h"
 #include "maltypes.h"
+#include "ports.h"
 
-#include <iostream>
+#include <algorithm>
 
 namespace mal {
 
 GlobalEnv::GlobalEnv()
 {
-    m_buildins = {
+    const std::pair<std::string_view, std::shared_ptr<MalBuildin>> buildins[] = {
         { "prn", std::make_shared<MalBuildin>(prn) },
         { "pr-str", std::make_shared<MalBuildin>(printString) },
         { "str", std::make_shared<MalBuildin>(str) },
@@ -31,20 +32,50 @@ GlobalEnv::GlobalEnv()
         { "eval", std::make_shared<MalBuildin>(eval) },
         { "read-string", std::make_shared<MalBuildin>(readString) },
         { "slurp", std::make_shared<MalBuildin>(slurp) },
+        { "spit", std::make_shared<MalBuildin>(spit) },
+        { "spit-append", std::make_shared<MalBuildin>(spitAppend) },
+        { "*out*", std::make_shared<MalBuildin>(standardOutput) },
+        { "*err*", std::make_shared<MalBuildin>(standardError) },
+        { "*in*", std::make_shared<MalBuildin>(standardInput) },
+        { "open-output", std::make_shared<MalBuildin>(openOutput) },
+        { "open-input", std::make_shared<MalBuildin>(openInput) },
+        { "write", std::make_shared<MalBuildin>(writePort) },
+        { "flush", std::make_shared<MalBuildin>(flushPort) },
+        { "close", std::make_shared<MalBuildin>(closePort) },
+        { "read-line", std::make_shared<MalBuildin>(readLine) },
+        { "line-seq", std::make_shared<MalBuildin>(lineSeq) },
+        { "read-all", std::make_shared<MalBuildin>(readAllForms) },
+        { "load-data", std::make_shared<MalBuildin>(loadData) },
+        { "json-read", std::make_shared<MalBuildin>(jsonRead) },
+        { "json-write", std::make_shared<MalBuildin>(jsonWrite) },
         { "load-file", std::make_shared<MalBuildin>(loadFile) },
         { "not", std::make_shared<MalBuildin>(malNot) },
         { "deref", std::make_shared<MalBuildin>(deref) },
         { "*ARGV*", std::make_shared<MalBuildin>(argv) },
         { "*host-language*", std::make_shared<MalBuildin>(hostLanguage) },
         { "cons", std::make_shared<MalBuildin>(cons) },
+        { "conj", std::make_shared<MalBuildin>(conj) },
         { "concat", std::make_shared<MalBuildin>(concat) },
         { "nth", std::make_shared<MalBuildin>(nth) },
         { "first", std::make_shared<MalBuildin>(first) },
         { "rest", std::make_shared<MalBuildin>(rest) },
+        { "next", std::make_shared<MalBuildin>(next) },
         { "cond", std::make_shared<MalBuildin>(cond) },
         { "throw", std::make_shared<MalBuildin>(malThrow) },
         { "apply", std::make_shared<MalBuildin>(apply) },
         { "map", std::make_shared<MalBuildin>(map) },
+        { "range", std::make_shared<MalBuildin>(range) },
+        { "iterate", std::make_shared<MalBuildin>(iterate) },
+        { "take", std::make_shared<MalBuildin>(take) },
+        { "drop", std::make_shared<MalBuildin>(drop) },
+        { "filter", std::make_shared<MalBuildin>(filter) },
+        { "remove", std::make_shared<MalBuildin>(remove) },
+        { "keep", std::make_shared<MalBuildin>(keep) },
+        { "reduce", std::make_shared<MalBuildin>(reduce) },
+        { "transduce", std::make_shared<MalBuildin>(transduce) },
+        { "into", std::make_shared<MalBuildin>(into) },
+        { "comp", std::make_shared<MalBuildin>(comp) },
+        { "take-while", std::make_shared<MalBuildin>(takeWhile) },
         { "keyword", std::make_shared<MalBuildin>(makeKeyword) },
         { "symbol", std::make_shared<MalBuildin>(makeSymbol) },
         { "vector", std::make_shared<MalBuildin>(makeVector) },
@@ -66,8 +97,24 @@ GlobalEnv::GlobalEnv()
         { "+", std::make_shared<MalBuildin>(plus) },
         { "-", std::make_shared<MalBuildin>(minus) },
         { "/", std::make_shared<MalBuildin>(divides) },
-        { "*", std::make_shared<MalBuildin>(multiplies) }
+        { "*", std::make_shared<MalBuildin>(multiplies) },
+
+        { "ivec", std::make_shared<MalBuildin>(makeIntegerVector) },
+        { "dvec", std::make_shared<MalBuildin>(makeDoubleVector) },
+        { "v+", std::make_shared<MalBuildin>(vectorPlus) },
+        { "v*", std::make_shared<MalBuildin>(vectorMultiplies) },
+        { "v<", std::make_shared<MalBuildin>(vectorLess) },
+        { "v>", std::make_shared<MalBuildin>(vectorGreater) },
+        { "v=", std::make_shared<MalBuildin>(vectorEqual) },
+        { "sum", std::make_shared<MalBuildin>(sum) },
+        { "dot", std::make_shared<MalBuildin>(dot) },
+        { "vmin", std::make_shared<MalBuildin>(vectorMin) },
+        { "vmax", std::make_shared<MalBuildin>(vectorMax) }
     };
+
+    for (const auto& [name, buildin] : buildins) {
+        m_buildins[MalSymbol::intern(name).get()] = buildin;
+    }
 }
 
 GlobalEnv& GlobalEnv::the()
@@ -76,7 +123,7 @@ GlobalEnv& GlobalEnv::the()
     return env;
 }
 
-std::shared_ptr<MalType> GlobalEnv::find(const std::string& key) const
+std::shared_ptr<MalType> GlobalEnv::find(const MalSymbol* key) const
 {
     if (auto env = m_buildins.find(key); env != m_buildins.end()) {
         auto& [k, relatedEnv] = *env;
@@ -85,6 +132,16 @@ std::shared_ptr<MalType> GlobalEnv::find(const std::string& key) const
     return nullptr;
 }
 
+const MalSymbol* GlobalEnv::nameOf(const MalBuildin* buildin) const
+{
+    for (const auto& [name, globalBuildin] : m_buildins) {
+        if (globalBuildin.get() == buildin) {
+            return name;
+        }
+    }
+    return nullptr;
+}
+
 std::shared_ptr<MalList> GlobalEnv::getArgvs() const
 {
     return m_argvs;
@@ -95,7 +152,7 @@ void GlobalEnv::setUpArgv(int argc, char* argv[])
     if (!m_argvs) {
         m_argvs = std::make_shared<MalList>();
         for (int argIndex = 1; argIndex < argc; ++argIndex) {
-            m_argvs->append(std::make_shared<MalSymbol>(argv[argIndex]));
+            m_argvs->append(MalSymbol::intern(argv[argIndex]));
         }
     }
 }
@@ -105,54 +162,74 @@ Env::Env(Env* parentEvn)
     parentEnv = parentEvn;
 }
 
+// NOTE: a copy of a captured frame keeps seeing the frames it captured, so a closure made in a lazy body does too
 Env::Env(const Env& oldEnv)
+    : m_data(std::make_shared<Bindings>(*oldEnv.m_data))
+    , m_capturedParent(oldEnv.parentEnv ? nullptr : oldEnv.m_capturedParent)
 {
-    m_data = oldEnv.m_data;
-    parentEnv = nullptr;
 }
 
-void Env::set(const std::string& key, std::shared_ptr<MalType> value)
+Env::Env(std::shared_ptr<Bindings> data, std::shared_ptr<Env> capturedParent)
+    : m_data(std::move(data))
+    , m_capturedParent(std::move(capturedParent))
+{
+}
+
+void Env::set(const MalSymbol* key, std::shared_ptr<MalType> value)
 {
     // TODO: check if key is already in  GlobalEnv
-    m_data[key] = value;
+    (*m_data)[key] = value;
 }
 
-std::shared_ptr<MalType> Env::find(const std::string& key) const
+std::shared_ptr<MalType> Env::find(const MalSymbol* key) const
 {
-    if (auto env = m_data.find(key); env != m_data.end()) {
-        auto& [k, relatedEnv] = *env;
-        return relatedEnv;
-    }
-    if (parentEnv) {
-        auto res = parentEnv->find(key);
-        if (res != nullptr) {
-            return res;
+    for (const auto* env = this; env; env = env->outer()) {
+        if (auto binding = env->m_data->find(key); binding != env->m_data->end()) {
+            auto& [k, value] = *binding;
+            return value;
         }
     }
     return GlobalEnv::the().find(key);
 }
 
+const Env* Env::outer() const
+{
+    return parentEnv ? parentEnv : m_capturedParent.get();
+}
+
+bool Env::isBoundInFrames(const MalSymbol* key) const
+{
+    for (const auto* env = this; env; env = env->outer()) {
+        if (env->m_data->count(key) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Env::setBindings(const MalContainer* parameters, const MalContainer* arguments)
 {
+    static const auto* variadicMarker = MalSymbol::intern("&").get();
+
     for (size_t parameterIndex = 0; parameterIndex < parameters->size(); ++parameterIndex) {
-        const auto currentParameter = parameters->at(parameterIndex)->asString();
+        const auto currentParameter = parameters->at(parameterIndex)->as<MalSymbol>();
 
         // (& paramName) bound name to all arguments that left
         // (fn* (a & paramName) (+ a count paramName))(1 2 3) -> a = 1 paramName = (2, 3)
-        if (currentParameter == "&") {
-            auto allOtherArgs = std::make_shared<MalList>();
-            for (size_t vaArgs = parameterIndex; vaArgs < arguments->size(); ++vaArgs) {
-                allOtherArgs->append(arguments->at(vaArgs));
-            }
+        if (currentParameter == variadicMarker) {
+            const auto restOffset = std::min(parameterIndex, arguments->size());
+            auto allOtherArgs = arguments->slice(restOffset, arguments->size() - restOffset);
+            allOtherArgs->toList();
             if (parameterIndex + 1 == parameters->size()) {
-                std::cout << "Expected parameter pack name after `&`\n";
+                OutputPort::standardError()->write("Expected parameter pack name after `&`\n");
                 return;
             }
-            const auto allOtherArgsName = parameters->at(parameterIndex + 1)->asString();
-            set(allOtherArgsName, allOtherArgs);
+            if (const auto allOtherArgsName = parameters->at(parameterIndex + 1)->as<MalSymbol>(); allOtherArgsName) {
+                set(allOtherArgsName, allOtherArgs);
+            }
             return;
         }
-        if (parameterIndex < arguments->size()) {
+        if (currentParameter && parameterIndex < arguments->size()) {
             const auto currentArgument = arguments->at(parameterIndex);
             set(currentParameter, currentArgument);
         }
@@ -161,16 +238,39 @@ void Env::setBindings(const MalContainer* parameters, const MalContainer* argume
 
 void Env::addToEnv(Env& newEnv)
 {
-    for (const auto& [key, value] : newEnv.m_data) {
-        if (auto itElem = m_data.find(key); itElem == m_data.end()) {
-            m_data.insert({ key, value });
+    for (const auto& [key, value] : *newEnv.m_data) {
+        if (!isBoundInFrames(key)) {
+            m_data->insert({ key, value });
         }
     }
 }
 
 bool Env::isEmpty() const
 {
-    return m_data.empty();
+    return m_data->empty();
+}
+
+std::shared_ptr<Env> Env::captured() const
+{
+    if (!parentEnv) {
+        return std::shared_ptr<Env>(new Env(m_data, m_capturedParent));
+    }
+    return std::shared_ptr<Env>(new Env(std::make_shared<Bindings>(*m_data), parentEnv->captured()));
+}
+
+Env Env::flattened() const
+{
+    Env env(*this);
+    env.m_capturedParent = nullptr;
+    for (auto* outerEnv = outer(); outerEnv; outerEnv = outerEnv->outer()) {
+        env.m_data->insert(outerEnv->m_data->begin(), outerEnv->m_data->end());
+    }
+    return env;
+}
+
+const Env::Bindings& Env::bindings() const
+{
+    return *m_data;
 }
 
 } // namespace mal
@@ -8,11 +8,14 @@ class MalBuildin;
 class MalType;
 class MalContainer;
 class MalList;
+class MalSymbol;
 
 class GlobalEnv {
 public:
     static GlobalEnv& the();
-    std::shared_ptr<MalType> find(const std::string& key) const;
+    std::shared_ptr<MalType> find(const MalSymbol* key) const;
+    // Name the buildin is bound to, nullptr for buildins made at runtime
+    const MalSymbol* nameOf(const MalBuildin* buildin) const;
     std::shared_ptr<MalList> getArgvs() const;
     void setUpArgv(int argc, char* argv[]);
 
@@ -20,25 +23,47 @@ private:
     GlobalEnv();
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<MalBuildin>> m_buildins;
+    std::unordered_map<const MalSymbol*, std::shared_ptr<MalBuildin>> m_buildins;
     std::shared_ptr<MalList> m_argvs;
 };
 
 class Env {
 public:
+    using Bindings = std::unordered_map<const MalSymbol*, std::shared_ptr<MalType>>;
+
     Env() = default;
     Env(Env* parentEnv);
     Env(const Env& newEnv);
 
-    void set(const std::string& key, std::shared_ptr<MalType> value);
-    std::shared_ptr<MalType> find(const std::string& key) const;
+    // NOTE: symbols are interned, so environments are keyed by symbol identity
+    void set(const MalSymbol* key, std::shared_ptr<MalType> value);
+    std::shared_ptr<MalType> find(const MalSymbol* key) const;
     void setBindings(const MalContainer* binds, const MalContainer* exprs);
     void addToEnv(Env& newEnv);
     bool isEmpty() const;
+    // Environment for bodies evaluated after this one is gone (lazy sequences and their transformations).
+    // Frames of let* and calls are copied, they only hold local bindings. The outermost frame, the top level
+    // or the environment of a closure, is shared by reference count, so capturing doesn't copy the globals
+    // and def!s made later are visible.
+    std::shared_ptr<Env> captured() const;
+    // Copy that doesn't refer to parents, inner bindings shadow outer ones
+    Env flattened() const;
+    // Bindings of this environment only, parents are not looked at
+    const Bindings& bindings() const;
+
+private:
+    Env(std::shared_ptr<Bindings> data, std::shared_ptr<Env> capturedParent);
+
+    // Parent frame, either on the stack or captured
+    const Env* outer() const;
+    // Looks through the frames, but not through the buildins
+    bool isBoundInFrames(const MalSymbol* key) const;
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<MalType>> m_data;
+    // NOTE: shared only between a frame and the environments that captured it
+    std::shared_ptr<Bindings> m_data { std::make_shared<Bindings>() };
     Env* parentEnv = nullptr;
+    std::shared_ptr<Env> m_capturedParent;
 };
 
 } // namespace mal
@@ -6,6 +6,39 @@
 
 namespace mal {
 
+// Interned symbols the evaluator dispatches on, compared by identity
+struct SpecialSymbols {
+    const MalSymbol* def = MalSymbol::intern("def!").get();
+    const MalSymbol* let = MalSymbol::intern("let*").get();
+    const MalSymbol* malIf = MalSymbol::intern("if").get();
+    const MalSymbol* malDo = MalSymbol::intern("do").get();
+    const MalSymbol* fn = MalSymbol::intern("fn*").get();
+    const MalSymbol* atom = MalSymbol::intern("atom").get();
+    const MalSymbol* reset = MalSymbol::intern("reset!").get();
+    const MalSymbol* swap = MalSymbol::intern("swap!").get();
+    const MalSymbol* quote = MalSymbol::intern("quote").get();
+    const MalSymbol* quasiQuote = MalSymbol::intern("quasiquote").get();
+    const MalSymbol* quasiQuoteExpand = MalSymbol::intern("quasiquoteexpand").get();
+    const MalSymbol* unquote = MalSymbol::intern("unquote").get();
+    const MalSymbol* spliceUnquote = MalSymbol::intern("splice-unquote").get();
+    const MalSymbol* defMacro = MalSymbol::intern("defmacro!").get();
+    const MalSymbol* macroExpand = MalSymbol::intern("macroexpand").get();
+    const MalSymbol* malTry = MalSymbol::intern("try*").get();
+    const MalSymbol* malCatch = MalSymbol::intern("catch*").get();
+    const MalSymbol* lazySeq = MalSymbol::intern("lazy-seq").get();
+    const MalSymbol* argv = MalSymbol::intern("*ARGV*").get();
+    const MalSymbol* hostLanguage = MalSymbol::intern("*host-language*").get();
+    const MalSymbol* standardOutput = MalSymbol::intern("*out*").get();
+    const MalSymbol* standardError = MalSymbol::intern("*err*").get();
+    const MalSymbol* standardInput = MalSymbol::intern("*in*").get();
+};
+
+static const SpecialSymbols& specialSymbols()
+{
+    static const SpecialSymbols symbols;
+    return symbols;
+}
+
 std::shared_ptr<MalType> evaluateFunc(const MalContainer* ls, Env& env)
 {
     const auto functionParameters = ls->at(1);
@@ -17,8 +50,8 @@ std::shared_ptr<MalType> evaluateDo(MalContainer* ls, Env& env)
 {
     if (ls->size() == 1) {
         return MalException::throwException("not enough arguments");
-    } else if (auto result = eval_ast(ls->tail(), env); result->asMalContainer()) {
-        return result->asMalContainer()->back();
+    } else if (auto result = eval_ast(ls->tail(), env); result->is<MalContainer>()) {
+        return result->as<MalContainer>()->back();
     } else {
         return result;
     }
@@ -36,7 +69,7 @@ std::shared_ptr<MalType> evaluateIf(const MalContainer* ls, Env& env)
     const auto ifCondition = ls->at(1);
     const auto res = EVAL(ifCondition, env);
 
-    if (auto resStr = res->asString(); resStr != "nil" && resStr != "false") {
+    if (const auto boolean = res->as<MalBoolean>(); !res->is<MalNil>() && !(boolean && !boolean->getValue())) {
         const auto trueBranch = ls->at(2);
         return EVAL(trueBranch, env);
     } else if (ls->size() > numberOfArguments) {
@@ -49,11 +82,15 @@ std::shared_ptr<MalType> evaluateIf(const MalContainer* ls, Env& env)
 std::shared_ptr<MalType> evaluateLet(const MalContainer* ls, Env& env)
 {
     Env letEnv(&env);
-    auto letArguments = ls->at(1)->asMalContainer();
+    auto letArguments = ls->at(1)->as<MalContainer>();
 
     // EXAMPLE: (let* (p (+ 2 3) q (+ 2 p)) (+ p q))
-    for (size_t i = 0; i < letArguments->size(); i += 2) {
-        letEnv.set(letArguments->at(i)->asString(), EVAL(letArguments->at(i + 1), letEnv));
+    for (size_t i = 0; i + 1 < letArguments->size(); i += 2) {
+        const auto name = letArguments->at(i)->as<MalSymbol>();
+        if (!name) {
+            return MalException::throwException("let* expects symbol, got " + letArguments->at(i)->asString());
+        }
+        letEnv.set(name, EVAL(letArguments->at(i + 1), letEnv));
     }
 
     return EVAL(ls->at(2), letEnv);
@@ -65,10 +102,13 @@ std::shared_ptr<MalType> evaluateDef(const MalContainer* ls, Env& env)
         return MalException::throwException("Not enough arguments");
     }
 
-    const auto envName = ls->at(1)->asString();
+    const auto envName = ls->at(1)->as<MalSymbol>();
+    if (!envName) {
+        return MalException::throwException("def! expects symbol, got " + ls->at(1)->asString());
+    }
     const auto envArguments = EVAL(ls->at(2), env);
 
-    if (!envArguments->asMalException()) {
+    if (!envArguments->is<MalException>()) {
         env.set(envName, envArguments);
     }
     return envArguments;
@@ -90,15 +130,15 @@ std::shared_ptr<MalType> evaluateReset(const MalContainer* ls, Env& env)
         return MalException::throwException("Not enough arguments");
     }
 
-    const auto atomName = ls->at(1)->asString();
-    if (const auto maybeAtom = env.find(atomName); !maybeAtom) {
-        return MalException::throwException(atomName + " is not defined");
-    } else if (!maybeAtom->asMalAtom()) {
+    const auto atomName = ls->at(1)->as<MalSymbol>();
+    if (const auto maybeAtom = atomName ? env.find(atomName) : nullptr; !maybeAtom) {
+        return MalException::throwException(ls->at(1)->asString() + " is not defined");
+    } else if (!maybeAtom->is<MalAtom>()) {
         return MalException::throwException("This operation could only be applied to atoms");
     } else {
         // NOTE: can you reset new atom with new atom?
         const auto newValue = EVAL(ls->at(2), env);
-        maybeAtom->asMalAtom()->reset(newValue);
+        maybeAtom->as<MalAtom>()->reset(newValue);
         return newValue;
     }
 }
@@ -109,21 +149,21 @@ std::shared_ptr<MalType> evaluateSwap(const MalContainer* ls, Env& env)
         return MalException::throwException("Not enough arguments");
     }
 
-    const auto atomName = ls->at(1)->asString();
-    if (const auto maybeAtom = env.find(atomName); !maybeAtom) {
-        return MalException::throwException(atomName + " is not defined");
-    } else if (!maybeAtom->asMalAtom()) {
+    const auto atomName = ls->at(1)->as<MalSymbol>();
+    if (const auto maybeAtom = atomName ? env.find(atomName) : nullptr; !maybeAtom) {
+        return MalException::throwException(ls->at(1)->asString() + " is not defined");
+    } else if (!maybeAtom->is<MalAtom>()) {
         return MalException::throwException("This operation could only be applied to atoms");
     } else {
         const auto function = EVAL(ls->at(2), env);
         const auto functionAst = std::make_shared<MalContainer>(ls->type());
         functionAst->append(function);
-        functionAst->append(maybeAtom->asMalAtom()->deref());
+        functionAst->append(maybeAtom->as<MalAtom>()->deref());
         for (size_t argIndex = 3; argIndex < ls->size(); ++argIndex) {
             functionAst->append(ls->at(argIndex));
         }
         const auto res = EVAL(functionAst, env);
-        maybeAtom->asMalAtom()->reset(res);
+        maybeAtom->as<MalAtom>()->reset(res);
         return res;
     }
 }
@@ -138,33 +178,34 @@ std::shared_ptr<MalType> evaluateQuote(const MalContainer* ast)
 
 std::shared_ptr<MalType> evaluateQuasiQuoteHelper(std::shared_ptr<MalType> ast, Env& env)
 {
-    if (auto ls = ast->asMalContainer(); ls) {
+    if (auto ls = ast->as<MalContainer>(); ls) {
         auto resultList = std::make_shared<MalList>();
         if (ls->type() == MalContainer::ContainerType::VECTOR) {
-            resultList->append(std::make_shared<MalSymbol>("vec"));
-            ls->toList();
-            resultList->append(evaluateQuasiQuoteHelper(ast, env));
+            resultList->append(MalSymbol::intern("vec"));
+            auto asList = ls->slice(0, ls->size());
+            asList->toList();
+            resultList->append(evaluateQuasiQuoteHelper(asList, env));
             return resultList;
         } else if (!ls->isEmpty()) {
             auto firstElemet = ls->at(0);
-            if (ls->size() > 1 && firstElemet->asString() == "unquote") {
+            if (ls->size() > 1 && firstElemet.get() == specialSymbols().unquote) {
                 return ls->at(1);
             }
-            if (auto firstElementAsContainer = firstElemet->asMalContainer(); firstElementAsContainer
+            if (auto firstElementAsContainer = firstElemet->as<MalContainer>(); firstElementAsContainer
                 && !firstElementAsContainer->isEmpty()
-                && firstElementAsContainer->at(0)->asString() == "splice-unquote") {
-                resultList->append(std::make_shared<MalSymbol>("concat"));
+                && firstElementAsContainer->at(0).get() == specialSymbols().spliceUnquote) {
+                resultList->append(MalSymbol::intern("concat"));
                 resultList->append(firstElementAsContainer->at(1));
             } else {
-                resultList->append(std::make_shared<MalSymbol>("cons"));
+                resultList->append(MalSymbol::intern("cons"));
                 resultList->append(evaluateQuasiQuoteHelper(firstElemet, env));
             }
-            resultList->append(evaluateQuasiQuoteHelper(MalContainer::tail(ls), env));
+            resultList->append(evaluateQuasiQuoteHelper(ls->tail(), env));
             return resultList;
         }
-    } else if (ast->asMalSymbol() || ast->asMalHashMap()) {
+    } else if (ast->is<MalSymbol>() || ast->is<MalHashMap>()) {
         auto list = std::make_shared<MalList>();
-        list->append(std::make_shared<MalSymbol>("quote"));
+        list->append(MalSymbol::intern("quote"));
         list->append(ast);
         return list;
     }
@@ -173,9 +214,7 @@ std::shared_ptr<MalType> evaluateQuasiQuoteHelper(std::shared_ptr<MalType> ast,
 
 std::shared_ptr<MalType> evaluateQuasiQuote(MalContainer* ast, Env& env)
 {
-    // buildin or env clsoure could be passed here, so we have to create a new list
-    // TODO: get rid of member function call of .tail() everywhere
-    auto quasiQuoteArgument = MalContainer::tail(ast);
+    auto quasiQuoteArgument = ast->tail();
     if (quasiQuoteArgument->isEmpty()) {
         return quasiQuoteArgument;
     }
@@ -185,7 +224,7 @@ std::shared_ptr<MalType> evaluateQuasiQuote(MalContainer* ast, Env& env)
 std::shared_ptr<MalType> evaluateDefMacro(const MalContainer* ls, Env& env)
 {
     auto macroArguments = evaluateDef(ls, env);
-    if (auto closure = macroArguments->asMalClosure(); closure) {
+    if (auto closure = macroArguments->as<MalClosure>(); closure) {
         closure->setIsMacroFunctionCall(true);
     }
     return macroArguments;
@@ -193,15 +232,15 @@ std::shared_ptr<MalType> evaluateDefMacro(const MalContainer* ls, Env& env)
 
 MalClosure* getMacroFunction(std::shared_ptr<MalType> ast, Env& env)
 {
-    auto ls = ast->asMalContainer();
+    auto ls = ast->as<MalContainer>();
     if (!ls || ls->isEmpty()) {
         return nullptr;
     }
 
     auto firstElemt = ls->at(0);
-    if (auto symobl = firstElemt->asMalSymbol(); symobl) {
-        if (auto callable = env.find(symobl->asString()); callable) {
-            auto macroFunction = callable->asMalClosure();
+    if (auto symobl = firstElemt->as<MalSymbol>(); symobl) {
+        if (auto callable = env.find(symobl); callable) {
+            auto macroFunction = callable->as<MalClosure>();
             if (macroFunction && macroFunction->getIsMacroFucntionCall()) {
                 return macroFunction;
             }
@@ -213,7 +252,7 @@ MalClosure* getMacroFunction(std::shared_ptr<MalType> ast, Env& env)
 std::shared_ptr<MalType> tryToExpandMacro(std::shared_ptr<MalType> ast, Env& env)
 {
     auto macroFunction = getMacroFunction(ast, env);
-    if (auto ls = ast->asMalContainer(); ls && macroFunction) {
+    if (auto ls = ast->as<MalContainer>(); ls && macroFunction) {
         auto args = ls->tail();
         auto res = macroFunction->evaluate(args.get(), env);
         return tryToExpandMacro(res, env);
@@ -245,69 +284,102 @@ std::shared_ptr<MalType> evaluateTry(const MalContainer* ls, Env& env)
     }
 
     auto tryBlock = EVAL(ls->at(1), env);
-    if (ls->size() > 2 && tryBlock->asMalException()) {
-        if (auto catchBlock = ls->at(2)->asMalContainer(); catchBlock && !catchBlock->isEmpty() && catchBlock->at(0)->asString() == "catch*") {
+    if (ls->size() > 2 && tryBlock->is<MalException>()) {
+        if (auto catchBlock = ls->at(2)->as<MalContainer>(); catchBlock && !catchBlock->isEmpty() && catchBlock->at(0).get() == specialSymbols().malCatch) {
             if (catchBlock->size() <= 2) {
                 return std::make_shared<MalNil>();
             }
-            auto exceptionName = catchBlock->at(1)->asString();
+            auto exceptionName = catchBlock->at(1)->as<MalSymbol>();
             auto exceptioinAction = catchBlock->at(2);
             // TODO: come up with other exception handling logic
-            auto strException = std::make_shared<MalString>(extractExcetpionMessage(tryBlock->asMalException()));
+            auto strException = std::make_shared<MalString>(extractExcetpionMessage(tryBlock->as<MalException>()));
             Env exceptionEnv(&env);
-            env.set(exceptionName, strException);
+            if (exceptionName) {
+                env.set(exceptionName, strException);
+            }
             return EVAL(exceptioinAction, exceptionEnv);
         }
     }
     return tryBlock;
 }
 
+// (lazy-seq body) body is evaluated once the sequence is walked, and should evaluate to a sequence or nil
+std::shared_ptr<MalType> evaluateLazySeq(const MalContainer* ls, Env& env)
+{
+    if (ls->size() < 2) {
+        return MalException::throwException("lazy-seq expects body");
+    }
+    // NOTE: sequence could be walked after env is gone, so it captures it (see Env::captured)
+    auto lazySeqEnv = env.captured();
+    return std::make_shared<MalLazySeq>([body = ls->at(1), lazySeqEnv](MalLazySeq::Elements& chunk) -> std::shared_ptr<MalType> {
+        auto sequence = EVAL(body, *lazySeqEnv);
+        if (sequence->is<MalException>() || sequence->is<MalLazySeq>()) {
+            return sequence;
+        } else if (auto container = sequence->as<MalContainer>(); container) {
+            chunk.assign(container->begin(), container->end());
+            return nullptr;
+        } else if (sequence->is<MalNil>()) {
+            return nullptr;
+        }
+        return MalException::throwException("lazy-seq body should evaluate to a sequence, got " + sequence->asString());
+    });
+}
+
 std::shared_ptr<MalType> EVAL(std::shared_ptr<MalType> ast, Env& env)
 {
-    if (const auto container = ast->asMalContainer(); container) {
+    if (const auto container = ast->as<MalContainer>(); container) {
         if (container->isEmpty()) {
             return ast;
         }
 
         // TODO: move some of this fucntions to global env
-        if (const auto symbolStr = container->at(0)->asString(); symbolStr == "def!") {
-            return evaluateDef(container, env);
-        } else if (symbolStr == "let*") {
-            return evaluateLet(container, env);
-        } else if (symbolStr == "if") {
-            return evaluateIf(container, env);
-        } else if (symbolStr == "do") {
-            return evaluateDo(container, env);
-        } else if (symbolStr == "fn*") {
-            return evaluateFunc(container, env);
-        } else if (symbolStr == "atom") {
-            return evaluateAtom(container, env);
-        } else if (symbolStr == "reset!") {
-            return evaluateReset(container, env);
-        } else if (symbolStr == "swap!") {
-            return evaluateSwap(container, env);
-        } else if (symbolStr == "quote") {
-            return evaluateQuote(container);
-        } else if (symbolStr == "quasiquote") {
-            return EVAL(evaluateQuasiQuote(container, env), env);
-        } else if (symbolStr == "quasiquoteexpand") {
-            return evaluateQuasiQuote(container, env);
-        } else if (symbolStr == "defmacro!") {
-            return evaluateDefMacro(container, env);
-        } else if (symbolStr == "macroexpand") {
-            return evaluateMacroExpansion(container, env);
-        } else if (symbolStr == "try*") {
-            return evaluateTry(container, env);
+        if (const auto symbol = container->at(0)->as<MalSymbol>(); symbol) {
+            const auto& special = specialSymbols();
+            if (symbol == special.def) {
+                return evaluateDef(container, env);
+            } else if (symbol == special.let) {
+                return evaluateLet(container, env);
+            } else if (symbol == special.malIf) {
+                return evaluateIf(container, env);
+            } else if (symbol == special.malDo) {
+                return evaluateDo(container, env);
+            } else if (symbol == special.fn) {
+                return evaluateFunc(container, env);
+            } else if (symbol == special.atom) {
+                return evaluateAtom(container, env);
+            } else if (symbol == special.reset) {
+                return evaluateReset(container, env);
+            } else if (symbol == special.swap) {
+                return evaluateSwap(container, env);
+            } else if (symbol == special.quote) {
+                return evaluateQuote(container);
+            } else if (symbol == special.quasiQuote) {
+                return EVAL(evaluateQuasiQuote(container, env), env);
+            } else if (symbol == special.quasiQuoteExpand) {
+                return evaluateQuasiQuote(container, env);
+            } else if (symbol == special.defMacro) {
+                return evaluateDefMacro(container, env);
+            } else if (symbol == special.macroExpand) {
+                return evaluateMacroExpansion(container, env);
+            } else if (symbol == special.malTry) {
+                return evaluateTry(container, env);
+            } else if (symbol == special.lazySeq) {
+                return evaluateLazySeq(container, env);
+            }
         }
 
-        const auto evaluatedList = eval_ast(ast, env);
-        if (auto ls = evaluatedList->asMalContainer(); ls && !ls->isEmpty()) {
+        auto evaluatedList = eval_ast(ast, env);
+        if (auto ls = evaluatedList->as<MalContainer>(); ls && !ls->isEmpty()) {
             const auto head = ls->head();
-            if (auto closure = head->asMalClosure(); closure) {
+            if (auto closure = head->as<MalClosure>(); closure) {
                 auto returnValue = closure->evaluate(ls->tail().get(), env);
                 return closure->getIsMacroFucntionCall() ? EVAL(returnValue, env) : returnValue;
-            } else if (auto buildin = head->asMalBuildin(); buildin) {
-                return buildin->evaluate(ls->tail().get(), env);
+            } else if (auto buildin = head->as<MalBuildin>(); buildin) {
+                // arguments are the only owner of evaluated values, so buildins could take them (see takeAt)
+                auto args = ls->tail();
+                evaluatedList.reset();
+                args->markAsOwnedArguments();
+                return buildin->evaluate(args.get(), env);
             }
         }
         return evaluatedList;
@@ -317,34 +389,38 @@ std::shared_ptr<MalType> EVAL(std::shared_ptr<MalType> ast, Env& env)
 
 std::shared_ptr<MalType> eval_ast(std::shared_ptr<MalType> ast, Env& env)
 {
-    if (const auto container = ast->asMalContainer(); container) {
+    if (const auto container = ast->as<MalContainer>(); container) {
         if (container->isEmpty()) {
             return ast;
         }
         auto newContainer = std::make_shared<MalContainer>(container->type());
         for (const auto& element : *container) {
-            if (const auto evaluatedElement = EVAL(element, env); evaluatedElement->asMalException()) {
+            if (const auto evaluatedElement = EVAL(element, env); evaluatedElement->is<MalException>()) {
                 return evaluatedElement;
             } else {
                 newContainer->append(evaluatedElement);
             }
         }
         return newContainer;
-    } else if (const auto symbol = ast->asMalSymbol(); symbol) {
+    } else if (const auto symbol = ast->as<MalSymbol>(); symbol) {
         if (symbol->getType() == MalSymbol::SymbolType::KEYWORD) {
             return ast;
         }
-        const auto relatedEnv = env.find(symbol->asString());
+        const auto relatedEnv = env.find(symbol);
         if (!relatedEnv) {
-            return MalException::throwException("\"'" + symbol->asString() + "'" + " not found\"");
-        } else if (symbol->asString() == "*ARGV*" || symbol->asString() == "*host-language*") {
-            return relatedEnv->asMalBuildin()->evaluate(nullptr);
+            return MalException::throwException("'" + symbol->asString() + "'" + " not found");
+        } else if (symbol == specialSymbols().argv || symbol == specialSymbols().hostLanguage || symbol == specialSymbols().standardOutput
+            || symbol == specialSymbols().standardError || symbol == specialSymbols().standardInput) {
+            return relatedEnv->as<MalBuildin>()->evaluate(nullptr);
         }
         return relatedEnv;
-    } else if (const auto hashMap = ast->asMalHashMap(); hashMap) {
-        auto newHashMap = std::make_shared<MalHashMap>();
-        for (auto& [key, value] : *hashMap) {
-            newHashMap->insert(key, EVAL(value, env));
+    } else if (const auto hashMap = ast->as<MalHashMap>(); hashMap) {
+        // NOTE: values that evaluate to themselves keep sharing the trie with the original map
+        auto newHashMap = std::static_pointer_cast<MalHashMap>(hashMap->clone());
+        for (const auto& [key, value] : *hashMap) {
+            if (auto evaluatedValue = EVAL(value, env); evaluatedValue != value) {
+                newHashMap->insert(key, evaluatedValue);
+            }
         }
         return newHashMap;
     }
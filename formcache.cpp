@@ -0,0 +1,273 @@
+#include "formcache.h"
+
+#include "binaryio.h"
+#include "mappedfile.h"
+#include "maltypes.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace mal::formcache {
+
+namespace {
+constexpr char magic[4] = { 'M', 'A', 'L', 'C' };
+// bumped whenever the layout changes, images of other versions are stale
+constexpr uint32_t formatVersion = 2;
+
+enum class NodeType : uint8_t {
+    NIL,
+    TRUE,
+    FALSE,
+    NUMBER,
+    BIG_INTEGER,
+    DOUBLE,
+    STRING,
+    SYMBOL,
+    LIST,
+    VECTOR,
+    HASH_MAP
+};
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+    uint32_t symbolsCount;
+    uint32_t formsCount;
+    // forms are decoded while they are evaluated, a damaged image has to be found before that
+    uint64_t nodesHash;
+};
+
+// FNV-1a, stable between runs and builds unlike std::hash
+uint64_t hashBytes(std::string_view bytes)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const auto symbol : bytes) {
+        hash = (hash ^ static_cast<uint8_t>(symbol)) * 0x100000001b3;
+    }
+    return hash;
+}
+}
+
+std::string cachePath(const std::string& sourcePath)
+{
+    return sourcePath + "c";
+}
+
+std::unique_ptr<Reader> Reader::open(const std::string& sourcePath, std::string_view source)
+{
+    auto file = MappedFile::open(cachePath(sourcePath));
+    if (!file) {
+        return nullptr;
+    }
+
+    BinaryReader image(file->view());
+    Header header {};
+    // size is compared first, hashing the source is only worth it when the image could match
+    if (!image.get(header) || std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != formatVersion
+        || header.sourceSize != source.size() || header.sourceHash != hashBytes(source)) {
+        return nullptr;
+    }
+    std::vector<std::shared_ptr<MalSymbol>> symbols;
+    if (!readSymbolTable(image, header.symbolsCount, symbols) || header.nodesHash != hashBytes(image.rest())) {
+        return nullptr;
+    }
+    BinaryReader nodes(image.rest());
+    return std::make_unique<Reader>(std::move(file), nodes, std::move(symbols), header.formsCount);
+}
+
+Reader::Reader(std::shared_ptr<const MappedFile> file, BinaryReader nodes, std::vector<std::shared_ptr<MalSymbol>> symbols, uint32_t formsCount)
+    : m_file(std::move(file))
+    , m_nodes(nodes)
+    , m_symbols(std::move(symbols))
+    , m_formsLeft(formsCount)
+{
+}
+
+std::shared_ptr<MalType> Reader::next()
+{
+    if (m_isDamaged) {
+        return nullptr;
+    }
+    if (m_formsLeft == 0) {
+        m_isDamaged = !m_nodes.isEnd();
+        return nullptr;
+    }
+    --m_formsLeft;
+    auto form = decode();
+    m_isDamaged = !form;
+    return form;
+}
+
+bool Reader::isDamaged() const
+{
+    return m_isDamaged;
+}
+
+std::shared_ptr<MalType> Reader::decode()
+{
+    NodeType type {};
+    if (!m_nodes.get(type)) {
+        return nullptr;
+    }
+    switch (type) {
+    case NodeType::NIL:
+        return std::make_shared<MalNil>();
+    case NodeType::TRUE:
+    case NodeType::FALSE:
+        return std::make_shared<MalBoolean>(type == NodeType::TRUE);
+    case NodeType::NUMBER: {
+        int64_t number = 0;
+        return m_nodes.get(number) ? std::make_shared<MalNumber>(number) : nullptr;
+    }
+    case NodeType::BIG_INTEGER: {
+        std::string_view digits;
+        if (!m_nodes.getString(digits)) {
+            return nullptr;
+        }
+        auto number = BigInteger::fromString(digits);
+        return number ? MalBigInteger::normalized(std::move(number.value())) : nullptr;
+    }
+    case NodeType::DOUBLE: {
+        double number = 0;
+        return m_nodes.get(number) ? std::make_shared<MalDouble>(number) : nullptr;
+    }
+    case NodeType::STRING: {
+        std::string_view str;
+        return m_nodes.getString(str) ? std::make_shared<MalString>(str) : nullptr;
+    }
+    case NodeType::SYMBOL: {
+        uint32_t symbolIndex = 0;
+        if (!m_nodes.get(symbolIndex) || symbolIndex >= m_symbols.size()) {
+            return nullptr;
+        }
+        return m_symbols[symbolIndex];
+    }
+    case NodeType::LIST:
+    case NodeType::VECTOR: {
+        std::shared_ptr<MalContainer> container;
+        if (type == NodeType::LIST) {
+            container = std::make_shared<MalList>();
+        } else {
+            container = std::make_shared<MalVector>();
+        }
+        uint32_t size = 0;
+        if (!m_nodes.get(size)) {
+            return nullptr;
+        }
+        for (uint32_t elementIndex = 0; elementIndex < size; ++elementIndex) {
+            auto element = decode();
+            if (!element) {
+                return nullptr;
+            }
+            container->append(std::move(element));
+        }
+        return container;
+    }
+    case NodeType::HASH_MAP: {
+        auto hashMap = std::make_shared<MalHashMap>();
+        uint32_t size = 0;
+        if (!m_nodes.get(size)) {
+            return nullptr;
+        }
+        for (uint32_t pairIndex = 0; pairIndex < size; ++pairIndex) {
+            auto key = decode();
+            auto value = key ? decode() : nullptr;
+            if (!value) {
+                return nullptr;
+            }
+            hashMap->insert(std::move(key), std::move(value));
+        }
+        return hashMap;
+    }
+    }
+    return nullptr;
+}
+
+bool Writer::add(MalType* form)
+{
+    // a form that can't be encoded leaves the nodes half written, there is no cache for this source then
+    m_isEncodable = m_isEncodable && encode(form);
+    ++m_formsCount;
+    return m_isEncodable;
+}
+
+// Header and symbol table come first, they are known only once all forms are encoded
+bool Writer::store(const std::string& sourcePath, std::string_view source) const
+{
+    if (!m_isEncodable) {
+        return false;
+    }
+    Header header {};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = formatVersion;
+    header.sourceSize = source.size();
+    header.sourceHash = hashBytes(source);
+    header.symbolsCount = m_symbols.size();
+    header.formsCount = m_formsCount;
+    header.nodesHash = hashBytes(m_nodes.data());
+
+    BinaryWriter out;
+    out.put(header);
+    m_symbols.write(out);
+    return writeFileAtomically(cachePath(sourcePath), out.data() + m_nodes.data());
+}
+
+bool Writer::encode(MalType* value)
+{
+    switch (value->tag()) {
+    case MalTypeTag::NIL:
+        m_nodes.put(NodeType::NIL);
+        return true;
+    case MalTypeTag::BOOLEAN:
+        m_nodes.put(value->as<MalBoolean>()->getValue() ? NodeType::TRUE : NodeType::FALSE);
+        return true;
+    case MalTypeTag::NUMBER:
+        m_nodes.put(NodeType::NUMBER);
+        m_nodes.put(value->as<MalNumber>()->getValue());
+        return true;
+    case MalTypeTag::BIG_INTEGER:
+        m_nodes.put(NodeType::BIG_INTEGER);
+        m_nodes.putString(value->as<MalBigInteger>()->getValue().toString());
+        return true;
+    case MalTypeTag::DOUBLE:
+        m_nodes.put(NodeType::DOUBLE);
+        m_nodes.put(value->as<MalDouble>()->getValue());
+        return true;
+    case MalTypeTag::STRING:
+        m_nodes.put(NodeType::STRING);
+        m_nodes.putString(value->as<MalString>()->value());
+        return true;
+    case MalTypeTag::SYMBOL:
+        m_nodes.put(NodeType::SYMBOL);
+        m_nodes.put(m_symbols.indexOf(value->as<MalSymbol>()));
+        return true;
+    case MalTypeTag::CONTAINER: {
+        const auto container = value->as<MalContainer>();
+        m_nodes.put(container->type() == MalContainer::ContainerType::LIST ? NodeType::LIST : NodeType::VECTOR);
+        m_nodes.put(static_cast<uint32_t>(container->size()));
+        for (const auto& element : *container) {
+            if (!encode(element.get())) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case MalTypeTag::HASH_MAP: {
+        const auto hashMap = value->as<MalHashMap>();
+        m_nodes.put(NodeType::HASH_MAP);
+        m_nodes.put(static_cast<uint32_t>(hashMap->size()));
+        for (const auto& [key, element] : *hashMap) {
+            if (!encode(key.get()) || !encode(element.get())) {
+                return false;
+            }
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+} // namespace mal::formcache
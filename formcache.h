@@ -0,0 +1,69 @@
+#pragma once
+
+#include "binaryio.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mal {
+class MalType;
+class MappedFile;
+
+// Binary image of the forms read from a source file, kept next to it ("core.mal" -> "core.malc").
+// Symbols and keywords are stored once in a table and interned again on load, forms are typed nodes
+// in prefix order. The image carries size and hash of the source it was read from, a changed source
+// makes it stale and it is written anew.
+// NOTE: numbers are stored in host byte order, images are not meant to be moved between machines
+namespace formcache {
+
+// "<sourcePath>c"
+std::string cachePath(const std::string& sourcePath);
+
+// Forms of a cache file decoded one at a time, like FormReader reads them from the source
+class Reader {
+public:
+    // nullptr if the cache file is missing, stale or damaged.
+    // The encoded forms are checked against their hash here, so a damaged file is found before any form is taken
+    static std::unique_ptr<Reader> open(const std::string& sourcePath, std::string_view source);
+
+    Reader(std::shared_ptr<const MappedFile> file, BinaryReader nodes, std::vector<std::shared_ptr<MalSymbol>> symbols, uint32_t formsCount);
+
+    // nullptr once all forms are read or if the rest of the file can't be decoded, see isDamaged
+    std::shared_ptr<MalType> next();
+    bool isDamaged() const;
+
+private:
+    // nullptr if the image is damaged
+    std::shared_ptr<MalType> decode();
+
+private:
+    std::shared_ptr<const MappedFile> m_file;
+    BinaryReader m_nodes;
+    std::vector<std::shared_ptr<MalSymbol>> m_symbols;
+    uint32_t m_formsLeft;
+    bool m_isDamaged { false };
+};
+
+// Encodes forms as they are read, so the source's forms don't have to be kept until the cache is written
+class Writer {
+public:
+    // false if form has values the reader doesn't make, the cache is not stored then
+    bool add(MalType* form);
+    // Replaces the cache file atomically, false if some form couldn't be added or the file couldn't be written
+    // (a read-only directory is not an error, there is just no cache)
+    bool store(const std::string& sourcePath, std::string_view source) const;
+
+private:
+    bool encode(MalType* value);
+
+private:
+    BinaryWriter m_nodes;
+    SymbolTableWriter m_symbols;
+    uint32_t m_formsCount { 0 };
+    bool m_isEncodable { true };
+};
+
+} // namespace formcache
+} // namespace mal
@@ -0,0 +1,540 @@
+#include "heapimage.h"
+
+#include "binaryio.h"
+#include "env.h"
+#include "mappedfile.h"
+#include "maltypes.h"
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace mal::heapimage {
+
+namespace {
+constexpr char magic[4] = { 'M', 'A', 'L', 'I' };
+// bumped whenever the layout changes
+constexpr uint32_t formatVersion = 1;
+
+enum class ObjectType : uint8_t {
+    NIL,
+    TRUE,
+    FALSE,
+    NUMBER,
+    BIG_INTEGER,
+    DOUBLE,
+    STRING,
+    SYMBOL,
+    LIST,
+    VECTOR,
+    HASH_MAP,
+    INTEGER_VECTOR,
+    DOUBLE_VECTOR,
+    ATOM,
+    CLOSURE,
+    BUILDIN
+};
+
+// Edges that could close a cycle, they are set once all objects exist
+enum class LinkType : uint8_t {
+    META_INFO,
+    ATOM_VALUE,
+    CLOSURE_BINDING
+};
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t symbolsCount;
+    uint32_t objectsCount;
+    uint32_t bindingsCount;
+    uint32_t linksCount;
+};
+
+// Objects are written in the order they are created on restore: elements of containers, keys and values
+// of maps and parameters and body of closures always come before the object that holds them
+class Encoder {
+public:
+    // Index of the object, nullopt if it can't be saved, see error()
+    std::optional<uint32_t> add(const std::shared_ptr<MalType>& value)
+    {
+        if (auto added = m_indexes.find(value.get()); added != m_indexes.end()) {
+            return added->second;
+        }
+        if (!writeObject(value.get())) {
+            return std::nullopt;
+        }
+        const auto index = static_cast<uint32_t>(m_objects.size());
+        m_objects.push_back(value);
+        m_indexes.emplace(value.get(), index);
+        return index;
+    }
+
+    // Adds metadata, atom values and closure environments of all added objects and of objects they add
+    bool addLinks()
+    {
+        for (; m_linkedCount < m_objects.size(); ++m_linkedCount) {
+            // copied, linking appends to m_objects
+            const auto value = m_objects[m_linkedCount];
+            if (value->hasMetaInfo() && !link(LinkType::META_INFO, value->getMetaInfo())) {
+                return false;
+            }
+            if (auto atom = value->as<MalAtom>(); atom && !link(LinkType::ATOM_VALUE, atom->deref())) {
+                return false;
+            }
+            if (auto closure = value->as<MalClosure>(); closure) {
+                // a closure made in a lazy body also sees the frames the body captured
+                const auto closureEnv = closure->relatedEnv().flattened();
+                for (const auto& [name, boundValue] : closureEnv.bindings()) {
+                    if (!link(LinkType::CLOSURE_BINDING, boundValue, name)) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    void addBinding(const MalSymbol* name, uint32_t object)
+    {
+        m_bindings.put(m_symbols.indexOf(const_cast<MalSymbol*>(name)));
+        m_bindings.put(object);
+        ++m_bindingsCount;
+    }
+
+    std::string image() const
+    {
+        Header header {};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = formatVersion;
+        header.symbolsCount = m_symbols.size();
+        header.objectsCount = static_cast<uint32_t>(m_objects.size());
+        header.bindingsCount = m_bindingsCount;
+        header.linksCount = m_linksCount;
+
+        BinaryWriter out;
+        out.put(header);
+        m_symbols.write(out);
+        return out.data() + m_objectsData.data() + m_bindings.data() + m_links.data();
+    }
+
+    const std::string& error() const
+    {
+        return m_error;
+    }
+
+private:
+    bool writeObject(MalType* value)
+    {
+        switch (value->tag()) {
+        case MalTypeTag::NIL:
+            m_objectsData.put(ObjectType::NIL);
+            return true;
+        case MalTypeTag::BOOLEAN:
+            m_objectsData.put(value->as<MalBoolean>()->getValue() ? ObjectType::TRUE : ObjectType::FALSE);
+            return true;
+        case MalTypeTag::NUMBER:
+            m_objectsData.put(ObjectType::NUMBER);
+            m_objectsData.put(value->as<MalNumber>()->getValue());
+            return true;
+        case MalTypeTag::BIG_INTEGER:
+            m_objectsData.put(ObjectType::BIG_INTEGER);
+            m_objectsData.putString(value->as<MalBigInteger>()->getValue().toString());
+            return true;
+        case MalTypeTag::DOUBLE:
+            m_objectsData.put(ObjectType::DOUBLE);
+            m_objectsData.put(value->as<MalDouble>()->getValue());
+            return true;
+        case MalTypeTag::STRING:
+            m_objectsData.put(ObjectType::STRING);
+            m_objectsData.putString(value->as<MalString>()->value());
+            return true;
+        case MalTypeTag::SYMBOL:
+            m_objectsData.put(ObjectType::SYMBOL);
+            m_objectsData.put(m_symbols.indexOf(value->as<MalSymbol>()));
+            return true;
+        case MalTypeTag::CONTAINER: {
+            const auto container = value->as<MalContainer>();
+            std::vector<uint32_t> elements;
+            elements.reserve(container->size());
+            for (const auto& element : *container) {
+                if (const auto index = add(element); index) {
+                    elements.push_back(*index);
+                } else {
+                    return false;
+                }
+            }
+            m_objectsData.put(container->type() == MalContainer::ContainerType::LIST ? ObjectType::LIST : ObjectType::VECTOR);
+            writeIndexes(elements);
+            return true;
+        }
+        case MalTypeTag::HASH_MAP: {
+            std::vector<uint32_t> entries;
+            for (const auto& [key, element] : *value->as<MalHashMap>()) {
+                const auto keyIndex = add(key);
+                const auto elementIndex = keyIndex ? add(element) : std::nullopt;
+                if (!elementIndex) {
+                    return false;
+                }
+                entries.push_back(*keyIndex);
+                entries.push_back(*elementIndex);
+            }
+            m_objectsData.put(ObjectType::HASH_MAP);
+            writeIndexes(entries);
+            return true;
+        }
+        case MalTypeTag::NUMERIC_VECTOR: {
+            const auto numericVector = value->as<MalNumericVector>();
+            m_objectsData.put(numericVector->isDouble() ? ObjectType::DOUBLE_VECTOR : ObjectType::INTEGER_VECTOR);
+            m_objectsData.put(static_cast<uint32_t>(numericVector->size()));
+            if (numericVector->isDouble()) {
+                for (const auto element : numericVector->doubles()) {
+                    m_objectsData.put(element);
+                }
+            } else {
+                for (const auto element : numericVector->integers()) {
+                    m_objectsData.put(element);
+                }
+            }
+            return true;
+        }
+        case MalTypeTag::ATOM:
+            m_objectsData.put(ObjectType::ATOM);
+            m_objectsData.putString(value->as<MalAtom>()->description());
+            return true;
+        case MalTypeTag::CLOSURE: {
+            const auto closure = value->as<MalClosure>();
+            const auto parameters = add(closure->parameters());
+            const auto body = parameters ? add(closure->body()) : std::nullopt;
+            if (!body) {
+                return false;
+            }
+            m_objectsData.put(ObjectType::CLOSURE);
+            m_objectsData.put(*parameters);
+            m_objectsData.put(*body);
+            m_objectsData.put(static_cast<uint8_t>(closure->getIsMacroFucntionCall()));
+            return true;
+        }
+        case MalTypeTag::BUILDIN:
+            if (const auto name = GlobalEnv::the().nameOf(value->as<MalBuildin>()); name) {
+                m_objectsData.put(ObjectType::BUILDIN);
+                m_objectsData.put(m_symbols.indexOf(const_cast<MalSymbol*>(name)));
+                return true;
+            }
+            m_error = "image can't hold functions made by buildins";
+            return false;
+        case MalTypeTag::LAZY_SEQ:
+            m_error = "image can't hold lazy sequences";
+            return false;
+        case MalTypeTag::TRANSDUCER:
+            m_error = "image can't hold transducers";
+            return false;
+        case MalTypeTag::PORT:
+            m_error = "image can't hold ports";
+            return false;
+        default:
+            m_error = "image can't hold " + value->asString();
+            return false;
+        }
+    }
+
+    void writeIndexes(const std::vector<uint32_t>& indexes)
+    {
+        m_objectsData.put(static_cast<uint32_t>(indexes.size()));
+        for (const auto index : indexes) {
+            m_objectsData.put(index);
+        }
+    }
+
+    bool link(LinkType type, const std::shared_ptr<MalType>& target, const MalSymbol* name = nullptr)
+    {
+        const auto targetIndex = add(target);
+        if (!targetIndex) {
+            return false;
+        }
+        m_links.put(type);
+        m_links.put(static_cast<uint32_t>(m_linkedCount));
+        if (type == LinkType::CLOSURE_BINDING) {
+            m_links.put(m_symbols.indexOf(const_cast<MalSymbol*>(name)));
+        }
+        m_links.put(*targetIndex);
+        ++m_linksCount;
+        return true;
+    }
+
+private:
+    BinaryWriter m_objectsData;
+    BinaryWriter m_bindings;
+    BinaryWriter m_links;
+    SymbolTableWriter m_symbols;
+    // Owned, so a value only a temporary held can't be freed and its address reused while encoding
+    std::vector<std::shared_ptr<MalType>> m_objects;
+    std::unordered_map<const MalType*, uint32_t> m_indexes;
+    size_t m_linkedCount { 0 };
+    uint32_t m_bindingsCount { 0 };
+    uint32_t m_linksCount { 0 };
+    std::string m_error;
+};
+
+class Decoder : public BinaryReader {
+public:
+    using BinaryReader::BinaryReader;
+
+    bool readSymbols(uint32_t count)
+    {
+        return readSymbolTable(*this, count, m_symbols);
+    }
+
+    bool readObjects(uint32_t count)
+    {
+        // every object takes its type byte at least
+        if (!hasRoomFor(count, sizeof(ObjectType))) {
+            return false;
+        }
+        m_objects.reserve(count);
+        for (uint32_t objectIndex = 0; objectIndex < count; ++objectIndex) {
+            auto object = readObject();
+            if (!object) {
+                return false;
+            }
+            m_objects.push_back(std::move(object));
+        }
+        return true;
+    }
+
+    bool readBindings(uint32_t count, Env::Bindings& bindings)
+    {
+        for (uint32_t bindingIndex = 0; bindingIndex < count; ++bindingIndex) {
+            std::shared_ptr<MalSymbol> name;
+            std::shared_ptr<MalType> value;
+            if (!readSymbol(name) || !readObjectIndex(value)) {
+                return false;
+            }
+            bindings[name.get()] = std::move(value);
+        }
+        return true;
+    }
+
+    bool readLinks(uint32_t count)
+    {
+        for (uint32_t linkIndex = 0; linkIndex < count; ++linkIndex) {
+            LinkType type {};
+            std::shared_ptr<MalType> object;
+            if (!get(type) || !readObjectIndex(object)) {
+                return false;
+            }
+            std::shared_ptr<MalSymbol> name;
+            if (type == LinkType::CLOSURE_BINDING && !readSymbol(name)) {
+                return false;
+            }
+            std::shared_ptr<MalType> target;
+            if (!readObjectIndex(target)) {
+                return false;
+            }
+
+            if (type == LinkType::META_INFO) {
+                object->setMetaInfo(std::move(target));
+            } else if (auto atom = object->as<MalAtom>(); type == LinkType::ATOM_VALUE && atom) {
+                atom->reset(std::move(target));
+            } else if (auto closure = object->as<MalClosure>(); type == LinkType::CLOSURE_BINDING && closure) {
+                closure->relatedEnv().set(name.get(), std::move(target));
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // nullptr if the image is damaged
+    std::shared_ptr<MalType> readObject()
+    {
+        ObjectType type {};
+        if (!get(type)) {
+            return nullptr;
+        }
+        switch (type) {
+        case ObjectType::NIL:
+            return std::make_shared<MalNil>();
+        case ObjectType::TRUE:
+        case ObjectType::FALSE:
+            return std::make_shared<MalBoolean>(type == ObjectType::TRUE);
+        case ObjectType::NUMBER: {
+            int64_t number = 0;
+            return get(number) ? std::make_shared<MalNumber>(number) : nullptr;
+        }
+        case ObjectType::BIG_INTEGER: {
+            std::string_view digits;
+            if (!getString(digits)) {
+                return nullptr;
+            }
+            auto number = BigInteger::fromString(digits);
+            return number ? MalBigInteger::normalized(std::move(number.value())) : nullptr;
+        }
+        case ObjectType::DOUBLE: {
+            double number = 0;
+            return get(number) ? std::make_shared<MalDouble>(number) : nullptr;
+        }
+        case ObjectType::STRING: {
+            std::string_view str;
+            return getString(str) ? std::make_shared<MalString>(str) : nullptr;
+        }
+        case ObjectType::SYMBOL: {
+            std::shared_ptr<MalSymbol> symbol;
+            return readSymbol(symbol) ? symbol : nullptr;
+        }
+        case ObjectType::LIST:
+        case ObjectType::VECTOR: {
+            std::shared_ptr<MalContainer> container;
+            if (type == ObjectType::LIST) {
+                container = std::make_shared<MalList>();
+            } else {
+                container = std::make_shared<MalVector>();
+            }
+            uint32_t size = 0;
+            if (!get(size) || !hasRoomFor(size, sizeof(uint32_t))) {
+                return nullptr;
+            }
+            for (uint32_t elementIndex = 0; elementIndex < size; ++elementIndex) {
+                std::shared_ptr<MalType> element;
+                if (!readObjectIndex(element)) {
+                    return nullptr;
+                }
+                container->append(std::move(element));
+            }
+            return container;
+        }
+        case ObjectType::HASH_MAP: {
+            auto hashMap = std::make_shared<MalHashMap>();
+            uint32_t size = 0;
+            if (!get(size) || size % 2 != 0 || !hasRoomFor(size, sizeof(uint32_t))) {
+                return nullptr;
+            }
+            for (uint32_t entryIndex = 0; entryIndex < size; entryIndex += 2) {
+                std::shared_ptr<MalType> key;
+                std::shared_ptr<MalType> value;
+                if (!readObjectIndex(key) || !readObjectIndex(value)) {
+                    return nullptr;
+                }
+                hashMap->insert(std::move(key), std::move(value));
+            }
+            return hashMap;
+        }
+        case ObjectType::INTEGER_VECTOR:
+            return readNumericVector<int64_t>();
+        case ObjectType::DOUBLE_VECTOR:
+            return readNumericVector<double>();
+        case ObjectType::ATOM: {
+            std::string_view description;
+            return getString(description) ? std::make_shared<MalAtom>(std::make_shared<MalNil>(), std::string(description)) : nullptr;
+        }
+        case ObjectType::CLOSURE: {
+            std::shared_ptr<MalType> parameters;
+            std::shared_ptr<MalType> body;
+            uint8_t isMacro = 0;
+            if (!readObjectIndex(parameters) || !parameters->is<MalContainer>() || !readObjectIndex(body) || !get(isMacro)) {
+                return nullptr;
+            }
+            auto closure = std::make_shared<MalClosure>(parameters, body, Env());
+            closure->setIsMacroFunctionCall(isMacro);
+            return closure;
+        }
+        case ObjectType::BUILDIN: {
+            std::shared_ptr<MalSymbol> name;
+            if (!readSymbol(name)) {
+                return nullptr;
+            }
+            auto buildin = GlobalEnv::the().find(name.get());
+            return buildin && buildin->is<MalBuildin>() ? buildin : nullptr;
+        }
+        }
+        return nullptr;
+    }
+
+    template <typename Element>
+    std::shared_ptr<MalType> readNumericVector()
+    {
+        uint32_t size = 0;
+        if (!get(size) || !hasRoomFor(size, sizeof(Element))) {
+            return nullptr;
+        }
+        std::vector<Element> elements(size);
+        for (auto& element : elements) {
+            if (!get(element)) {
+                return nullptr;
+            }
+        }
+        return std::make_shared<MalNumericVector>(std::move(elements));
+    }
+
+    bool readSymbol(std::shared_ptr<MalSymbol>& symbol)
+    {
+        uint32_t index = 0;
+        if (!get(index) || index >= m_symbols.size()) {
+            return false;
+        }
+        symbol = m_symbols[index];
+        return true;
+    }
+
+    // Only objects read so far could be referred to
+    bool readObjectIndex(std::shared_ptr<MalType>& object)
+    {
+        uint32_t index = 0;
+        if (!get(index) || index >= m_objects.size()) {
+            return false;
+        }
+        object = m_objects[index];
+        return true;
+    }
+
+private:
+    std::vector<std::shared_ptr<MalSymbol>> m_symbols;
+    std::vector<std::shared_ptr<MalType>> m_objects;
+};
+}
+
+std::shared_ptr<MalType> dump(const Env& env, const std::string& path)
+{
+    Encoder encoder;
+    for (const auto& [name, value] : env.bindings()) {
+        const auto index = encoder.add(value);
+        if (!index) {
+            return MalException::throwException(std::string(name->name()) + ": " + encoder.error());
+        }
+        encoder.addBinding(name, *index);
+    }
+    if (!encoder.addLinks()) {
+        return MalException::throwException(encoder.error());
+    }
+    if (!writeFileAtomically(path, encoder.image())) {
+        return MalException::throwException("Couldn't write image " + path);
+    }
+    return std::make_shared<MalNil>();
+}
+
+std::shared_ptr<MalType> restore(Env& env, const std::string& path)
+{
+    const auto file = MappedFile::open(path);
+    if (!file) {
+        return MalException::throwException("Couldn't open image " + path);
+    }
+
+    Decoder decoder(file->view());
+    Header header {};
+    Env::Bindings bindings;
+    const bool isRead = decoder.get(header) && std::memcmp(header.magic, magic, sizeof(magic)) == 0 && header.version == formatVersion
+        && decoder.readSymbols(header.symbolsCount) && decoder.readObjects(header.objectsCount)
+        && decoder.readBindings(header.bindingsCount, bindings) && decoder.readLinks(header.linksCount) && decoder.isEnd();
+    if (!isRead) {
+        return MalException::throwException("Damaged image " + path);
+    }
+    for (auto& [name, value] : bindings) {
+        env.set(name, std::move(value));
+    }
+    return std::make_shared<MalNil>();
+}
+
+} // namespace mal::heapimage
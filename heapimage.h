@@ -0,0 +1,26 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace mal {
+class Env;
+class MalType;
+
+// Snapshot of the values an environment holds, closures, atoms and metadata included, so a process
+// could start with a loaded prelude instead of evaluating it again. Every object is stored once and
+// shared objects stay shared, cycles through atoms and closure environments are kept. Buildins are
+// stored by name and bound to the buildins of the process that restores the image.
+// Lazy sequences, transducers and buildins made at runtime can't be saved.
+// NOTE: numbers are stored in host byte order, images are not meant to be moved between machines
+namespace heapimage {
+
+// nil, or an exception if some value can't be saved or the file couldn't be written
+std::shared_ptr<MalType> dump(const Env& env, const std::string& path);
+
+// Binds everything the image holds in env, nil or an exception if the image is missing or damaged,
+// env is left untouched then
+std::shared_ptr<MalType> restore(Env& env, const std::string& path);
+
+} // namespace heapimage
+} // namespace mal
@@ -0,0 +1,609 @@
+#include "json.h"
+
+#include "lexer.h"
+#include "maltypes.h"
+#include "printer.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <unordered_map>
+#include <utility>
+
+namespace mal::json {
+
+namespace {
+// byte sets of the classifier, in the order they are passed to it
+enum ByteClass : size_t {
+    WHITESPACE,
+    STRING_SPECIAL,
+    // bytes skipping a nested value stops at, strings are skipped separately
+    STRUCTURAL
+};
+
+class Parser {
+public:
+    Parser(std::string_view text)
+        : m_text(text)
+        , m_classifier(text, { " \t\n\r", "\"\\", "\"[]{}" })
+    {
+    }
+
+    std::shared_ptr<MalType> parseDocument()
+    {
+        auto value = parseValue();
+        if (value->is<MalException>()) {
+            return value;
+        }
+        skipWhitespace();
+        return isEnd() ? value : unexpected();
+    }
+
+    std::shared_ptr<MalType> parseAt(const std::vector<PathStep>& path)
+    {
+        for (const auto& step : path) {
+            if (!enter(step)) {
+                return m_error ? m_error : std::make_shared<MalNil>();
+            }
+        }
+        return parseValue();
+    }
+
+private:
+    std::shared_ptr<MalType> parseValue()
+    {
+        skipWhitespace();
+        if (isEnd()) {
+            return unexpected();
+        }
+        switch (m_text[m_position]) {
+        case '{':
+            return parseObject();
+        case '[':
+            return parseArray();
+        case '"': {
+            std::string_view str;
+            if (!parseString(str)) {
+                return unexpected();
+            }
+            return std::make_shared<MalString>(str);
+        }
+        case 't':
+            return parseLiteral("true", [] { return std::make_shared<MalBoolean>(true); });
+        case 'f':
+            return parseLiteral("false", [] { return std::make_shared<MalBoolean>(false); });
+        case 'n':
+            return parseLiteral("null", [] { return std::make_shared<MalNil>(); });
+        default:
+            return parseNumber();
+        }
+    }
+
+    std::shared_ptr<MalType> parseObject()
+    {
+        auto object = std::make_shared<MalHashMap>();
+        ++m_position;
+        if (skipWhitespace(); match('}')) {
+            return object;
+        }
+        while (true) {
+            auto key = parseKey();
+            if (!key) {
+                return unexpected();
+            }
+            auto value = parseValue();
+            if (value->is<MalException>()) {
+                return value;
+            }
+            object->insert(std::move(key), std::move(value));
+            if (skipWhitespace(); match('}')) {
+                return object;
+            }
+            if (!match(',')) {
+                return unexpected();
+            }
+            skipWhitespace();
+        }
+    }
+
+    std::shared_ptr<MalType> parseArray()
+    {
+        auto array = std::make_shared<MalVector>();
+        ++m_position;
+        if (skipWhitespace(); match(']')) {
+            return array;
+        }
+        while (true) {
+            auto element = parseValue();
+            if (element->is<MalException>()) {
+                return element;
+            }
+            array->append(std::move(element));
+            if (skipWhitespace(); match(']')) {
+                return array;
+            }
+            if (!match(',')) {
+                return unexpected();
+            }
+        }
+    }
+
+    // Key of an object member up to the colon, nullptr on error. Keys repeat from object to object,
+    // keywords of keys without escapes are looked up by their text without going to the global table.
+    std::shared_ptr<MalSymbol> parseKey()
+    {
+        std::string_view key;
+        if (!parseString(key)) {
+            return nullptr;
+        }
+        std::shared_ptr<MalSymbol> keyword;
+        // a key without escapes is a view of the text, the scratch buffer is reused
+        if (key.data() != m_scratch.data()) {
+            auto& cached = m_keywords[key];
+            if (!cached) {
+                cached = MalSymbol::intern(":" + std::string(key), MalSymbol::SymbolType::KEYWORD);
+            }
+            keyword = cached;
+        } else {
+            keyword = MalSymbol::intern(":" + std::string(key), MalSymbol::SymbolType::KEYWORD);
+        }
+        skipWhitespace();
+        return match(':') ? keyword : nullptr;
+    }
+
+    // str views the text when the string has no escapes, the scratch buffer otherwise
+    bool parseString(std::string_view& str)
+    {
+        if (!match('"')) {
+            return false;
+        }
+        const auto start = m_position;
+        if (!findStringSpecial() || isEnd()) {
+            return false;
+        }
+        if (m_text[m_position] == '"') {
+            str = m_text.substr(start, m_position++ - start);
+            return true;
+        }
+
+        m_scratch.assign(m_text.substr(start, m_position - start));
+        while (!isEnd()) {
+            if (m_text[m_position] == '"') {
+                ++m_position;
+                str = m_scratch;
+                return true;
+            }
+            if (m_position + 1 >= m_text.size() || !unescape(m_text[m_position + 1])) {
+                return false;
+            }
+            const auto chunkStart = m_position;
+            if (!findStringSpecial()) {
+                return false;
+            }
+            m_scratch += m_text.substr(chunkStart, m_position - chunkStart);
+        }
+        return false;
+    }
+
+    // Moves to the next quote or backslash of a string. The classifier doesn't look for control characters,
+    // the bytes it skipped are checked for them, false and the position of the first one if there is any
+    bool findStringSpecial()
+    {
+        const auto chunkStart = m_position;
+        m_position = m_classifier.findFirstOf(m_position, STRING_SPECIAL);
+        const auto chunk = m_text.substr(chunkStart, m_position - chunkStart);
+        const auto control = std::find_if(chunk.begin(), chunk.end(), [](char symbol) { return static_cast<unsigned char>(symbol) < 0x20; });
+        if (control != chunk.end()) {
+            m_position = chunkStart + (control - chunk.begin());
+            return false;
+        }
+        return true;
+    }
+
+    // Appends the character escaped by the backslash at the current position and moves past the escape
+    bool unescape(char escaped)
+    {
+        m_position += 2;
+        switch (escaped) {
+        case '"':
+        case '\\':
+        case '/':
+            m_scratch += escaped;
+            return true;
+        case 'b':
+            m_scratch += '\b';
+            return true;
+        case 'f':
+            m_scratch += '\f';
+            return true;
+        case 'n':
+            m_scratch += '\n';
+            return true;
+        case 'r':
+            m_scratch += '\r';
+            return true;
+        case 't':
+            m_scratch += '\t';
+            return true;
+        case 'u':
+            return unescapeCodePoint();
+        default:
+            return false;
+        }
+    }
+
+    // \uXXXX, characters out of the basic plane are written as a surrogate pair of two escapes
+    bool unescapeCodePoint()
+    {
+        uint32_t codePoint = 0;
+        if (!parseHex(codePoint)) {
+            return false;
+        }
+        if (codePoint >= 0xd800 && codePoint < 0xdc00) {
+            uint32_t low = 0;
+            if (m_text.substr(m_position, 2) != "\\u" || (m_position += 2, !parseHex(low)) || low < 0xdc00 || low >= 0xe000) {
+                return false;
+            }
+            codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+        }
+        appendUtf8(codePoint);
+        return true;
+    }
+
+    bool parseHex(uint32_t& value)
+    {
+        const auto digits = m_text.substr(m_position, 4);
+        const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value, 16);
+        if (digits.size() != 4 || error != std::errc() || end != digits.data() + digits.size()) {
+            return false;
+        }
+        m_position += 4;
+        return true;
+    }
+
+    void appendUtf8(uint32_t codePoint)
+    {
+        if (codePoint < 0x80) {
+            m_scratch += static_cast<char>(codePoint);
+        } else if (codePoint < 0x800) {
+            m_scratch += static_cast<char>(0xc0 | (codePoint >> 6));
+            m_scratch += static_cast<char>(0x80 | (codePoint & 0x3f));
+        } else if (codePoint < 0x10000) {
+            m_scratch += static_cast<char>(0xe0 | (codePoint >> 12));
+            m_scratch += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+            m_scratch += static_cast<char>(0x80 | (codePoint & 0x3f));
+        } else {
+            m_scratch += static_cast<char>(0xf0 | (codePoint >> 18));
+            m_scratch += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f));
+            m_scratch += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+            m_scratch += static_cast<char>(0x80 | (codePoint & 0x3f));
+        }
+    }
+
+    template <typename MakeValue>
+    std::shared_ptr<MalType> parseLiteral(std::string_view literal, MakeValue makeValue)
+    {
+        if (m_text.substr(m_position, literal.size()) != literal) {
+            return unexpected();
+        }
+        m_position += literal.size();
+        return makeValue();
+    }
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?, the error points at the first byte that breaks it
+    std::shared_ptr<MalType> parseNumber()
+    {
+        const auto start = m_position;
+        auto skipDigits = [this]() {
+            const auto digitsStart = m_position;
+            while (!isEnd() && m_text[m_position] >= '0' && m_text[m_position] <= '9') {
+                ++m_position;
+            }
+            return m_position != digitsStart;
+        };
+        match('-');
+        // a leading zero is the whole integer part
+        if (!match('0') && !skipDigits()) {
+            return unexpected();
+        }
+        if (match('.') && !skipDigits()) {
+            return unexpected();
+        }
+        if (match('e') || match('E')) {
+            if (!match('+')) {
+                match('-');
+            }
+            if (!skipDigits()) {
+                return unexpected();
+            }
+        }
+        // "01", "1.5.2" and the like
+        if (!isEnd() && std::string_view("+-0123456789.eE").find(m_text[m_position]) != std::string_view::npos) {
+            return unexpected();
+        }
+        auto number = MalNumber::fromString(m_text.substr(start, m_position - start));
+        if (number->is<MalException>()) {
+            m_position = start;
+            return unexpected();
+        }
+        return number;
+    }
+
+    // Moves into the value at step of the current value, false if there is none or the document is broken
+    bool enter(const PathStep& step)
+    {
+        skipWhitespace();
+        if (!match(step.isIndex ? '[' : '{')) {
+            return false;
+        }
+        const char closing = step.isIndex ? ']' : '}';
+        if (skipWhitespace(); match(closing)) {
+            return false;
+        }
+        for (size_t index = 0;; ++index) {
+            bool isFound = step.isIndex && index == step.index;
+            if (!step.isIndex) {
+                std::string_view key;
+                if (!parseString(key) || (skipWhitespace(), !match(':'))) {
+                    return fail();
+                }
+                isFound = key == step.key;
+            }
+            if (isFound) {
+                return true;
+            }
+            if (!skipValue()) {
+                return fail();
+            }
+            if (skipWhitespace(); match(closing)) {
+                return false;
+            }
+            if (!match(',')) {
+                return fail();
+            }
+            skipWhitespace();
+        }
+    }
+
+    // Moves past the current value without building it
+    bool skipValue()
+    {
+        skipWhitespace();
+        if (isEnd()) {
+            return false;
+        }
+        const char first = m_text[m_position];
+        if (first == '"') {
+            std::string_view str;
+            return parseString(str);
+        }
+        if (first != '[' && first != '{') {
+            while (!isEnd() && std::string_view(",]} \t\n\r").find(m_text[m_position]) == std::string_view::npos) {
+                ++m_position;
+            }
+            return true;
+        }
+        size_t depth = 0;
+        while (true) {
+            m_position = m_classifier.findFirstOf(m_position, STRUCTURAL);
+            if (isEnd()) {
+                return false;
+            }
+            switch (m_text[m_position]) {
+            case '"': {
+                std::string_view str;
+                if (!parseString(str)) {
+                    return false;
+                }
+                continue;
+            }
+            case '[':
+            case '{':
+                ++depth;
+                break;
+            default:
+                if (--depth == 0) {
+                    ++m_position;
+                    return true;
+                }
+                break;
+            }
+            ++m_position;
+        }
+    }
+
+    void skipWhitespace()
+    {
+        m_position = m_classifier.findFirstNotOf(m_position, WHITESPACE);
+    }
+
+    bool match(char symbol)
+    {
+        if (!isEnd() && m_text[m_position] == symbol) {
+            ++m_position;
+            return true;
+        }
+        return false;
+    }
+
+    bool isEnd() const
+    {
+        return m_position >= m_text.size();
+    }
+
+    bool fail()
+    {
+        m_error = unexpected();
+        return false;
+    }
+
+    std::shared_ptr<MalType> unexpected() const
+    {
+        if (isEnd()) {
+            return MalException::throwException("json: unexpected end of input");
+        }
+        const auto [line, column] = positionAfter({}, m_text.substr(0, m_position));
+        return MalException::throwException("json: unexpected '" + std::string(1, m_text[m_position]) + "' at line " + std::to_string(line)
+            + ", column " + std::to_string(column));
+    }
+
+private:
+    std::string_view m_text;
+    simd::TextClassifier m_classifier;
+    size_t m_position { 0 };
+    std::string m_scratch;
+    std::unordered_map<std::string_view, std::shared_ptr<MalSymbol>> m_keywords;
+    std::shared_ptr<MalType> m_error;
+};
+
+void writeString(std::string_view str, std::string& out)
+{
+    out += '"';
+    for (const char symbol : str) {
+        switch (symbol) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(symbol) < 0x20) {
+                constexpr char hexDigits[] = "0123456789abcdef";
+                out += "\\u00";
+                out += hexDigits[symbol >> 4];
+                out += hexDigits[symbol & 0xf];
+            } else {
+                out += symbol;
+            }
+        }
+    }
+    out += '"';
+}
+
+// Keywords are written without the colon, so keys read from JSON are written back as they were
+void writeKey(MalType* key, std::string& out)
+{
+    if (auto keyword = key->as<MalSymbol>(); keyword && keyword->getType() == MalSymbol::SymbolType::KEYWORD) {
+        writeString(keyword->name().substr(1), out);
+    } else if (auto str = key->as<MalString>(); str) {
+        writeString(str->value(), out);
+    } else {
+        writeString(key->asString(), out);
+    }
+}
+
+template <typename Elements>
+std::shared_ptr<MalType> writeArray(const Elements& elements, std::string& out)
+{
+    out += '[';
+    bool isFirst = true;
+    for (const auto& element : elements) {
+        if (!std::exchange(isFirst, false)) {
+            out += ',';
+        }
+        if (auto error = write(element.get(), out); error) {
+            return error;
+        }
+    }
+    out += ']';
+    return nullptr;
+}
+}
+
+std::shared_ptr<MalType> read(std::string_view text)
+{
+    return Parser(text).parseDocument();
+}
+
+std::shared_ptr<MalType> read(std::string_view text, const std::vector<PathStep>& path)
+{
+    return Parser(text).parseAt(path);
+}
+
+std::shared_ptr<MalType> write(MalType* value, std::string& out)
+{
+    switch (value->tag()) {
+    case MalTypeTag::NIL:
+        out += "null";
+        return nullptr;
+    case MalTypeTag::BOOLEAN:
+    case MalTypeTag::NUMBER:
+    case MalTypeTag::BIG_INTEGER:
+        Printer(out, false).print(*value);
+        return nullptr;
+    case MalTypeTag::DOUBLE:
+        if (!std::isfinite(value->as<MalDouble>()->getValue())) {
+            return MalException::throwException("json: can't write " + value->asString());
+        }
+        Printer(out, false).print(*value);
+        return nullptr;
+    case MalTypeTag::STRING:
+        writeString(value->as<MalString>()->value(), out);
+        return nullptr;
+    case MalTypeTag::SYMBOL:
+        writeKey(value, out);
+        return nullptr;
+    case MalTypeTag::CONTAINER:
+        return writeArray(*value->as<MalContainer>(), out);
+    case MalTypeTag::NUMERIC_VECTOR: {
+        const auto numericVector = value->as<MalNumericVector>();
+        std::vector<std::shared_ptr<MalType>> elements;
+        elements.reserve(numericVector->size());
+        for (size_t index = 0; index < numericVector->size(); ++index) {
+            elements.push_back(numericVector->at(index));
+        }
+        return writeArray(elements, out);
+    }
+    case MalTypeTag::LAZY_SEQ: {
+        // a sequence is written like a list, chunk by chunk as it is realized
+        out += '[';
+        bool isFirst = true;
+        for (auto node = value->as<MalLazySeq>(); node; node = node->next().get()) {
+            if (auto error = node->realize(); error) {
+                return error;
+            }
+            for (const auto& element : node->chunk()) {
+                if (!std::exchange(isFirst, false)) {
+                    out += ',';
+                }
+                if (auto error = write(element.get(), out); error) {
+                    return error;
+                }
+            }
+        }
+        out += ']';
+        return nullptr;
+    }
+    case MalTypeTag::HASH_MAP: {
+        out += '{';
+        bool isFirst = true;
+        for (const auto& [key, element] : *value->as<MalHashMap>()) {
+            if (!std::exchange(isFirst, false)) {
+                out += ',';
+            }
+            writeKey(key.get(), out);
+            out += ':';
+            if (auto error = write(element.get(), out); error) {
+                return error;
+            }
+        }
+        out += '}';
+        return nullptr;
+    }
+    default:
+        return MalException::throwException("json: can't write " + value->asString());
+    }
+}
+
+} // namespace mal::json
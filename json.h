@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mal {
+class MalType;
+
+// JSON straight to and from mal values: objects are hash maps keyed by keywords, arrays are vectors,
+// integers are fixnums (big integers when they don't fit), other numbers are doubles, null is nil.
+// Strings and nesting are skipped with the SIMD byte classifier, only the bytes of values that are
+// built are looked at one by one, and string bytes are checked for raw control characters.
+// Lazy sequences are written like lists.
+namespace json {
+
+// One step of a path into a document, a key of an object or an index of an array
+struct PathStep {
+    std::string_view key;
+    size_t index { 0 };
+    bool isIndex { false };
+};
+
+// Value of the whole document, or an exception with the position of the first error
+std::shared_ptr<MalType> read(std::string_view text);
+// Value at path, values that are not on the path are skipped without being built. nil if there is
+// no such value. NOTE: skipped values are only checked to be balanced, not to be valid JSON
+std::shared_ptr<MalType> read(std::string_view text, const std::vector<PathStep>& path);
+
+// Appends JSON of value to out, nullptr on success, an exception for values JSON can't hold
+std::shared_ptr<MalType> write(MalType* value, std::string& out);
+
+} // namespace json
+} // namespace mal
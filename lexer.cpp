@@ -1,5 +1,6 @@
 #include "lexer.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <ctype.h>
 #include <iostream>
@@ -25,54 +26,70 @@ std::ostream& operator<<(std::ostream& stream, TokenType type)
     return stream;
 }
 
-Lexer::Lexer(std::string_view program)
+namespace {
+// byte sets of the classifier, in the order they are passed to it
+enum ByteClass : size_t {
+    WHITESPACE,
+    SYMBOL_END,
+    STRING_SPECIAL,
+    NEWLINE
+};
+}
+
+SourcePosition positionAfter(SourcePosition start, std::string_view text)
+{
+    const auto lastNewline = text.rfind('\n');
+    if (lastNewline == std::string_view::npos) {
+        start.column += text.size();
+        return start;
+    }
+    start.line += std::count(text.begin(), text.end(), '\n');
+    start.column = text.size() - lastNewline;
+    return start;
+}
+
+Lexer::Lexer(std::string_view program, SourcePosition start)
     : m_program(program)
+    , m_start(start)
+    , m_classifier(program, { " \t\n\r\v\f,", " )]},\n", "\"\\", "\n" })
 {
 }
 
-std::vector<Token> Lexer::tokenize()
+Token Lexer::next()
 {
-    std::vector<Token> tokens;
     auto makeOneCharToken = [this](TokenType type) {
         return makeToken(type, m_currentIndex - 1, 1);
     };
 
-    while (m_currentIndex != m_program.size()) {
-        const char currentSymbol = advance();
-
-        if (isspace(currentSymbol) || currentSymbol == ',') {
-            continue;
+    while (true) {
+        m_currentIndex = m_classifier.findFirstNotOf(m_currentIndex, WHITESPACE);
+        if (isEnd()) {
+            return makeToken(TokenType::LAST_TOKEN, m_currentIndex, 0);
         }
+        const char currentSymbol = advance();
 
         if (isdigit(currentSymbol)) {
-            tokens.push_back(matchNumber());
-            continue;
+            return matchNumber();
         }
 
         switch (currentSymbol) {
         case '[': {
-            tokens.push_back(makeOneCharToken(TokenType::LEFT_SQUARE_BRACE));
-            break;
+            return makeOneCharToken(TokenType::LEFT_SQUARE_BRACE);
         }
         case ']': {
-            tokens.push_back(makeOneCharToken(TokenType::RIGHT_SQUARE_BACE));
-            break;
+            return makeOneCharToken(TokenType::RIGHT_SQUARE_BACE);
         }
         case '{': {
-            tokens.push_back(makeOneCharToken(TokenType::LEFT_CURLY_BRACE));
-            break;
+            return makeOneCharToken(TokenType::LEFT_CURLY_BRACE);
         }
         case '}': {
-            tokens.push_back(makeOneCharToken(TokenType::RIGHT_CURLY_BRACE));
-            break;
+            return makeOneCharToken(TokenType::RIGHT_CURLY_BRACE);
         }
         case '(': {
-            tokens.push_back(makeOneCharToken(TokenType::LEFT_PAREN));
-            break;
+            return makeOneCharToken(TokenType::LEFT_PAREN);
         }
         case ')': {
-            tokens.push_back(makeOneCharToken(TokenType::RIGHT_PAREN));
-            break;
+            return makeOneCharToken(TokenType::RIGHT_PAREN);
         }
         case '^':
         case '\'': 
@@ -82,69 +99,64 @@ std::vector<Token> Lexer::tokenize()
             // try to match ~@
             if (match('@')) {
                 advance();
-                tokens.push_back(makeToken(TokenType::MACRO, m_currentIndex - 2, 2));
+                return makeToken(TokenType::MACRO, m_currentIndex - 2, 2);
             } else {
-                tokens.push_back(makeOneCharToken(TokenType::MACRO));
+                return makeOneCharToken(TokenType::MACRO);
             }
-            break;
         }
         case '*': {
             if (match('*')) {
                 advance();
-                tokens.push_back(makeToken(TokenType::DOUBLE_STAR, m_currentIndex - 2, 2));
+                return makeToken(TokenType::DOUBLE_STAR, m_currentIndex - 2, 2);
             } else if (isalpha(peek())) {
-                tokens.push_back(matchEverythingElse());
+                return matchEverythingElse();
             } else {
-                tokens.push_back(makeOneCharToken(TokenType::SYMBOL));
+                return makeOneCharToken(TokenType::SYMBOL);
             }
-            break;
         }
         case '-': {
             if (isdigit(peek())) {
-                tokens.push_back(matchNumber());
+                return matchNumber();
             } else {
-                tokens.push_back(makeOneCharToken(TokenType::SYMBOL));
+                return makeOneCharToken(TokenType::SYMBOL);
             }
-            break;
         }
         case '=': {
-            tokens.push_back(makeOneCharToken(TokenType::SYMBOL));
-            break;
+            return makeOneCharToken(TokenType::SYMBOL);
         }
         case '>': {
             if (match('=')) {
                 advance();
-                tokens.push_back(makeToken(TokenType::SYMBOL, m_currentIndex - 2, 2));
+                return makeToken(TokenType::SYMBOL, m_currentIndex - 2, 2);
             } else {
-                tokens.push_back(makeOneCharToken(TokenType::SYMBOL));
+                return makeOneCharToken(TokenType::SYMBOL);
             }
-            break;
         }
         case '<': {
             if (match('=')) {
                 advance();
-                tokens.push_back(makeToken(TokenType::SYMBOL, m_currentIndex - 2, 2));
+                return makeToken(TokenType::SYMBOL, m_currentIndex - 2, 2);
             } else {
-                tokens.push_back(makeOneCharToken(TokenType::SYMBOL));
+                return makeOneCharToken(TokenType::SYMBOL);
             }
-            break;
         }
         case '"': {
-            tokens.push_back(matchString());
-            break;
+            return matchString();
         }
         case ';': {
             skipComment();
             break;
         }
         default: {
-            tokens.push_back(matchEverythingElse(currentSymbol == ':'));
-            break;
+            return matchEverythingElse(currentSymbol == ':');
         }
         }
     }
-    tokens.push_back(makeToken(TokenType::LAST_TOKEN, 0, 0));
-    return tokens;
+}
+
+SourcePosition Lexer::positionOf(const Token& token) const
+{
+    return positionAfter(m_start, m_program.substr(0, token.token.data() - m_program.data()));
 }
 
 char Lexer::advance()
@@ -165,9 +177,10 @@ bool Lexer::match(char symbol) const
     return m_program[m_currentIndex] == symbol;
 }
 
+// The program is a view, what follows it (a mapped page, the rest of a shared buffer) is not ours to read
 char Lexer::peek() const
 {
-    return m_program[m_currentIndex];
+    return isEnd() ? '\0' : m_program[m_currentIndex];
 }
 
 bool Lexer::isEnd() const
@@ -178,15 +191,13 @@ bool Lexer::isEnd() const
 Token Lexer::matchString()
 {
     const auto startPos = m_currentIndex - 1;
-    int num = 0;
-    // TODO: try to come up with other solution, this is not really readable
-    while (!isEnd()) {
-        //  Two backslashes will be transformed to one`//` -> `/`,
-        //  so we don't want to treat transformed backslash as an escape char.
-        num = m_program[m_currentIndex - 1] == '\\' ? num + 1 : 0;
-        if (!(peek() != '"' || ((num % 2 != 0) && m_program[m_currentIndex - 1] == '\\')))
+    while (true) {
+        m_currentIndex = m_classifier.findFirstOf(m_currentIndex, STRING_SPECIAL);
+        if (isEnd() || peek() == '"') {
             break;
-        advance();
+        }
+        // backslash escapes whatever follows, so `\\"` ends the string and `\"` doesn't
+        m_currentIndex = std::min(m_currentIndex + 2, m_program.size());
     }
 
     auto tokenType = TokenType::ERROR_UNTERMINATED_STRING;
@@ -199,17 +210,37 @@ Token Lexer::matchString()
 
 void Lexer::skipComment()
 {
-    while (!isEnd() && peek() != '\n') {
-        advance();
-    }
+    m_currentIndex = m_classifier.findFirstOf(m_currentIndex, NEWLINE);
 }
 
 Token Lexer::matchNumber()
 {
     const auto startPos = m_currentIndex - 1;
+    auto isDigitAt = [this](size_t index) {
+        return index < m_program.size() && isdigit(m_program[index]);
+    };
+    auto skipDigits = [this, &isDigitAt]() {
+        while (isDigitAt(m_currentIndex)) {
+            advance();
+        }
+    };
+
     // TODO: handel errors
-    while (!isEnd() && isdigit(peek())) {
+    skipDigits();
+    // optional fraction and exponent make a floating point literal: 1.5, 2e10, 1.5e-3
+    if (match('.') && isDigitAt(m_currentIndex + 1)) {
         advance();
+        skipDigits();
+    }
+    if (match('e') || match('E')) {
+        const bool hasSign = m_currentIndex + 1 < m_program.size() && (m_program[m_currentIndex + 1] == '-' || m_program[m_currentIndex + 1] == '+');
+        if (isDigitAt(m_currentIndex + (hasSign ? 2 : 1))) {
+            advance();
+            if (hasSign) {
+                advance();
+            }
+            skipDigits();
+        }
     }
     return makeToken(TokenType::NUMBER, startPos, m_currentIndex - startPos);
 }
@@ -218,11 +249,7 @@ Token Lexer::matchEverythingElse(bool isKeyword)
 {
     using namespace std::literals;
     const auto startPos = m_currentIndex - 1;
-    auto isSeparator = [](char c) { return " )]},\n"sv.find(c) != std::string_view::npos; };
-
-    while (!isEnd() && !isSeparator(peek())) {
-        advance();
-    }
+    m_currentIndex = m_classifier.findFirstOf(m_currentIndex, SYMBOL_END);
 
     TokenType symbolType = isKeyword ? TokenType::KEYWORD : TokenType::SYMBOL;
     
@@ -1,9 +1,10 @@
 #pragma once
 
 #include <string_view>
-#include <vector>
 #include <ostream>
 
+#include "simd.h"
+
 namespace mal {
 
 // TODO: delete unused tokens
@@ -38,10 +39,23 @@ struct Token {
     std::string_view token;
 };
 
+struct SourcePosition {
+    size_t line { 1 };
+    size_t column { 1 };
+};
+
+// Position of the end of text that starts at start
+SourcePosition positionAfter(SourcePosition start, std::string_view text);
+
+// Splits program into tokens on demand, tokens are views of the program
 class Lexer {
 public:
-    Lexer(std::string_view program);
-    std::vector<Token> tokenize();
+    Lexer(std::string_view program, SourcePosition start = {});
+
+    // LAST_TOKEN, placed at the end of the program, once the program is over
+    Token next();
+    // NOTE: counts lines from the beginning, it is meant for error messages
+    SourcePosition positionOf(const Token& token) const;
 
 private:
     char advance();
@@ -59,6 +73,8 @@ private:
 private:
     size_t m_currentIndex { 0 };
     std::string_view m_program;
+    SourcePosition m_start;
+    simd::TextClassifier m_classifier;
 };
 
 }
\ No newline at end of file
@@ -2,9 +2,16 @@
 
 #include "eval_ast.h"
 #include "lexer.h"
+#include "ports.h"
+#include "printer.h"
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <cmath>
 #include <iostream>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
 
 namespace mal {
@@ -14,32 +21,72 @@ std::shared_ptr<MalType> MalType::clone() const
     return std::make_shared<MalNil>();
 }
 
+size_t MalType::hash() const
+{
+    return std::hash<const MalType*> {}(this);
+}
+
+static size_t combineHashes(size_t seed, size_t hash)
+{
+    return seed ^ (hash + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
+using MetaInfoTable = std::unordered_map<const MalType*, std::shared_ptr<MalType>>;
+
+static MetaInfoTable& metaInfoTable()
+{
+    // NOTE: intentionally leaked, values with metadata could outlive static destructors
+    static auto* table = new MetaInfoTable;
+    return *table;
+}
+
+std::string MalType::asString() const
+{
+    std::string out;
+    Printer(out, true).print(*this);
+    return out;
+}
+
+MalType::MalType(MalTypeTag tag)
+    : m_tag(tag)
+{
+}
+
+MalType::~MalType()
+{
+    if (m_hasMetaInfo) {
+        metaInfoTable().erase(this);
+    }
+}
+
 void MalType::setMetaInfo(std::shared_ptr<MalType> metaInfo)
 {
-    if (this->asMalBuildin() || this->asMalClosure() || this->asMalContainer() || this->asMalHashMap()) {
-        m_metaInfo = metaInfo;
+    if (is<MalCallable>() || is<MalContainer>() || is<MalHashMap>()) {
+        metaInfoTable()[this] = metaInfo;
+        m_hasMetaInfo = true;
     }
 }
 
 std::shared_ptr<MalType> MalType::getMetaInfo() const
 {
-    return m_metaInfo ? m_metaInfo : std::make_shared<MalNil>();
+    if (m_hasMetaInfo) {
+        if (auto metaInfo = metaInfoTable().find(this); metaInfo != metaInfoTable().end()) {
+            return metaInfo->second;
+        }
+    }
+    return std::make_shared<MalNil>();
 }
 
 MalAtom::MalAtom(std::shared_ptr<MalType> malType, const std::string& atomDesripton)
-    : m_underlyingType(malType)
+    : MalType(MalTypeTag::ATOM)
+    , m_underlyingType(malType)
     , m_atomDescripton(atomDesripton)
 {
 }
 
-std::string MalAtom::asString() const
-{
-    return m_atomDescripton;
-}
-
-MalAtom* MalAtom::asMalAtom()
+void MalAtom::print(Printer& printer) const
 {
-    return this;
+    printer.write(m_atomDescripton);
 }
 
 std::shared_ptr<MalType> MalAtom::reset(std::shared_ptr<MalType> newType)
@@ -53,86 +100,343 @@ std::shared_ptr<MalType> MalAtom::deref() const
     return m_underlyingType;
 }
 
-MalNumber::MalNumber(std::string_view number)
-    : m_number(std::atoi(number.data()))
+const std::string& MalAtom::description() const
+{
+    return m_atomDescripton;
+}
+
+MalNumber::MalNumber(int64_t number)
+    : MalType(MalTypeTag::NUMBER)
+    , m_number(number)
+{
+}
+
+void MalNumber::print(Printer& printer) const
 {
+    char buffer[24];
+    const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), m_number);
+    printer.write(std::string_view(buffer, end - buffer));
 }
 
-MalNumber::MalNumber(int number)
-    : m_number(number)
+int64_t MalNumber::getValue() const
 {
+    return m_number;
 }
 
-MalNumber* MalNumber::asMalNumber()
+size_t MalNumber::hash() const
 {
-    return this;
+    return std::hash<int64_t> {}(m_number);
 }
 
-std::string MalNumber::asString() const
+std::shared_ptr<MalType> MalNumber::fromString(std::string_view number)
 {
-    return std::to_string(m_number);
+    const auto numberEnd = number.data() + number.size();
+    if (number.find_first_of(".eE") != std::string_view::npos) {
+        double value = 0;
+        if (auto [end, error] = std::from_chars(number.data(), numberEnd, value); error == std::errc() && end == numberEnd) {
+            return std::make_shared<MalDouble>(value);
+        }
+        return MalException::throwException("Invalid number literal " + std::string(number));
+    }
+
+    // from_chars doesn't accept leading plus sign
+    const auto digits = number.starts_with('+') ? number.substr(1) : number;
+    int64_t value = 0;
+    if (auto [end, error] = std::from_chars(digits.data(), numberEnd, value); error == std::errc() && end == numberEnd) {
+        return std::make_shared<MalNumber>(value);
+    }
+    if (auto bigNumber = BigInteger::fromString(number); bigNumber.has_value()) {
+        return MalBigInteger::normalized(std::move(bigNumber.value()));
+    }
+    return MalException::throwException("Invalid number literal " + std::string(number));
 }
 
-int MalNumber::getValue() const
+MalBigInteger::MalBigInteger(BigInteger number)
+    : MalType(MalTypeTag::BIG_INTEGER)
+    , m_number(std::move(number))
+{
+}
+
+void MalBigInteger::print(Printer& printer) const
+{
+    printer.write(m_number.toString());
+}
+
+const BigInteger& MalBigInteger::getValue() const
 {
     return m_number;
 }
 
-MalContainer::MalContainer(ContainerType type)
-    : m_type(type)
+size_t MalBigInteger::hash() const
 {
+    return m_number.hash();
 }
 
-MalContainer::MalContainer(const std::vector<std::shared_ptr<MalType>>& data, MalContainer::ContainerType type)
-    : m_data(data)
-    , m_type(type)
+std::shared_ptr<MalType> MalBigInteger::normalized(BigInteger number)
+{
+    if (number.fitsInt64()) {
+        return std::make_shared<MalNumber>(number.toInt64());
+    }
+    return std::make_shared<MalBigInteger>(std::move(number));
+}
+
+MalDouble::MalDouble(double number)
+    : MalType(MalTypeTag::DOUBLE)
+    , m_number(number)
+{
+}
+
+void MalDouble::print(Printer& printer) const
 {
+    char buffer[32];
+    const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), m_number);
+    const std::string_view number(buffer, end - buffer);
+    printer.write(number);
+    // keep integral doubles distinguishable from fixnums when printed
+    if (std::isfinite(m_number) && number.find_first_of(".e") == std::string_view::npos) {
+        printer.write(".0");
+    }
 }
 
-MalContainer* MalContainer::asMalContainer()
+double MalDouble::getValue() const
 {
-    return this;
+    return m_number;
 }
 
-std::string MalContainer::asString() const
+size_t MalDouble::hash() const
 {
-    std::stringstream ss;
-    ss << (m_type == ContainerType::LIST ? '(' : '[');
-    for (const auto& obj : m_data) {
-        ss << obj->asString() << (&obj != &m_data.back() ? " " : "");
+    return std::hash<double> {}(m_number);
+}
+
+MalContainer::MalContainer(ContainerType type)
+    : MalType(MalTypeTag::CONTAINER)
+    , m_type(type)
+    , m_storage(Storage::INLINE)
+{
+}
+
+MalContainer::MalContainer(const ListData& data, MalContainer::ContainerType type)
+    : MalContainer(type)
+{
+    if (type == ContainerType::LIST && data.size() > inlineCapacity) {
+        m_storage = Storage::SLOTS;
+        m_listBuffer = std::make_shared<ListBuffer>(ListBuffer { data });
+        m_size = data.size();
+        return;
+    }
+    for (const auto& element : data) {
+        append(element);
     }
-    ss << (m_type == ContainerType::LIST ? ')' : ']');
-    return ss.str();
+}
+
+MalContainer::MalContainer(VectorData data)
+    : MalContainer(ContainerType::VECTOR)
+{
+    m_storage = Storage::TRIE;
+    m_size = data.size();
+    m_vectorData = std::move(data);
+}
+
+void MalContainer::print(Printer& printer) const
+{
+    const bool isList = m_type == ContainerType::LIST;
+    printer.printCollection(isList ? '(' : '[', isList ? ')' : ']', [&](auto element) {
+        for (const auto& obj : *this) {
+            if (!element([&] { printer.print(*obj); })) {
+                return;
+            }
+        }
+    });
+}
+
+std::shared_ptr<MalContainer> MalContainer::shareStorage(ContainerType type) const
+{
+    auto container = std::make_shared<MalContainer>(type);
+    container->m_storage = m_storage;
+    container->m_inlineSlots = m_inlineSlots;
+    container->m_listBuffer = m_listBuffer;
+    container->m_vectorData = m_vectorData;
+    container->m_offset = m_offset;
+    container->m_size = m_size;
+    return container;
 }
 
 std::shared_ptr<MalType> MalContainer::clone() const
 {
-    return std::make_shared<MalContainer>(m_data, m_type);
+    auto container = shareStorage(m_type);
+    container->m_hash = m_hash;
+    return container;
+}
+
+void MalContainer::spill()
+{
+    if (m_type == ContainerType::LIST) {
+        m_storage = Storage::SLOTS;
+        m_listBuffer = std::make_shared<ListBuffer>();
+        m_listBuffer->slots.reserve(inlineCapacity * 2);
+        std::move(m_inlineSlots.begin(), m_inlineSlots.begin() + m_size, std::back_inserter(m_listBuffer->slots));
+    } else {
+        m_storage = Storage::TRIE;
+        for (size_t elementIndex = 0; elementIndex < m_size; ++elementIndex) {
+            m_vectorData = m_vectorData.pushBack(std::move(m_inlineSlots[elementIndex]));
+        }
+    }
 }
 
 void MalContainer::append(std::shared_ptr<MalType> element)
 {
-    m_data.push_back(element);
+    m_hash.reset();
+    if (m_storage == Storage::INLINE) {
+        if (m_size < inlineCapacity) {
+            m_inlineSlots[m_size++] = std::move(element);
+            return;
+        }
+        spill();
+    }
+    if (m_storage == Storage::TRIE) {
+        // elements past the end of the view belong to someone else
+        if (m_offset + m_size != m_vectorData.size()) {
+            VectorData data;
+            for (const auto& existing : *this) {
+                data = data.pushBack(existing);
+            }
+            m_vectorData = std::move(data);
+            m_offset = 0;
+        }
+        m_vectorData = m_vectorData.pushBack(std::move(element));
+        ++m_size;
+        return;
+    }
+
+    // NOTE: only list ending where the buffer does may push into it, and shared buffer is never
+    // reallocated, so elements other lists hand out by reference stay valid
+    const bool canAppendInPlace = m_listBuffer
+        && m_offset + m_size == m_listBuffer->slots.size()
+        && (m_listBuffer.use_count() == 1 || m_listBuffer->slots.size() < m_listBuffer->slots.capacity());
+    if (!canAppendInPlace) {
+        auto newBuffer = std::make_shared<ListBuffer>();
+        newBuffer->slots.reserve(std::max<size_t>(m_size * 2, 4));
+        newBuffer->slots.assign(begin(), end());
+        m_listBuffer = std::move(newBuffer);
+        m_offset = 0;
+    }
+    m_listBuffer->slots.push_back(std::move(element));
+    ++m_size;
+}
+
+std::shared_ptr<MalContainer> MalContainer::cons(std::shared_ptr<MalType> element) const
+{
+    auto list = std::make_shared<MalContainer>(ContainerType::LIST);
+    if (m_size < inlineCapacity) {
+        list->append(std::move(element));
+        for (const auto& existing : *this) {
+            list->append(existing);
+        }
+        return list;
+    }
+    list->m_storage = Storage::SLOTS;
+    if (m_storage == Storage::SLOTS && m_listBuffer && m_offset == m_listBuffer->front && m_offset != 0) {
+        // this list starts where the buffer does, no other list sees the slot in front of it
+        list->m_listBuffer = m_listBuffer;
+        list->m_offset = m_offset - 1;
+    } else {
+        // copy into new buffer with as much free room in front as there are elements
+        const auto room = std::max<size_t>(m_size, 4);
+        list->m_listBuffer = std::make_shared<ListBuffer>();
+        list->m_listBuffer->slots.reserve(room + m_size);
+        list->m_listBuffer->slots.resize(room);
+        list->m_listBuffer->slots.insert(list->m_listBuffer->slots.end(), begin(), end());
+        list->m_offset = room - 1;
+    }
+    list->m_listBuffer->slots[list->m_offset] = std::move(element);
+    list->m_listBuffer->front = list->m_offset;
+    list->m_size = m_size + 1;
+    return list;
+}
+
+std::shared_ptr<MalContainer> MalContainer::slice(size_t offset, size_t length) const
+{
+    if (m_storage == Storage::INLINE) {
+        auto container = std::make_shared<MalContainer>(m_type);
+        auto element = begin();
+        std::advance(element, offset);
+        for (size_t elementIndex = 0; elementIndex < length; ++elementIndex, ++element) {
+            container->append(*element);
+        }
+        return container;
+    }
+    auto container = shareStorage(m_type);
+    container->m_offset += offset;
+    container->m_size = length;
+    return container;
 }
 
-std::vector<std::shared_ptr<MalType>>::iterator MalContainer::begin()
+std::shared_ptr<MalContainer> MalContainer::rest() const
 {
-    return m_data.begin();
+    auto list = isEmpty() ? slice(0, 0) : slice(1, m_size - 1);
+    list->m_type = ContainerType::LIST;
+    return list;
 }
 
-std::vector<std::shared_ptr<MalType>>::iterator MalContainer::end()
+const std::shared_ptr<MalType>* MalContainer::listSlots() const
 {
-    return m_data.end();
+    return m_storage == Storage::INLINE ? m_inlineSlots.data() : m_listBuffer->slots.data() + m_offset;
+}
+
+MalContainer::const_iterator MalContainer::begin() const
+{
+    if (m_storage == Storage::TRIE) {
+        return m_vectorData.iteratorAt(m_offset);
+    }
+    return listSlots();
+}
+
+MalContainer::const_iterator MalContainer::end() const
+{
+    if (m_storage == Storage::TRIE) {
+        return m_vectorData.iteratorAt(m_offset + m_size);
+    }
+    return listSlots() + m_size;
+}
+
+// NOTE: size goes in last, a lazy sequence knows it only once all elements are hashed
+template <typename Iterator>
+size_t MalContainer::hashElements(size_t size, Iterator begin, Iterator end)
+{
+    size_t result = 0;
+    for (auto element = begin; element != end; ++element) {
+        result = combineHashes(result, (*element)->hash());
+    }
+    return combineHashes(result, size);
+}
+
+size_t MalContainer::hash() const
+{
+    if (!m_hash) {
+        m_hash = hashElements(m_size, begin(), end());
+    }
+    return *m_hash;
+}
+
+bool MalContainer::sharesElementsWith(const MalContainer& other) const
+{
+    if (this == &other) {
+        return true;
+    }
+    if (m_storage == Storage::INLINE || m_storage != other.m_storage || m_offset != other.m_offset || m_size != other.m_size) {
+        return false;
+    }
+    return m_storage == Storage::TRIE ? m_vectorData.sharesStructureWith(other.m_vectorData) : m_listBuffer == other.m_listBuffer;
 }
 
 bool MalContainer::isEmpty() const
 {
-    return m_data.empty();
+    return m_size == 0;
 }
 
 size_t MalContainer::size() const
 {
-    return m_data.size();
+    return m_size;
 }
 
 MalContainer::ContainerType MalContainer::type() const
@@ -140,43 +444,77 @@ MalContainer::ContainerType MalContainer::type() const
     return m_type;
 }
 
+void MalContainer::toList()
+{
+    m_type = ContainerType::LIST;
+}
+
 std::shared_ptr<MalType> MalContainer::at(size_t index) const
 {
-    return m_data[index];
+    return m_storage == Storage::TRIE ? m_vectorData[m_offset + index] : listSlots()[index];
 }
 
 std::shared_ptr<MalType> MalContainer::back() const
 {
-    return m_data.back();
+    return at(m_size - 1);
 }
 
-std::shared_ptr<MalType> MalContainer::head() const
+std::shared_ptr<MalContainer> MalContainer::assoc(size_t index, std::shared_ptr<MalType> element) const
 {
-    if (m_data.size() == 0) {
-        // TODO: maybe thorw error here
-        return std::make_shared<MalContainer>(m_type);
+    auto vector = shareStorage(m_type);
+    if (index == m_size) {
+        vector->append(std::move(element));
+    } else {
+        vector->set(index, std::move(element));
     }
-    return m_data.at(0);
+    return vector;
 }
 
-std::shared_ptr<MalContainer> MalContainer::tail(MalContainer* container)
+void MalContainer::set(size_t index, std::shared_ptr<MalType> element)
 {
-    auto newContainer = std::make_shared<MalContainer>(container->type());
-    for (size_t elementIndex = 1; elementIndex < container->size(); ++elementIndex) {
-        newContainer->append(container->at(elementIndex));
+    m_hash.reset();
+    if (m_storage == Storage::INLINE) {
+        m_inlineSlots[index] = std::move(element);
+        return;
+    } else if (m_storage == Storage::TRIE) {
+        m_vectorData = m_vectorData.assoc(m_offset + index, std::move(element));
+        return;
     }
-    return newContainer;
+    if (m_listBuffer.use_count() != 1) {
+        auto newBuffer = std::make_shared<ListBuffer>();
+        newBuffer->slots.assign(begin(), end());
+        m_listBuffer = std::move(newBuffer);
+        m_offset = 0;
+    }
+    m_listBuffer->slots[m_offset + index] = std::move(element);
 }
 
-std::shared_ptr<MalContainer> MalContainer::tail()
+void MalContainer::markAsOwnedArguments()
 {
-    if (m_data.begin() != m_data.end()) {
-        const std::vector<std::shared_ptr<MalType>> newData(m_data.begin() + 1, m_data.end());
-        m_data = newData;
-    } else {
-        m_data.clear();
+    m_isOwnedArguments = true;
+}
+
+std::shared_ptr<MalType> MalContainer::takeAt(size_t index)
+{
+    if (!m_isOwnedArguments || m_storage == Storage::TRIE || (m_storage == Storage::SLOTS && m_listBuffer.use_count() != 1)) {
+        return at(index);
+    }
+    auto& slot = m_storage == Storage::INLINE ? m_inlineSlots[index] : m_listBuffer->slots[m_offset + index];
+    return std::exchange(slot, std::make_shared<MalNil>());
+}
+
+std::shared_ptr<MalType> MalContainer::head() const
+{
+    if (isEmpty()) {
+        // TODO: maybe thorw error here
+        return std::make_shared<MalContainer>(m_type);
     }
-    return std::make_shared<MalContainer>(m_data, m_type);
+    return at(0);
+}
+
+std::shared_ptr<MalContainer> MalContainer::tail() const
+{
+    return isEmpty() ? slice(0, 0) : slice(1, m_size - 1);
 }
 
 MalList::MalList()
@@ -189,20 +527,145 @@ MalVector::MalVector()
 {
 }
 
+MalNumericVector::MalNumericVector(Integers elements)
+    : MalType(MalTypeTag::NUMERIC_VECTOR)
+    , m_elements(std::move(elements))
+{
+}
+
+MalNumericVector::MalNumericVector(Doubles elements)
+    : MalType(MalTypeTag::NUMERIC_VECTOR)
+    , m_elements(std::move(elements))
+{
+}
+
+void MalNumericVector::print(Printer& printer) const
+{
+    printer.printCollection('[', ']', [&](auto element) {
+        for (size_t elementIndex = 0; elementIndex < size(); ++elementIndex) {
+            if (!element([&] { printer.print(*at(elementIndex)); })) {
+                return;
+            }
+        }
+    });
+}
+
+bool MalNumericVector::operator==(MalType* type) const
+{
+    if (auto other = type->as<MalNumericVector>(); other) {
+        return m_elements == other->m_elements;
+    } else if (type->is<MalLazySeq>()) {
+        return type->operator==(const_cast<MalNumericVector*>(this));
+    }
+    // elements are boxed one at a time, the same way a vector of numbers compares them
+    auto container = type->as<MalContainer>();
+    if (!container || container->size() != size()) {
+        return false;
+    }
+    size_t elementIndex = 0;
+    for (const auto& element : *container) {
+        if (!at(elementIndex++)->operator==(element.get())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t MalNumericVector::hash() const
+{
+    return std::visit([](const auto& elements) {
+        size_t result = 0;
+        for (const auto& element : elements) {
+            result = combineHashes(result, std::hash<std::decay_t<decltype(element)>> {}(element));
+        }
+        return combineHashes(result, elements.size());
+    }, m_elements);
+}
+
+bool MalNumericVector::isDouble() const
+{
+    return std::holds_alternative<Doubles>(m_elements);
+}
+
+size_t MalNumericVector::size() const
+{
+    return std::visit([](const auto& elements) { return elements.size(); }, m_elements);
+}
+
+std::shared_ptr<MalType> MalNumericVector::at(size_t index) const
+{
+    if (isDouble()) {
+        return std::make_shared<MalDouble>(doubles()[index]);
+    }
+    return std::make_shared<MalNumber>(integers()[index]);
+}
+
+const MalNumericVector::Integers& MalNumericVector::integers() const
+{
+    return std::get<Integers>(m_elements);
+}
+
+const MalNumericVector::Doubles& MalNumericVector::doubles() const
+{
+    return std::get<Doubles>(m_elements);
+}
+
 MalSymbol::MalSymbol(std::string_view symbol, SymbolType type)
-    : m_symbol(symbol.data(), symbol.size())
+    : MalType(MalTypeTag::SYMBOL)
+    , m_symbol(symbol.data(), symbol.size())
+    , m_hash(std::hash<std::string_view>()(symbol))
     , m_symbolType(type)
 {
 }
 
-std::string MalSymbol::asString() const
+namespace {
+class SymbolTable {
+public:
+    std::shared_ptr<MalSymbol> find(std::string_view symbol) const
+    {
+        std::shared_lock lock(m_mutex);
+        if (auto interned = m_symbols.find(symbol); interned != m_symbols.end()) {
+            return interned->second;
+        }
+        return nullptr;
+    }
+
+    template <typename MakeSymbol>
+    std::shared_ptr<MalSymbol> insert(std::string_view symbol, MakeSymbol makeSymbol)
+    {
+        std::unique_lock lock(m_mutex);
+        // other thread could intern the same name while we were waiting for the lock
+        auto& interned = m_symbols[symbol];
+        if (!interned) {
+            interned = makeSymbol();
+        }
+        return interned;
+    }
+
+private:
+    mutable std::shared_mutex m_mutex;
+    // NOTE: keys are views into names owned by interned symbols, symbols are never released
+    std::unordered_map<std::string_view, std::shared_ptr<MalSymbol>> m_symbols;
+};
+} // namespace
+
+std::shared_ptr<MalSymbol> MalSymbol::intern(std::string_view symbol, SymbolType type)
 {
-    return m_symbol;
+    // NOTE: intentionally leaked, symbols are referenced from static objects
+    static auto* symbols = new SymbolTable;
+    static auto* keywords = new SymbolTable;
+
+    auto& table = type == SymbolType::KEYWORD ? *keywords : *symbols;
+    if (auto interned = table.find(symbol); interned) {
+        return interned;
+    }
+    auto newSymbol = std::shared_ptr<MalSymbol>(new MalSymbol(symbol, type));
+    return table.insert(newSymbol->name(), [&newSymbol]() { return newSymbol; });
 }
 
-MalSymbol* MalSymbol::asMalSymbol()
+void MalSymbol::print(Printer& printer) const
 {
-    return this;
+    printer.write(m_symbol);
 }
 
 MalSymbol::SymbolType MalSymbol::getType() const
@@ -210,49 +673,62 @@ MalSymbol::SymbolType MalSymbol::getType() const
     return m_symbolType;
 }
 
-MalString::MalString(std::string_view str)
-    : m_malString(str)
+std::string_view MalSymbol::name() const
 {
+    return m_symbol;
 }
 
-std::string MalString::asString() const
+size_t MalSymbol::hash() const
 {
-    return m_malString;
+    return m_hash;
 }
 
-MalString* MalString::asMalString()
+MalString::MalString(std::string_view str)
+    : MalType(MalTypeTag::STRING)
+    , m_buffer(std::make_shared<std::string>(str))
+    , m_size(str.size())
 {
-    return this;
 }
 
-std::string MalString::escapeString(const std::string& str)
+MalString::MalString(std::shared_ptr<std::string> buffer, size_t size)
+    : MalType(MalTypeTag::STRING)
+    , m_buffer(std::move(buffer))
+    , m_size(size)
 {
-    std::stringstream ss;
-    for (size_t i = 0; i < str.size(); ++i) {
-        const char currentChar = str[i];
-        if (currentChar == '\\') {
-            ss << "\\";
-        } else if (currentChar == '"') {
-            ss << "\\";
-        } else if (currentChar == '\n') {
-            ss << '\\' << 'n';
-            continue;
-        }
-        ss << currentChar;
+}
+
+void MalString::print(Printer& printer) const
+{
+    if (!printer.isReadable()) {
+        printer.write(value());
+        return;
     }
-    return ss.str();
+    printer.write('"');
+    printer.writeEscaped(value());
+    printer.write('"');
 }
 
-std::string MalString::unEscapeString(const std::string& str)
+std::string_view MalString::value() const
 {
-    std::stringstream ss;
+    return std::string_view(m_buffer->data(), m_size);
+}
+
+std::shared_ptr<std::string> MalString::appendableBuffer() const
+{
+    return m_buffer->size() == m_size ? m_buffer : nullptr;
+}
+
+std::string MalString::unEscapeString(std::string_view str)
+{
+    std::string unescaped;
+    unescaped.reserve(str.size());
     // translate:
     //      '\n' -> newline
     //      '\"' -> '"\'
     //      '\\' -> '\'
     for (size_t i = 0; i < str.size();) {
         if (i + 1 >= str.size()) {
-            ss << str.back();
+            unescaped += str.back();
             break;
         }
         const char currentChar = str[i];
@@ -261,13 +737,13 @@ std::string MalString::unEscapeString(const std::string& str)
             bool escaped = true;
             switch (nextChar) {
             case 'n':
-                ss << "\n";
+                unescaped += '\n';
                 break;
             case '\\':
-                ss << "\\";
+                unescaped += '\\';
                 break;
             case '"':
-                ss << "\"";
+                unescaped += '"';
                 break;
             default:
                 escaped = false;
@@ -278,45 +754,52 @@ std::string MalString::unEscapeString(const std::string& str)
                 continue;
             }
         }
-        ss << currentChar;
+        unescaped += currentChar;
         ++i;
     }
-    return ss.str();
+    return unescaped;
 }
 
 bool MalString::isEmpty() const
 {
-    return m_malString.empty();
+    return m_size == 0;
 }
 
-std::string MalNil::asString() const
+size_t MalString::hash() const
 {
-    return "nil";
+    return std::hash<std::string_view> {}(value());
 }
 
-MalNil* MalNil::asMalNil()
+MalNil::MalNil()
+    : MalType(MalTypeTag::NIL)
 {
-    return this;
 }
 
-MalBoolean::MalBoolean(bool value)
-    : m_boolValue(value)
+void MalNil::print(Printer& printer) const
 {
+    printer.write("nil");
 }
 
-MalBoolean::MalBoolean(std::string_view value)
-    : m_boolValue(value == "true")
+size_t MalNil::hash() const
+{
+    return 0;
+}
+
+MalBoolean::MalBoolean(bool value)
+    : MalType(MalTypeTag::BOOLEAN)
+    , m_boolValue(value)
 {
 }
 
-std::string MalBoolean::asString() const
+MalBoolean::MalBoolean(std::string_view value)
+    : MalType(MalTypeTag::BOOLEAN)
+    , m_boolValue(value == "true")
 {
-    return m_boolValue ? "true" : "false";
 }
 
-MalBoolean* MalBoolean::asMalBoolean()
+void MalBoolean::print(Printer& printer) const
 {
-    return this;
+    printer.write(m_boolValue ? "true" : "false");
 }
 
 bool MalBoolean::getValue() const
@@ -324,38 +807,63 @@ bool MalBoolean::getValue() const
     return m_boolValue;
 }
 
-std::string MalHashMap::asString() const
+size_t MalBoolean::hash() const
 {
-    std::stringstream ss;
-    ss << "{";
-    for (auto it = m_hashMap.begin(); it != m_hashMap.end(); ++it) {
-        const auto& [key, value] = *it;
-        ss << key << " " << value->asString() << (std::distance(it, m_hashMap.end()) > 1 ? " " : "");
-    }
-    ss << "}";
-    return ss.str();
+    return m_boolValue ? 1231 : 1237;
 }
 
-MalHashMap* MalHashMap::asMalHashMap()
+MalHashMap::MalHashMap()
+    : MalType(MalTypeTag::HASH_MAP)
 {
-    return this;
+}
+
+void MalHashMap::print(Printer& printer) const
+{
+    printer.printCollection('{', '}', [&](auto element) {
+        for (const auto& [key, value] : m_hashMap) {
+            const auto printEntry = [&] {
+                printer.print(*key);
+                printer.write(' ');
+                printer.print(*value);
+            };
+            if (!element(printEntry)) {
+                return;
+            }
+        }
+    });
 }
 
 std::shared_ptr<MalType> MalHashMap::clone() const
 {
     auto newHashMap = std::make_shared<MalHashMap>();
     newHashMap->m_hashMap = m_hashMap;
+    newHashMap->m_hash = m_hash;
     return newHashMap;
 }
 
-void MalHashMap::insert(const std::string& key, std::shared_ptr<MalType> value)
+size_t MalHashMap::hash() const
 {
-    m_hashMap[key] = value;
+    if (!m_hash) {
+        // NOTE: entries are mixed in order independent way, equal maps could be shaped differently after full collisions
+        size_t result = m_hashMap.size();
+        for (const auto& [key, value] : m_hashMap) {
+            result += combineHashes(key->hash(), value->hash());
+        }
+        m_hash = result;
+    }
+    return *m_hash;
 }
 
-void MalHashMap::remove(const std::string& key)
+void MalHashMap::insert(std::shared_ptr<MalType> key, std::shared_ptr<MalType> value)
 {
-    m_hashMap.erase(key);
+    m_hash.reset();
+    m_hashMap.insertInPlace(std::move(key), std::move(value));
+}
+
+void MalHashMap::remove(const std::shared_ptr<MalType>& key)
+{
+    m_hash.reset();
+    m_hashMap = m_hashMap.erase(key);
 }
 
 size_t MalHashMap::size() const
@@ -363,27 +871,27 @@ size_t MalHashMap::size() const
     return m_hashMap.size();
 }
 
-MalHashMap::HashMapIteraotr MalHashMap::begin()
+MalHashMap::HashMapIteraotr MalHashMap::begin() const
 {
     return m_hashMap.begin();
 }
 
-MalHashMap::HashMapIteraotr MalHashMap::end()
+MalHashMap::HashMapIteraotr MalHashMap::end() const
 {
     return m_hashMap.end();
 }
 
-MalHashMap::HashMapIteraotr MalHashMap::find(const std::string& key)
+std::shared_ptr<MalType> MalHashMap::find(const std::shared_ptr<MalType>& key) const
 {
-    return m_hashMap.find(key);
+    const auto value = m_hashMap.find(key);
+    return value ? *value : nullptr;
 }
 
 std::shared_ptr<MalList> MalHashMap::keys() const
 {
     auto listOfKeys = std::make_shared<MalList>();
-    for (auto it = m_hashMap.begin(); it != m_hashMap.end(); ++it) {
-        const auto& [key, value] = *it;
-        listOfKeys->append(std::make_shared<MalSymbol>(key, key.starts_with(':') ? MalSymbol::SymbolType::KEYWORD : MalSymbol::SymbolType::REGULAR_SYMBOL));
+    for (const auto& [key, value] : m_hashMap) {
+        listOfKeys->append(key);
     }
     return listOfKeys;
 }
@@ -391,26 +899,259 @@ std::shared_ptr<MalList> MalHashMap::keys() const
 std::shared_ptr<MalList> MalHashMap::vals() const
 {
     auto listOfValues = std::make_shared<MalList>();
-    for (auto it = m_hashMap.begin(); it != m_hashMap.end(); ++it) {
-        const auto& [key, value] = *it;
+    for (const auto& [key, value] : m_hashMap) {
         listOfValues->append(value);
     }
     return listOfValues;
 }
 
-MalException::MalException(const std::string& message)
-    : m_message(message)
+MalLazySeq::MalLazySeq(Realizer realizer)
+    : MalType(MalTypeTag::LAZY_SEQ)
+    , m_realizer(std::move(realizer))
+{
+}
+
+MalLazySeq::MalLazySeq(Elements chunk, std::shared_ptr<MalLazySeq> next)
+    : MalType(MalTypeTag::LAZY_SEQ)
+    , m_chunk(std::move(chunk))
+    , m_next(std::move(next))
+    , m_isRealized(true)
+{
+}
+
+MalLazySeq::~MalLazySeq()
+{
+    // NOTE: unlink realized nodes one by one, recursive destruction of long chain could exhaust the stack
+    auto next = std::move(m_next);
+    while (next && next.use_count() == 1) {
+        next = std::move(next->m_next);
+    }
+}
+
+std::shared_ptr<MalType> MalLazySeq::realize() const
+{
+    if (!m_isRealized) {
+        // realizer captures whatever it needs, release it right away so it doesn't hold upstream nodes
+        auto realizer = std::move(m_realizer);
+        m_realizer = nullptr;
+        m_isRealized = true;
+        auto next = realizer(m_chunk);
+        if (next && next->is<MalException>()) {
+            m_error = next;
+        } else if (next) {
+            m_next = std::static_pointer_cast<MalLazySeq>(next);
+        }
+    }
+    return m_error;
+}
+
+const MalLazySeq::Elements& MalLazySeq::chunk() const
+{
+    return m_chunk;
+}
+
+const std::shared_ptr<MalLazySeq>& MalLazySeq::next() const
+{
+    return m_next;
+}
+
+std::shared_ptr<MalType> MalLazySeq::forEach(std::shared_ptr<MalLazySeq> sequence, const Visitor& visit)
+{
+    while (sequence) {
+        if (auto error = sequence->realize(); error) {
+            return error;
+        }
+        for (const auto& element : sequence->chunk()) {
+            if (!visit(element)) {
+                return nullptr;
+            }
+        }
+        sequence = sequence->next();
+    }
+    return nullptr;
+}
+
+std::shared_ptr<MalType> MalLazySeq::firstNonEmpty(std::shared_ptr<MalLazySeq> sequence)
+{
+    while (sequence) {
+        if (auto error = sequence->realize(); error) {
+            return error;
+        }
+        if (!sequence->chunk().empty()) {
+            return sequence;
+        }
+        sequence = sequence->next();
+    }
+    return nullptr;
+}
+
+std::shared_ptr<MalType> MalLazySeq::toList(std::shared_ptr<MalLazySeq> sequence)
+{
+    auto list = std::make_shared<MalList>();
+    if (auto error = forEach(std::move(sequence), [&list](const auto& element) { list->append(element); return true; }); error) {
+        return error;
+    }
+    return list;
+}
+
+std::shared_ptr<MalType> MalLazySeq::collect(Elements& elements, size_t limit) const
+{
+    if (auto error = realize(); error) {
+        return error;
+    }
+    elements.insert(elements.end(), m_chunk.begin(), m_chunk.begin() + std::min(limit, m_chunk.size()));
+    if (elements.size() >= limit) {
+        return nullptr;
+    }
+    return forEach(m_next, [&elements, limit](const auto& element) {
+        elements.push_back(element);
+        return elements.size() < limit;
+    });
+}
+
+void MalLazySeq::print(Printer& printer) const
+{
+    // with print length set only the elements that are shown and one more, to tell there are more, are realized,
+    // so infinite sequences could be printed
+    const auto length = printer.limits().length;
+    Elements elements;
+    if (auto error = collect(elements, length ? *length + 1 : SIZE_MAX); error) {
+        printer.print(*error);
+        return;
+    }
+    MalContainer(elements, MalContainer::ContainerType::LIST).print(printer);
+}
+
+namespace {
+// Walks a lazy sequence element by element, a node is realized only when its first element is asked for
+class LazySeqCursor {
+public:
+    explicit LazySeqCursor(const MalLazySeq* sequence)
+        : m_node(sequence)
+    {
+    }
+
+    // nullptr at the end of the sequence or if realization failed, see isFailed
+    std::shared_ptr<MalType> next()
+    {
+        while (m_node) {
+            if (m_node->realize()) {
+                m_isFailed = true;
+                m_node = nullptr;
+                break;
+            }
+            if (m_index < m_node->chunk().size()) {
+                return m_node->chunk()[m_index++];
+            }
+            // the first node owns the rest of the chain, raw pointers stay valid for the walk
+            m_node = m_node->next().get();
+            m_index = 0;
+        }
+        return nullptr;
+    }
+
+    bool isFailed() const { return m_isFailed; }
+
+private:
+    const MalLazySeq* m_node;
+    size_t m_index { 0 };
+    bool m_isFailed { false };
+};
+
+bool areElementsEqual(const std::shared_ptr<MalType>& lhs, const std::shared_ptr<MalType>& rhs)
+{
+    return lhs == rhs || lhs->operator==(rhs.get());
+}
+}
+
+// Elements are compared as they are realized, the walk stops at the first mismatch or at the end of
+// the shorter side, so a finite sequence compares with an infinite one
+bool MalLazySeq::operator==(MalType* type) const
+{
+    if (type == this) {
+        return true;
+    }
+    LazySeqCursor elements(this);
+    auto isEndOfElements = [&elements]() { return !elements.next() && !elements.isFailed(); };
+    if (auto otherSequence = type->as<MalLazySeq>(); otherSequence) {
+        LazySeqCursor otherElements(otherSequence);
+        for (;;) {
+            const auto element = elements.next();
+            const auto otherElement = otherElements.next();
+            if (!element || !otherElement) {
+                return !element && !otherElement && !elements.isFailed() && !otherElements.isFailed();
+            }
+            if (!areElementsEqual(element, otherElement)) {
+                return false;
+            }
+        }
+    }
+    if (auto container = type->as<MalContainer>(); container) {
+        for (const auto& otherElement : *container) {
+            const auto element = elements.next();
+            if (!element || !areElementsEqual(element, otherElement)) {
+                return false;
+            }
+        }
+        return isEndOfElements();
+    }
+    if (auto numericVector = type->as<MalNumericVector>(); numericVector) {
+        for (size_t elementIndex = 0; elementIndex < numericVector->size(); ++elementIndex) {
+            const auto element = elements.next();
+            if (!element || !areElementsEqual(element, numericVector->at(elementIndex))) {
+                return false;
+            }
+        }
+        return isEndOfElements();
+    }
+    return false;
+}
+
+// NOTE: like count, it doesn't return for an infinite sequence
+size_t MalLazySeq::hash() const
 {
+    LazySeqCursor elements(this);
+    size_t result = 0;
+    size_t size = 0;
+    while (const auto element = elements.next()) {
+        result = combineHashes(result, element->hash());
+        ++size;
+    }
+    return combineHashes(result, size);
+}
+
+MalTransducer::MalTransducer(std::vector<Step> steps)
+    : MalType(MalTypeTag::TRANSDUCER)
+    , m_steps(std::move(steps))
+{
+}
+
+void MalTransducer::print(Printer& printer) const
+{
+    printer.write("transducer");
+}
+
+const std::vector<MalTransducer::Step>& MalTransducer::steps() const
+{
+    return m_steps;
+}
+
+std::shared_ptr<MalTransducer> MalTransducer::then(const MalTransducer& other) const
+{
+    auto steps = m_steps;
+    steps.insert(steps.end(), other.m_steps.begin(), other.m_steps.end());
+    return std::make_shared<MalTransducer>(std::move(steps));
 }
 
-std::string MalException::asString() const
+MalException::MalException(const std::string& message)
+    : MalType(MalTypeTag::EXCEPTION)
+    , m_message(message)
 {
-    return m_message;
 }
 
-MalException* MalException::asMalException()
+void MalException::print(Printer& printer) const
 {
-    return this;
+    printer.write(m_message);
 }
 
 std::shared_ptr<MalException> MalException::throwException(const std::string& message)
@@ -418,16 +1159,14 @@ std::shared_ptr<MalException> MalException::throwException(const std::string& me
     return std::make_shared<MalException>("Exception: " + message);
 }
 
-MalCallable* MalCallable::builinOrCallable(MalType* callable)
+MalCallable::MalCallable(MalTypeTag tag)
+    : MalType(tag)
 {
-    if (auto buildin = callable->asMalBuildin(); buildin) {
-        return buildin;
-    }
-    return callable->asMalClosure();
 }
 
 MalClosure::MalClosure(const std::shared_ptr<MalType> parameters, const std::shared_ptr<MalType> body, const Env& env)
-    : m_functionParameters(parameters)
+    : MalCallable(MalTypeTag::CLOSURE)
+    , m_functionParameters(parameters)
     , m_functionBody(body)
     , m_relatedEnv(env)
 {
@@ -438,14 +1177,9 @@ std::shared_ptr<MalType> MalClosure::clone() const
     return std::make_shared<MalClosure>(m_functionParameters, m_functionBody, m_relatedEnv);
 }
 
-std::string MalClosure::asString() const
+void MalClosure::print(Printer& printer) const
 {
-    return "closure";
-}
-
-MalClosure* MalClosure::asMalClosure()
-{
-    return this;
+    printer.write("closure");
 }
 
 std::shared_ptr<MalType> MalClosure::evaluate(MalContainer* arguments, Env& env)
@@ -455,7 +1189,7 @@ std::shared_ptr<MalType> MalClosure::evaluate(MalContainer* arguments, Env& env)
     // so we copy it, probably there is a better way to do this
     m_relatedEnv.addToEnv(env);
     Env newEnv(&m_relatedEnv);
-    newEnv.setBindings(m_functionParameters->asMalContainer(), arguments);
+    newEnv.setBindings(m_functionParameters->as<MalContainer>(), arguments);
     auto res = EVAL(m_functionBody, newEnv);
     return res;
 }
@@ -470,24 +1204,36 @@ void MalClosure::setIsMacroFunctionCall(bool isMacro)
     m_isMacroFunctionCall = isMacro;
 }
 
-MalBuildin::MalBuildin(Buildin buildinFunc)
-    : m_buildin(std::move(buildinFunc))
+const std::shared_ptr<MalType>& MalClosure::parameters() const
 {
+    return m_functionParameters;
 }
 
-MalBuildin::MalBuildin(BuildinWithEnv buildinFuncWithEnv)
-    : m_buildinWithEnv(std::move(buildinFuncWithEnv))
+const std::shared_ptr<MalType>& MalClosure::body() const
 {
+    return m_functionBody;
 }
 
-std::string MalBuildin::asString() const
+Env& MalClosure::relatedEnv()
 {
-    return "buildin";
+    return m_relatedEnv;
 }
 
-MalBuildin* MalBuildin::asMalBuildin()
+MalBuildin::MalBuildin(Buildin buildinFunc)
+    : MalCallable(MalTypeTag::BUILDIN)
+    , m_buildin(std::move(buildinFunc))
 {
-    return this;
+}
+
+MalBuildin::MalBuildin(BuildinWithEnv buildinFuncWithEnv)
+    : MalCallable(MalTypeTag::BUILDIN)
+    , m_buildinWithEnv(std::move(buildinFuncWithEnv))
+{
+}
+
+void MalBuildin::print(Printer& printer) const
+{
+    printer.write("buildin");
 }
 
 std::shared_ptr<MalType> MalBuildin::evaluate(MalContainer* args, Env& env)
@@ -514,4 +1260,33 @@ std::shared_ptr<MalType> MalBuildin::clone() const
     return std::make_shared<MalBuildin>(m_buildinWithEnv);
 }
 
+MalPort::MalPort(std::shared_ptr<OutputPort> output)
+    : MalType(MalTypeTag::PORT)
+    , m_output(std::move(output))
+{
+}
+
+MalPort::MalPort(std::shared_ptr<InputPort> input)
+    : MalType(MalTypeTag::PORT)
+    , m_input(std::move(input))
+{
+}
+
+void MalPort::print(Printer& printer) const
+{
+    printer.write(m_output ? "#<output-port " : "#<input-port ");
+    printer.write(m_output ? m_output->name() : m_input->name());
+    printer.write('>');
+}
+
+OutputPort* MalPort::output() const
+{
+    return m_output.get();
+}
+
+const std::shared_ptr<InputPort>& MalPort::input() const
+{
+    return m_input;
+}
+
 } // namespace mal
\ No newline at end of file
@@ -1,170 +1,387 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <functional>
+#include <iterator>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <variant>
 #include <vector>
 
+#include "biginteger.h"
 #include "env.h"
+#include "persistenthashmap.h"
+#include "persistentvector.h"
 
 namespace mal {
 enum class TokenType : char;
 
 class MalAtom;
 class MalNumber;
+class MalBigInteger;
+class MalDouble;
+class MalNumericVector;
 class MalContainer;
 class MalSymbol;
 class MalString;
 class MalHashMap;
+class MalLazySeq;
+class MalTransducer;
 class MalException;
 class MalBoolean;
 class MalNil;
 class MalClosure;
 class MalBuildin;
+class MalCallable;
+class MalPort;
+class Printer;
+class OutputPort;
+class InputPort;
+
+enum class MalTypeTag : uint8_t {
+    ATOM,
+    NUMBER,
+    BIG_INTEGER,
+    DOUBLE,
+    NUMERIC_VECTOR,
+    CONTAINER,
+    SYMBOL,
+    STRING,
+    HASH_MAP,
+    LAZY_SEQ,
+    TRANSDUCER,
+    EXCEPTION,
+    BOOLEAN,
+    NIL,
+    CLOSURE,
+    BUILDIN,
+    PORT
+};
 
 class MalType {
 public:
-    virtual std::string asString() const = 0;
-
-    virtual MalNumber* asMalNumber() { return nullptr; }
-    virtual MalContainer* asMalContainer() { return nullptr; }
-    virtual MalSymbol* asMalSymbol() { return nullptr; }
-    virtual MalString* asMalString() { return nullptr; }
-    virtual MalHashMap* asMalHashMap() { return nullptr; }
-    virtual MalException* asMalException() { return nullptr; }
-    virtual MalBoolean* asMalBoolean() { return nullptr; }
-    virtual MalNil* asMalNil() { return nullptr; }
-    virtual MalClosure* asMalClosure() { return nullptr; }
-    virtual MalBuildin* asMalBuildin() { return nullptr; }
-    virtual MalAtom* asMalAtom() { return nullptr; }
+    // Readable representation, the one REPL and pr-str show
+    std::string asString() const;
+    // Writes representation to printer, strings are quoted and escaped only when printing readably
+    virtual void print(Printer& printer) const = 0;
+
+    MalTypeTag tag() const { return m_tag; }
+
+    // NOTE: type tests are a byte compare, every concrete type exposes its tag as T::typeTag
+    template <typename T>
+    bool is() const
+    {
+        if constexpr (std::is_same_v<T, MalCallable>) {
+            return m_tag == MalTypeTag::CLOSURE || m_tag == MalTypeTag::BUILDIN;
+        } else {
+            return m_tag == T::typeTag;
+        }
+    }
+
+    template <typename T>
+    T* as()
+    {
+        return is<T>() ? static_cast<T*>(this) : nullptr;
+    }
+
+    template <typename T>
+    const T* as() const
+    {
+        return is<T>() ? static_cast<const T*>(this) : nullptr;
+    }
 
     void setMetaInfo(std::shared_ptr<MalType>);
     std::shared_ptr<MalType> getMetaInfo() const;
+    bool hasMetaInfo() const { return m_hasMetaInfo; }
 
     virtual std::shared_ptr<MalType> clone() const;
 
     virtual bool operator==(MalType*) const { return false; }
+    // Consistent with operator==, values that compare equal hash the same. Identity hash by default.
+    virtual size_t hash() const;
 
-    virtual ~MalType()
-    {
-    }
+    virtual ~MalType();
 
 protected:
-    // TODO: move this to separate class
-    std::shared_ptr<MalType> m_metaInfo;
+    explicit MalType(MalTypeTag tag);
+
+private:
+    const MalTypeTag m_tag;
+    // Metadata lives in a side table keyed by object identity,
+    // the flag only tells the destructor whether there is an entry to drop.
+    bool m_hasMetaInfo { false };
+};
+
+// Hash map keys are compared structurally, and by identity for types without value equality
+struct MalTypeKeyHash {
+    size_t operator()(const std::shared_ptr<MalType>& key) const { return key->hash(); }
+};
+
+struct MalTypeKeyEqual {
+    bool operator()(const std::shared_ptr<MalType>& lhs, const std::shared_ptr<MalType>& rhs) const
+    {
+        return lhs == rhs || lhs->operator==(rhs.get());
+    }
 };
 
 class MalAtom : public MalType {
 public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::ATOM;
+
     MalAtom(std::shared_ptr<MalType> malType, const std::string& atomDesripton);
 
-    std::string asString() const override;
-    MalAtom* asMalAtom() override;
+    void print(Printer& printer) const override;
 
     std::shared_ptr<MalType> reset(std::shared_ptr<MalType> newType);
     std::shared_ptr<MalType> deref() const;
+    const std::string& description() const;
 
 private:
     std::shared_ptr<MalType> m_underlyingType;
     std::string m_atomDescripton;
 };
 
+// Fixnum, the common case of the numeric tower
 class MalNumber final : public MalType {
 public:
-    MalNumber(std::string_view number);
-    MalNumber(int number);
+    static constexpr MalTypeTag typeTag = MalTypeTag::NUMBER;
 
-    std::string asString() const override;
-    MalNumber* asMalNumber() override;
+    MalNumber(int64_t number);
+
+    void print(Printer& printer) const override;
 
     virtual bool operator==(MalType* type) const override
     {
-        return type->asMalNumber() && type->asMalNumber()->getValue() == m_number;
+        return type->is<MalNumber>() && type->as<MalNumber>()->getValue() == m_number;
     }
 
-    bool operator>(MalNumber* malNumber) const
-    {
-        return m_number > malNumber->getValue();
-    }
+    int64_t getValue() const;
+    size_t hash() const override;
 
-    bool operator>=(MalNumber* malNumber) const
-    {
-        return m_number >= malNumber->getValue();
-    }
+    // Parses integer or floating point literal, integers that don't fit into fixnum become big integers
+    static std::shared_ptr<MalType> fromString(std::string_view number);
+
+private:
+    int64_t m_number;
+};
+
+// Integers that overflowed fixnum range, results that fit back are demoted to MalNumber
+class MalBigInteger final : public MalType {
+public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::BIG_INTEGER;
+
+    MalBigInteger(BigInteger number);
+
+    void print(Printer& printer) const override;
 
-    bool operator<(MalNumber* malNumber) const
+    virtual bool operator==(MalType* type) const override
     {
-        return m_number < malNumber->getValue();
+        return type->is<MalBigInteger>() && type->as<MalBigInteger>()->getValue() == m_number;
     }
 
-    bool operator<=(MalNumber* malNumber) const
+    const BigInteger& getValue() const;
+    size_t hash() const override;
+
+    static std::shared_ptr<MalType> normalized(BigInteger number);
+
+private:
+    BigInteger m_number;
+};
+
+class MalDouble final : public MalType {
+public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::DOUBLE;
+
+    MalDouble(double number);
+
+    void print(Printer& printer) const override;
+
+    virtual bool operator==(MalType* type) const override
     {
-        return m_number <= malNumber->getValue();
+        return type->is<MalDouble>() && type->as<MalDouble>()->getValue() == m_number;
     }
 
-    int getValue() const;
+    double getValue() const;
+    size_t hash() const override;
 
 private:
-    int m_number;
+    double m_number;
 };
 
+// Every container is [offset, offset + size) view into shared storage: slot buffer for lists built by cons
+// and append, persistent trie for vectors. Copies, slices, cons, rest and one-element updates of a vector
+// share storage with the original, storage is copied only when a view can't be extended in place.
+// Containers of up to inlineCapacity elements, the usual call forms and argument lists, keep them inline
+// and move to shared storage once they outgrow it.
 class MalContainer : public MalType {
 public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::CONTAINER;
+
     enum class ContainerType {
         LIST,
         VECTOR
     };
 
-    MalContainer(const std::vector<std::shared_ptr<MalType>>& data, MalContainer::ContainerType type);
+    static constexpr size_t inlineCapacity = 4;
+
+    using ListData = std::vector<std::shared_ptr<MalType>>;
+    using VectorData = PersistentVector<std::shared_ptr<MalType>>;
+
+    // Slots shared by lists built from one another, every list sees its own [offset, offset + size) range.
+    // Free room is kept in front of the first occupied slot, so cons doesn't move anything.
+    struct ListBuffer {
+        ListData slots;
+        size_t front { 0 };
+    };
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::shared_ptr<MalType>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator(const std::shared_ptr<MalType>* iterator)
+            : m_iterator(iterator)
+        {
+        }
+        const_iterator(VectorData::const_iterator iterator)
+            : m_iterator(iterator)
+        {
+        }
+
+        const std::shared_ptr<MalType>& operator*() const
+        {
+            if (auto listIterator = std::get_if<const std::shared_ptr<MalType>*>(&m_iterator)) {
+                return **listIterator;
+            }
+            return *std::get<VectorData::const_iterator>(m_iterator);
+        }
+
+        const_iterator& operator++()
+        {
+            std::visit([](auto& iterator) { ++iterator; }, m_iterator);
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const { return m_iterator == other.m_iterator; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        std::variant<const std::shared_ptr<MalType>*, VectorData::const_iterator> m_iterator;
+    };
+
+    MalContainer(const ListData& data, MalContainer::ContainerType type);
+    MalContainer(VectorData data);
     MalContainer(ContainerType containerType);
 
-    std::string asString() const override;
-    MalContainer* asMalContainer() override;
+    void print(Printer& printer) const override;
 
+    // NOTE: O(1) for vectors, trie is shared
     std::shared_ptr<MalType> clone() const override;
 
     virtual bool operator==(MalType* type) const override
     {
         // TODO: Compare only lists and not containers
-        if (auto ls = type->asMalContainer(); ls && ls->size() == m_data.size()) {
-            for (size_t lsIndex = 0; lsIndex < m_data.size(); ++lsIndex) {
-                const auto lhs = m_data[lsIndex];
-                const auto rhs = ls->at(lsIndex);
-                if (!(lhs->operator==(rhs.get()))) {
-                    return false;
-                }
-            }
+        if (type->is<MalLazySeq>() || type->is<MalNumericVector>()) {
+            return type->operator==(const_cast<MalContainer*>(this));
+        }
+        auto ls = type->as<MalContainer>();
+        if (!ls || ls->size() != size()) {
+            return false;
+        }
+        if (sharesElementsWith(*ls)) {
             return true;
         }
-        return false;
+        // NOTE: hashes are only compared once both are known, equality alone doesn't compute them
+        if (m_hash && ls->m_hash && *m_hash != *ls->m_hash) {
+            return false;
+        }
+        auto rhs = ls->begin();
+        for (const auto& lhs : *this) {
+            if (lhs != *rhs && !(lhs->operator==((*rhs).get()))) {
+                return false;
+            }
+            ++rhs;
+        }
+        return true;
     }
 
+    // Lists, vectors and lazy sequences with the same elements are equal, so they hash the same
+    size_t hash() const override;
+    template <typename Iterator>
+    static size_t hashElements(size_t size, Iterator begin, Iterator end);
+
     void append(std::shared_ptr<MalType>);
     bool isEmpty() const;
     size_t size() const;
     ContainerType type() const;
-    void toList() {
-        m_type = ContainerType::LIST;
-    }
+    void toList();
 
     std::shared_ptr<MalType> at(size_t index) const;
     std::shared_ptr<MalType> back() const;
 
+    // New vector with element at index replaced, index equal to size appends. Vectors only.
+    std::shared_ptr<MalContainer> assoc(size_t index, std::shared_ptr<MalType> element) const;
+
+    // New list with element in front, O(1) for lists
+    std::shared_ptr<MalContainer> cons(std::shared_ptr<MalType> element) const;
+    // Container of the same type viewing [offset, offset + length) of this one, O(1)
+    std::shared_ptr<MalContainer> slice(size_t offset, size_t length) const;
+    // List of all elements but first, O(1)
+    std::shared_ptr<MalContainer> rest() const;
+
     std::shared_ptr<MalType> head() const;
-    std::shared_ptr<MalContainer> tail();
+    // Container of the same type without first element, O(1)
+    std::shared_ptr<MalContainer> tail() const;
+
+    // Replaces element in place if no other container sees the storage, copies the storage otherwise
+    void set(size_t index, std::shared_ptr<MalType> element);
 
-    static std::shared_ptr<MalContainer> tail(MalContainer* container);
+    // Marks an argument list EVAL built for a buildin call, no user code ever sees its storage
+    void markAsOwnedArguments();
+    // Moves element out of an owned argument list if no other container sees the storage, lets consumers
+    // of lazy sequence passed as an argument walk it without the argument list holding on to its head.
+    // Any other container is the caller's data (apply passes lists as they are), the element is shared.
+    std::shared_ptr<MalType> takeAt(size_t index);
 
-    std::vector<std::shared_ptr<MalType>>::iterator begin();
-    std::vector<std::shared_ptr<MalType>>::iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    enum class Storage : uint8_t {
+        INLINE,
+        SLOTS,
+        TRIE
+    };
+
+    const std::shared_ptr<MalType>* listSlots() const;
+    std::shared_ptr<MalContainer> shareStorage(ContainerType type) const;
+    // Moves inline elements to a slot buffer or a trie, depending on type
+    void spill();
+    bool sharesElementsWith(const MalContainer& other) const;
 
 protected:
-    std::vector<std::shared_ptr<MalType>> m_data;
+    // NOTE: inline elements always start at offset 0, slots past the size are empty
+    std::array<std::shared_ptr<MalType>, inlineCapacity> m_inlineSlots;
+    std::shared_ptr<ListBuffer> m_listBuffer;
+    VectorData m_vectorData;
+    size_t m_offset { 0 };
+    size_t m_size { 0 };
 
 private:
     ContainerType m_type;
+    Storage m_storage;
+    // NOTE: never carried over by shareStorage, copies of an argument list are ordinary containers
+    bool m_isOwnedArguments { false };
+    // computed on first request, append resets it
+    mutable std::optional<size_t> m_hash;
 };
 
 // TODO: do we need MalList and MalVector???
@@ -178,130 +395,277 @@ public:
     MalVector();
 };
 
+// Unboxed fixnums or doubles in one contiguous array, made by ivec and dvec. Prints like a vector, equals
+// vectors and lists with the same elements and is a sequence to the sequence builtins. Elements are boxed
+// only when handed out one by one, numeric builtins work on the array itself.
+class MalNumericVector final : public MalType {
+public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::NUMERIC_VECTOR;
+
+    using Integers = std::vector<int64_t>;
+    using Doubles = std::vector<double>;
+
+    MalNumericVector(Integers elements);
+    MalNumericVector(Doubles elements);
+
+    void print(Printer& printer) const override;
+
+    bool operator==(MalType* type) const override;
+    size_t hash() const override;
+
+    bool isDouble() const;
+    size_t size() const;
+    std::shared_ptr<MalType> at(size_t index) const;
+
+    const Integers& integers() const;
+    const Doubles& doubles() const;
+
+private:
+    std::variant<Integers, Doubles> m_elements;
+};
+
+// Symbols and keywords are interned, there is exactly one object per name and type,
+// so equality and environment lookups are pointer compares.
 class MalSymbol final : public MalType {
 public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::SYMBOL;
+
     enum class SymbolType {
         REGULAR_SYMBOL,
         KEYWORD
     };
 public:
-    MalSymbol(std::string_view symbol, SymbolType type = SymbolType::REGULAR_SYMBOL);
+    // NOTE: thread safe, lookup of already interned names only takes a shared lock
+    static std::shared_ptr<MalSymbol> intern(std::string_view symbol, SymbolType type = SymbolType::REGULAR_SYMBOL);
 
-    std::string asString() const override;
-    MalSymbol* asMalSymbol() override;
+    void print(Printer& printer) const override;
 
     virtual bool operator==(MalType* type) const override
     {
-        return type->asMalSymbol() && type->asString() == m_symbol;
+        return type == this;
     }
 
     SymbolType getType() const;
-    
+    std::string_view name() const;
+    // NOTE: precomputed from the name, equal symbols are the same object anyway
+    size_t hash() const override;
+
 private:
-    std::string m_symbol;
-    SymbolType m_symbolType;
+    MalSymbol(std::string_view symbol, SymbolType type);
+
+private:
+    const std::string m_symbol;
+    const size_t m_hash;
+    const SymbolType m_symbolType;
 };
 
+// Holds unescaped characters, quoting is up to the printer.
+// Strings share a buffer with the string they were built from, see appendableBuffer().
 class MalString final : public MalType {
 public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::STRING;
+
     MalString(std::string_view str);
+    MalString(std::shared_ptr<std::string> buffer, size_t size);
 
-    std::string asString() const override;
-    MalString* asMalString() override;
+    void print(Printer& printer) const override;
 
     virtual bool operator==(MalType* type) const override
     {
-        return type->asMalString() && type->asString() == m_malString;
+        return type->is<MalString>() && type->as<MalString>()->value() == value();
     }
 
+    std::string_view value() const;
     bool isEmpty() const;
+    size_t hash() const override;
+
+    // Buffer could be extended in place only if this string ends where the buffer does,
+    // strings built from the same prefix keep seeing their own characters.
+    std::shared_ptr<std::string> appendableBuffer() const;
 
 public:
-    static std::string escapeString(const std::string& str);
-    static std::string unEscapeString(const std::string& str);
+    static std::string unEscapeString(std::string_view str);
 
 private:
-    std::string m_malString;
+    std::shared_ptr<std::string> m_buffer;
+    size_t m_size;
 };
 
 class MalNil final : public MalType {
 public:
-    std::string asString() const override;
-    MalNil* asMalNil() override;
+    static constexpr MalTypeTag typeTag = MalTypeTag::NIL;
+
+    MalNil();
+
+    void print(Printer& printer) const override;
 
     virtual bool operator==(MalType* type) const override
     {
-        return type->asMalNil();
+        return type->is<MalNil>();
     }
+    size_t hash() const override;
 };
 
 class MalBoolean final : public MalType {
 public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::BOOLEAN;
+
     MalBoolean(bool value);
     MalBoolean(std::string_view strValue);
 
-    std::string asString() const override;
-    MalBoolean* asMalBoolean() override;
+    void print(Printer& printer) const override;
 
     bool getValue() const;
+    size_t hash() const override;
 
     virtual bool operator==(MalType* type) const override
     {
-        return type->asMalBoolean() && type->asMalBoolean()->getValue() == m_boolValue;
+        return type->is<MalBoolean>() && type->as<MalBoolean>()->getValue() == m_boolValue;
     }
 
 private:
     const bool m_boolValue;
 };
 
+// Backed by persistent hash trie, clone and every update share structure with the original map.
+// Keys are values themselves, hashed and compared structurally.
 class MalHashMap final : public MalType {
 public:
-    using HashMapIteraotr = std::unordered_map<std::string, std::shared_ptr<MalType>>::iterator;
+    static constexpr MalTypeTag typeTag = MalTypeTag::HASH_MAP;
+
+    MalHashMap();
+
+    using HashMapData = PersistentHashMap<std::shared_ptr<MalType>, std::shared_ptr<MalType>, MalTypeKeyHash, MalTypeKeyEqual>;
+    using HashMapIteraotr = HashMapData::const_iterator;
 
 public:
-    std::string asString() const override;
-    MalHashMap* asMalHashMap() override;
+    void print(Printer& printer) const override;
     std::shared_ptr<MalType> clone() const override;
+    size_t hash() const override;
 
     virtual bool operator==(MalType* type) const override
     {
-        if (auto hashMap = type->asMalHashMap(); hashMap && hashMap->size() == m_hashMap.size()) {
-            for (const auto& [key, value]: m_hashMap) {
-                auto otherElement = hashMap->find(key);
-                if (otherElement != hashMap->end()) {
-                    auto& [otherKey, otherValue] = *otherElement;
-                    if (key != otherKey || !(value->operator==(otherValue.get()))){
-                        return false;
-                    }
-                }
-            }
+        auto hashMap = type->as<MalHashMap>();
+        if (!hashMap || hashMap->size() != m_hashMap.size()) {
+            return false;
+        }
+        if (hashMap == this || m_hashMap.sharesStructureWith(hashMap->m_hashMap)) {
             return true;
         }
-        return false;
+        if (m_hash && hashMap->m_hash && *m_hash != *hashMap->m_hash) {
+            return false;
+        }
+        for (const auto& [key, value]: m_hashMap) {
+            auto otherValue = hashMap->find(key);
+            if (!otherValue || (otherValue != value && !(value->operator==(otherValue.get())))) {
+                return false;
+            }
+        }
+        return true;
     }
 
-    void insert(const std::string& key, std::shared_ptr<MalType> value);
-    void remove(const std::string& key);
+    void insert(std::shared_ptr<MalType> key, std::shared_ptr<MalType> value);
+    void remove(const std::shared_ptr<MalType>& key);
 
     size_t size() const;
 
-    HashMapIteraotr begin();
-    HashMapIteraotr end();
-    HashMapIteraotr find(const std::string& key);
+    HashMapIteraotr begin() const;
+    HashMapIteraotr end() const;
+    // Value related to key or nullptr if there is none
+    std::shared_ptr<MalType> find(const std::shared_ptr<MalType>& key) const;
 
     std::shared_ptr<MalList> keys() const;
     std::shared_ptr<MalList> vals() const;
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<MalType>> m_hashMap;
+    HashMapData m_hashMap;
+    // computed on first request, insert and remove reset it
+    mutable std::optional<size_t> m_hash;
+};
+
+// Sequence realized on demand, chunk by chunk. Realized chunks are kept, so the same sequence always
+// yields the same elements, but walked nodes are dropped as soon as nothing refers to them anymore:
+// a walker that doesn't hold on to the head goes through the sequence in constant memory.
+class MalLazySeq final : public MalType {
+public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::LAZY_SEQ;
+    static constexpr size_t chunkSize = 32;
+
+    using Elements = std::vector<std::shared_ptr<MalType>>;
+    // Fills chunk with elements that come next and returns the sequence following them,
+    // nullptr at the end of sequence or MalException if realization failed.
+    using Realizer = std::function<std::shared_ptr<MalType>(Elements& chunk)>;
+    using Visitor = std::function<bool(const std::shared_ptr<MalType>&)>;
+
+    explicit MalLazySeq(Realizer realizer);
+    MalLazySeq(Elements chunk, std::shared_ptr<MalLazySeq> next);
+    ~MalLazySeq() override;
+
+    void print(Printer& printer) const override;
+    virtual bool operator==(MalType* type) const override;
+    size_t hash() const override;
+
+    // Realizes this node once, returns MalException if realizer failed
+    std::shared_ptr<MalType> realize() const;
+    const Elements& chunk() const;
+    const std::shared_ptr<MalLazySeq>& next() const;
+
+    // Calls visit for elements until it returns false, returns MalException if realization failed
+    static std::shared_ptr<MalType> forEach(std::shared_ptr<MalLazySeq> sequence, const Visitor& visit);
+    // First node with non-empty chunk, nullptr for empty sequence or MalException if realization failed
+    static std::shared_ptr<MalType> firstNonEmpty(std::shared_ptr<MalLazySeq> sequence);
+    // Realizes whole sequence into list, or returns MalException
+    static std::shared_ptr<MalType> toList(std::shared_ptr<MalLazySeq> sequence);
+
+private:
+    // Appends up to limit elements
+    std::shared_ptr<MalType> collect(Elements& elements, size_t limit = SIZE_MAX) const;
+
+private:
+    mutable Realizer m_realizer;
+    mutable Elements m_chunk;
+    mutable std::shared_ptr<MalLazySeq> m_next;
+    mutable std::shared_ptr<MalType> m_error;
+    mutable bool m_isRealized { false };
+};
+
+// Sequence transformation made of steps, every element goes through all of them before the next one is taken,
+// so (comp (map f) (filter p)) is a single pass without intermediate sequence
+class MalTransducer final : public MalType {
+public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::TRANSDUCER;
+
+    enum class StepType : uint8_t {
+        MAP,
+        FILTER,
+        REMOVE,
+        KEEP
+    };
+
+    struct Step {
+        StepType type;
+        std::shared_ptr<MalType> function;
+    };
+
+    MalTransducer(std::vector<Step> steps);
+
+    void print(Printer& printer) const override;
+
+    const std::vector<Step>& steps() const;
+    // Transducer running steps of this one first and then steps of other
+    std::shared_ptr<MalTransducer> then(const MalTransducer& other) const;
+
+private:
+    std::vector<Step> m_steps;
 };
 
 class MalException : public MalType {
 public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::EXCEPTION;
+
     MalException(const std::string& message);
 
-    std::string asString() const override;
-    MalException* asMalException() override;
+    void print(Printer& printer) const override;
 
     static std::shared_ptr<MalException> throwException(const std::string& message);
 
@@ -314,16 +678,17 @@ class MalCallable : public MalType {
 public:
     virtual std::shared_ptr<MalType> evaluate(MalContainer* arguments, Env& env) = 0;
 
-public:
-    static MalCallable* builinOrCallable(MalType* callable);
+protected:
+    explicit MalCallable(MalTypeTag tag);
 };
 
 class MalClosure : public MalCallable {
 public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::CLOSURE;
+
     MalClosure(const std::shared_ptr<MalType> parameters, const std::shared_ptr<MalType> body, const Env& env);
 
-    std::string asString() const override;
-    MalClosure* asMalClosure() override;
+    void print(Printer& printer) const override;
 
     std::shared_ptr<MalType> evaluate(MalContainer* arguments, Env& env) override;
     std::shared_ptr<MalType> clone() const override;
@@ -331,6 +696,11 @@ public:
     bool getIsMacroFucntionCall() const;
     void setIsMacroFunctionCall(bool isMacro);
 
+    const std::shared_ptr<MalType>& parameters() const;
+    const std::shared_ptr<MalType>& body() const;
+    // NOTE: grows with bindings of the callers, see evaluate()
+    Env& relatedEnv();
+
 private:
     const std::shared_ptr<MalType> m_functionParameters;
     const std::shared_ptr<MalType> m_functionBody;
@@ -340,14 +710,15 @@ private:
 
 class MalBuildin : public MalCallable {
 public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::BUILDIN;
+
     using Buildin = std::function<std::shared_ptr<MalType>(MalContainer*)>;
     using BuildinWithEnv = std::function<std::shared_ptr<MalType>(MalContainer*, Env&)>;
 
     MalBuildin(Buildin buildinFunc);
     MalBuildin(BuildinWithEnv buildinFuncWithEnv);
 
-    std::string asString() const override;
-    MalBuildin* asMalBuildin() override;
+    void print(Printer& printer) const override;
 
     std::shared_ptr<MalType> evaluate(MalContainer* args, Env& env) override;
     std::shared_ptr<MalType> evaluate(MalContainer* args) const;
@@ -359,4 +730,23 @@ private:
     BuildinWithEnv m_buildinWithEnv;
 };
 
+// Output or input port, equal only to itself
+class MalPort final : public MalType {
+public:
+    static constexpr MalTypeTag typeTag = MalTypeTag::PORT;
+
+    explicit MalPort(std::shared_ptr<OutputPort> output);
+    explicit MalPort(std::shared_ptr<InputPort> input);
+
+    void print(Printer& printer) const override;
+
+    // nullptr when the port goes the other way
+    OutputPort* output() const;
+    const std::shared_ptr<InputPort>& input() const;
+
+private:
+    std::shared_ptr<OutputPort> m_output;
+    std::shared_ptr<InputPort> m_input;
+};
+
 } // namespace mal
\ No newline at end of file
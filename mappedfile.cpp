@@ -0,0 +1,52 @@
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mal {
+
+std::shared_ptr<const MappedFile> MappedFile::open(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat fileStat { };
+    std::shared_ptr<const MappedFile> file;
+    // NOTE: procfs and sysfs files are regular but report size 0 whatever they hold, so files without
+    // a size are left to the read path, just like pipes
+    if (fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode) && fileStat.st_size > 0) {
+        const auto size = static_cast<size_t>(fileStat.st_size);
+        if (auto* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0); data != MAP_FAILED) {
+            // files are mostly read front to back, let the kernel read ahead and drop pages behind
+            madvise(data, size, MADV_SEQUENTIAL);
+            file = std::make_shared<MappedFile>(static_cast<const char*>(data), size);
+        }
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    return file;
+}
+
+MappedFile::MappedFile(const char* data, size_t size)
+    : m_data(data)
+    , m_size(size)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+std::string_view MappedFile::view() const
+{
+    return std::string_view(m_data, m_size);
+}
+
+} // namespace mal
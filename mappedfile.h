@@ -0,0 +1,33 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace mal {
+
+// Read-only mapping of a whole regular file. Readers view its pages instead of copying the content,
+// the mapping lives while anything holds it.
+// NOTE: truncating the file while it is mapped makes reads past its new end fault, and later writes to
+// the file show through the mapping. Only code that is done with the file before returning (load-file,
+// load-data) reads from it in place, values that outlive the call copy what they keep
+class MappedFile {
+public:
+    // nullptr if the file couldn't be opened, isn't a regular file (a pipe or a device can't be mapped)
+    // or is empty, which procfs files claim to be
+    static std::shared_ptr<const MappedFile> open(const std::string& path);
+
+    MappedFile(const char* data, size_t size);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const;
+
+private:
+    const char* m_data;
+    size_t m_size;
+};
+
+} // namespace mal
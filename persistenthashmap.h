@@ -0,0 +1,289 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace mal {
+
+// Immutable hash map, hash array mapped trie consuming 5 bits of the hash per level.
+// Every node keeps its entries and its subnodes in separate arrays indexed by popcount of a bitmap,
+// keys whose whole hash collide end up in a plain list at the bottom of the trie.
+// Trie shape depends only on the keys (up to full collisions), so maps with the same keys iterate in the same order.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class PersistentHashMap {
+    static constexpr size_t bits = 5;
+    static constexpr size_t mask = (size_t { 1 } << bits) - 1;
+    static constexpr size_t hashBits = sizeof(size_t) * 8;
+
+public:
+    using Entry = std::pair<Key, Value>;
+
+private:
+    struct Node {
+        uint32_t dataMap { 0 };
+        uint32_t nodeMap { 0 };
+        std::vector<Entry> entries;
+        std::vector<std::shared_ptr<Node>> children;
+    };
+
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Entry*;
+        using reference = const Entry&;
+
+        const_iterator() = default;
+        explicit const_iterator(const Node* root)
+        {
+            if (root) {
+                m_stack.push_back({ root, 0 });
+                settle();
+            }
+        }
+
+        const Entry& operator*() const { return m_stack.back().first->entries[m_stack.back().second]; }
+        const Entry* operator->() const { return &**this; }
+
+        const_iterator& operator++()
+        {
+            ++m_stack.back().second;
+            settle();
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            if (m_stack.empty() || other.m_stack.empty()) {
+                return m_stack.empty() == other.m_stack.empty();
+            }
+            return m_stack.back() == other.m_stack.back();
+        }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        // Position within a node walks its entries first and then its subnodes,
+        // settle() descends until position points to an entry.
+        void settle()
+        {
+            while (!m_stack.empty()) {
+                auto& [node, position] = m_stack.back();
+                if (position < node->entries.size()) {
+                    return;
+                }
+                if (const auto childIndex = position - node->entries.size(); childIndex < node->children.size()) {
+                    ++position;
+                    const auto* child = node->children[childIndex].get();
+                    m_stack.push_back({ child, 0 });
+                    continue;
+                }
+                m_stack.pop_back();
+            }
+        }
+
+    private:
+        std::vector<std::pair<const Node*, size_t>> m_stack;
+    };
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const_iterator begin() const { return const_iterator(m_root.get()); }
+    const_iterator end() const { return const_iterator(); }
+
+    bool sharesStructureWith(const PersistentHashMap& other) const { return m_root == other.m_root; }
+
+    const Value* find(const Key& key) const
+    {
+        const auto hash = Hash {}(key);
+        const Node* node = m_root.get();
+        for (size_t shift = 0; node; shift += bits) {
+            if (isCollisionNode(shift)) {
+                for (const auto& entry : node->entries) {
+                    if (KeyEqual {}(entry.first, key)) {
+                        return &entry.second;
+                    }
+                }
+                return nullptr;
+            }
+            const auto bit = bitFor(hash, shift);
+            if (node->dataMap & bit) {
+                const auto& entry = node->entries[indexOf(node->dataMap, bit)];
+                return KeyEqual {}(entry.first, key) ? &entry.second : nullptr;
+            }
+            if (!(node->nodeMap & bit)) {
+                return nullptr;
+            }
+            node = node->children[indexOf(node->nodeMap, bit)].get();
+        }
+        return nullptr;
+    }
+
+    PersistentHashMap insert(Key key, Value value) const
+    {
+        PersistentHashMap result = *this;
+        bool added = false;
+        const auto hash = Hash {}(key);
+        result.m_root = insertInto(m_root, 0, hash, Entry(std::move(key), std::move(value)), added);
+        result.m_size += added;
+        return result;
+    }
+
+    // Same as insert, but nodes no other map shares are updated in place instead of being copied,
+    // so building a fresh map key by key doesn't copy its root over and over
+    void insertInPlace(Key key, Value value)
+    {
+        bool added = false;
+        const auto hash = Hash {}(key);
+        m_root = insertInto(std::move(m_root), 0, hash, Entry(std::move(key), std::move(value)), added);
+        m_size += added;
+    }
+
+    PersistentHashMap erase(const Key& key) const
+    {
+        if (!m_root) {
+            return *this;
+        }
+        PersistentHashMap result = *this;
+        bool removed = false;
+        result.m_root = eraseFrom(m_root, 0, Hash {}(key), key, removed);
+        result.m_size -= removed;
+        return result;
+    }
+
+private:
+    static bool isCollisionNode(size_t shift) { return shift >= hashBits; }
+    static uint32_t bitFor(size_t hash, size_t shift) { return uint32_t { 1 } << ((hash >> shift) & mask); }
+    static size_t indexOf(uint32_t bitmap, uint32_t bit) { return std::popcount(bitmap & (bit - 1)); }
+
+    // Node is reused if nothing else refers to it, copied otherwise
+    static std::shared_ptr<Node> insertInto(std::shared_ptr<Node> node, size_t shift, size_t hash, Entry entry, bool& added)
+    {
+        auto result = !node ? std::make_shared<Node>() : node.use_count() == 1 ? std::move(node) : std::make_shared<Node>(*node);
+        if (isCollisionNode(shift)) {
+            for (auto& existing : result->entries) {
+                if (KeyEqual {}(existing.first, entry.first)) {
+                    existing.second = std::move(entry.second);
+                    return result;
+                }
+            }
+            result->entries.push_back(std::move(entry));
+            added = true;
+            return result;
+        }
+
+        const auto bit = bitFor(hash, shift);
+        if (result->dataMap & bit) {
+            const auto entryIndex = indexOf(result->dataMap, bit);
+            if (KeyEqual {}(result->entries[entryIndex].first, entry.first)) {
+                result->entries[entryIndex].second = std::move(entry.second);
+                return result;
+            }
+            // slot is taken by another key, both of them move one level down
+            auto existing = std::move(result->entries[entryIndex]);
+            const auto existingHash = Hash {}(existing.first);
+            result->entries.erase(result->entries.begin() + entryIndex);
+            result->dataMap ^= bit;
+            result->nodeMap |= bit;
+            result->children.insert(result->children.begin() + indexOf(result->nodeMap, bit),
+                mergeEntries(shift + bits, std::move(existing), existingHash, std::move(entry), hash));
+            added = true;
+        } else if (result->nodeMap & bit) {
+            auto& child = result->children[indexOf(result->nodeMap, bit)];
+            child = insertInto(std::move(child), shift + bits, hash, std::move(entry), added);
+        } else {
+            result->dataMap |= bit;
+            result->entries.insert(result->entries.begin() + indexOf(result->dataMap, bit), std::move(entry));
+            added = true;
+        }
+        return result;
+    }
+
+    static std::shared_ptr<Node> mergeEntries(size_t shift, Entry lhs, size_t lhsHash, Entry rhs, size_t rhsHash)
+    {
+        auto node = std::make_shared<Node>();
+        if (isCollisionNode(shift)) {
+            node->entries.push_back(std::move(lhs));
+            node->entries.push_back(std::move(rhs));
+            return node;
+        }
+
+        const auto lhsBit = bitFor(lhsHash, shift);
+        const auto rhsBit = bitFor(rhsHash, shift);
+        if (lhsBit == rhsBit) {
+            node->nodeMap = lhsBit;
+            node->children.push_back(mergeEntries(shift + bits, std::move(lhs), lhsHash, std::move(rhs), rhsHash));
+        } else {
+            node->dataMap = lhsBit | rhsBit;
+            if (lhsBit > rhsBit) {
+                std::swap(lhs, rhs);
+            }
+            node->entries.push_back(std::move(lhs));
+            node->entries.push_back(std::move(rhs));
+        }
+        return node;
+    }
+
+    static std::shared_ptr<Node> eraseFrom(const std::shared_ptr<Node>& node, size_t shift, size_t hash, const Key& key, bool& removed)
+    {
+        if (isCollisionNode(shift)) {
+            for (size_t entryIndex = 0; entryIndex < node->entries.size(); ++entryIndex) {
+                if (KeyEqual {}(node->entries[entryIndex].first, key)) {
+                    auto result = std::make_shared<Node>(*node);
+                    result->entries.erase(result->entries.begin() + entryIndex);
+                    removed = true;
+                    return result;
+                }
+            }
+            return node;
+        }
+
+        const auto bit = bitFor(hash, shift);
+        if (node->dataMap & bit) {
+            const auto entryIndex = indexOf(node->dataMap, bit);
+            if (!KeyEqual {}(node->entries[entryIndex].first, key)) {
+                return node;
+            }
+            auto result = std::make_shared<Node>(*node);
+            result->entries.erase(result->entries.begin() + entryIndex);
+            result->dataMap ^= bit;
+            removed = true;
+            return result;
+        }
+
+        if (node->nodeMap & bit) {
+            const auto childIndex = indexOf(node->nodeMap, bit);
+            auto newChild = eraseFrom(node->children[childIndex], shift + bits, hash, key, removed);
+            if (!removed) {
+                return node;
+            }
+            auto result = std::make_shared<Node>(*node);
+            // NOTE: subnode left with single entry is inlined back, so the shape stays the same
+            // as if the erased key was never inserted
+            if (newChild->children.empty() && newChild->entries.size() == 1) {
+                result->children.erase(result->children.begin() + childIndex);
+                result->nodeMap ^= bit;
+                result->dataMap |= bit;
+                result->entries.insert(result->entries.begin() + indexOf(result->dataMap, bit), newChild->entries.front());
+            } else {
+                result->children[childIndex] = std::move(newChild);
+            }
+            return result;
+        }
+        return node;
+    }
+
+private:
+    size_t m_size { 0 };
+    std::shared_ptr<Node> m_root;
+};
+
+} // namespace mal
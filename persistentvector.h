@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace mal {
+
+// Immutable vector, 32-way trie of full leaves plus a tail buffer for the last (up to 32) elements.
+// Every update returns new version that shares all untouched nodes with the old one.
+template <typename T>
+class PersistentVector {
+    static constexpr size_t bits = 5;
+    static constexpr size_t width = size_t { 1 } << bits;
+    static constexpr size_t mask = width - 1;
+
+    struct Node {
+        std::vector<std::shared_ptr<Node>> children;
+        std::vector<T> values;
+    };
+    using Tail = std::vector<T>;
+
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator(const PersistentVector* vector, size_t index)
+            : m_vector(vector)
+            , m_index(index)
+        {
+        }
+
+        const T& operator*() const
+        {
+            if (!m_block || m_index - m_blockStart >= width) {
+                m_block = m_vector->blockFor(m_index);
+                m_blockStart = m_index & ~mask;
+            }
+            return m_block[m_index - m_blockStart];
+        }
+
+        const_iterator& operator++()
+        {
+            ++m_index;
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const const_iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        const PersistentVector* m_vector;
+        size_t m_index;
+        // NOTE: elements of one leaf are contiguous, so block lookup is done once per 32 elements
+        mutable const T* m_block { nullptr };
+        mutable size_t m_blockStart { 0 };
+    };
+
+    PersistentVector()
+        : m_tail(makeTail())
+    {
+    }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const T& operator[](size_t index) const
+    {
+        return blockFor(index)[index & mask];
+    }
+
+    const T& back() const { return (*this)[m_size - 1]; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_size); }
+    const_iterator iteratorAt(size_t index) const { return const_iterator(this, index); }
+
+    // Both versions see the same nodes, elements at indices below both sizes are the same
+    bool sharesStructureWith(const PersistentVector& other) const
+    {
+        return m_root == other.m_root && m_tail == other.m_tail;
+    }
+
+    PersistentVector pushBack(T value) const
+    {
+        PersistentVector result = *this;
+        const auto tailSize = m_size - tailOffset();
+
+        if (tailSize < width) {
+            // NOTE: if this version ends where the shared tail does, older versions don't see
+            // elements past their own size, so the tail could be extended in place.
+            if (m_tail->size() != tailSize) {
+                result.m_tail = makeTail(m_tail->begin(), m_tail->begin() + tailSize);
+            }
+            result.m_tail->push_back(std::move(value));
+            ++result.m_size;
+            return result;
+        }
+
+        auto tailNode = std::make_shared<Node>();
+        tailNode->values = *m_tail;
+
+        // root overflow, tree grows one level up
+        if ((m_size >> bits) > (size_t { 1 } << m_shift)) {
+            result.m_root = std::make_shared<Node>();
+            result.m_root->children.push_back(m_root);
+            result.m_root->children.push_back(newPath(m_shift, tailNode));
+            result.m_shift = m_shift + bits;
+        } else {
+            result.m_root = pushTail(m_shift, m_root, tailNode);
+        }
+
+        result.m_tail = makeTail();
+        result.m_tail->push_back(std::move(value));
+        ++result.m_size;
+        return result;
+    }
+
+    PersistentVector assoc(size_t index, T value) const
+    {
+        if (index == m_size) {
+            return pushBack(std::move(value));
+        }
+
+        PersistentVector result = *this;
+        if (index >= tailOffset()) {
+            result.m_tail = makeTail(m_tail->begin(), m_tail->begin() + (m_size - tailOffset()));
+            (*result.m_tail)[index & mask] = std::move(value);
+            return result;
+        }
+        result.m_root = assocPath(m_shift, m_root, index, std::move(value));
+        return result;
+    }
+
+private:
+    // NOTE: tail never reallocates, elements handed out by reference stay valid
+    // while newer versions append to the shared tail
+    template <typename... Elements>
+    static std::shared_ptr<Tail> makeTail(Elements... elements)
+    {
+        auto tail = std::make_shared<Tail>();
+        tail->reserve(width);
+        if constexpr (sizeof...(elements) != 0) {
+            tail->assign(elements...);
+        }
+        return tail;
+    }
+
+    size_t tailOffset() const
+    {
+        return m_size < width ? 0 : ((m_size - 1) >> bits) << bits;
+    }
+
+    const T* blockFor(size_t index) const
+    {
+        if (index >= tailOffset()) {
+            return m_tail->data();
+        }
+        const Node* node = m_root.get();
+        for (size_t level = m_shift; level > 0; level -= bits) {
+            node = node->children[(index >> level) & mask].get();
+        }
+        return node->values.data();
+    }
+
+    static std::shared_ptr<Node> newPath(size_t level, std::shared_ptr<Node> node)
+    {
+        if (level == 0) {
+            return node;
+        }
+        auto path = std::make_shared<Node>();
+        path->children.push_back(newPath(level - bits, std::move(node)));
+        return path;
+    }
+
+    std::shared_ptr<Node> pushTail(size_t level, const std::shared_ptr<Node>& parent, std::shared_ptr<Node> tailNode) const
+    {
+        auto result = parent ? std::make_shared<Node>(*parent) : std::make_shared<Node>();
+        const auto childIndex = ((m_size - 1) >> level) & mask;
+        if (level == bits) {
+            result->children.push_back(std::move(tailNode));
+        } else if (childIndex < result->children.size()) {
+            result->children[childIndex] = pushTail(level - bits, result->children[childIndex], std::move(tailNode));
+        } else {
+            result->children.push_back(newPath(level - bits, std::move(tailNode)));
+        }
+        return result;
+    }
+
+    static std::shared_ptr<Node> assocPath(size_t level, const std::shared_ptr<Node>& node, size_t index, T value)
+    {
+        auto result = std::make_shared<Node>(*node);
+        if (level == 0) {
+            result->values[index & mask] = std::move(value);
+        } else {
+            const auto childIndex = (index >> level) & mask;
+            result->children[childIndex] = assocPath(level - bits, node->children[childIndex], index, std::move(value));
+        }
+        return result;
+    }
+
+private:
+    size_t m_size { 0 };
+    size_t m_shift { bits };
+    std::shared_ptr<Node> m_root;
+    std::shared_ptr<Tail> m_tail;
+};
+
+} // namespace mal
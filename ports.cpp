@@ -0,0 +1,243 @@
+#include "ports.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mal {
+
+std::shared_ptr<OutputPort> OutputPort::open(const std::string& path, bool append)
+{
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return std::make_shared<OutputPort>(fd, true, path);
+}
+
+const std::shared_ptr<OutputPort>& OutputPort::standardOutput()
+{
+    // NOTE: the port itself is a static, so it is flushed at exit even if a value holding it leaks
+    static OutputPort port(STDOUT_FILENO, false, "stdout");
+    static const std::shared_ptr<OutputPort> sharedPort(&port, [](OutputPort*) { });
+    return sharedPort;
+}
+
+const std::shared_ptr<OutputPort>& OutputPort::standardError()
+{
+    static OutputPort port(STDERR_FILENO, false, "stderr", true, standardOutput().get());
+    static const std::shared_ptr<OutputPort> sharedPort(&port, [](OutputPort*) { });
+    return sharedPort;
+}
+
+OutputPort::OutputPort(int fd, bool ownsDescriptor, std::string name, bool isUnbuffered, OutputPort* tied)
+    : m_fd(fd)
+    , m_ownsDescriptor(ownsDescriptor)
+    , m_name(std::move(name))
+    , m_isUnbuffered(isUnbuffered)
+    , m_tied(tied)
+{
+    if (!m_isUnbuffered) {
+        m_buffer.reserve(bufferSize);
+    }
+}
+
+OutputPort::~OutputPort()
+{
+    close();
+}
+
+const std::string& OutputPort::name() const
+{
+    return m_name;
+}
+
+bool OutputPort::isClosed() const
+{
+    return m_fd < 0;
+}
+
+std::string& OutputPort::buffer()
+{
+    return m_buffer;
+}
+
+void OutputPort::write(std::string_view text)
+{
+    if (m_isUnbuffered) {
+        flush();
+        writeAll(text);
+        return;
+    }
+    // text that wouldn't fit goes out right after the buffer instead of being copied through it
+    if (m_buffer.size() + text.size() > bufferSize) {
+        if (flush() && text.size() >= bufferSize) {
+            writeAll(text);
+            return;
+        }
+    }
+    m_buffer += text;
+}
+
+void OutputPort::flushIfFull()
+{
+    if (m_buffer.size() >= bufferSize || (m_isUnbuffered && !m_buffer.empty())) {
+        flush();
+    }
+}
+
+bool OutputPort::flush()
+{
+    const bool isWritten = writeAll(m_buffer);
+    m_buffer.clear();
+    return isWritten;
+}
+
+bool OutputPort::close()
+{
+    if (isClosed()) {
+        return true;
+    }
+    bool isFlushed = flush();
+    if (m_ownsDescriptor) {
+        isFlushed = ::close(m_fd) == 0 && isFlushed;
+        m_fd = -1;
+    }
+    return isFlushed;
+}
+
+bool OutputPort::writeAll(std::string_view data)
+{
+    if (isClosed()) {
+        return data.empty();
+    }
+    // what was printed to the tied port before comes out first
+    if (m_tied && !data.empty()) {
+        m_tied->flush();
+    }
+    while (!data.empty()) {
+        const auto written = ::write(m_fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
+
+std::shared_ptr<InputPort> InputPort::open(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    // lines are read front to back
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return std::make_shared<InputPort>(fd, true, path);
+}
+
+const std::shared_ptr<InputPort>& InputPort::standardInput()
+{
+    static const auto port = std::make_shared<InputPort>(STDIN_FILENO, false, "stdin", OutputPort::standardOutput().get());
+    return port;
+}
+
+InputPort::InputPort(int fd, bool ownsDescriptor, std::string name, OutputPort* tied)
+    : m_fd(fd)
+    , m_ownsDescriptor(ownsDescriptor)
+    , m_name(std::move(name))
+    , m_tied(tied)
+    , m_buffer(bufferSize, '\0')
+{
+}
+
+InputPort::~InputPort()
+{
+    close();
+}
+
+const std::string& InputPort::name() const
+{
+    return m_name;
+}
+
+bool InputPort::isClosed() const
+{
+    return m_fd < 0;
+}
+
+std::optional<std::string_view> InputPort::readLine()
+{
+    // only the bytes read since the last search are looked at again
+    size_t searchFrom = m_begin;
+    for (;;) {
+        if (const auto* newline = static_cast<const char*>(memchr(m_buffer.data() + searchFrom, '\n', m_end - searchFrom)); newline) {
+            const auto lineEnd = static_cast<size_t>(newline - m_buffer.data());
+            std::string_view line(m_buffer.data() + m_begin, lineEnd - m_begin);
+            m_begin = lineEnd + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            return line;
+        }
+        // fill moves unread bytes to the front, they have no newline
+        const auto searchedSize = m_end - m_begin;
+        if (!fill()) {
+            break;
+        }
+        searchFrom = m_begin + searchedSize;
+    }
+    // the last line may have no newline
+    if (m_begin == m_end) {
+        return std::nullopt;
+    }
+    std::string_view line(m_buffer.data() + m_begin, m_end - m_begin);
+    m_begin = m_end;
+    return line;
+}
+
+void InputPort::close()
+{
+    if (!isClosed() && m_ownsDescriptor) {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+    m_begin = m_end = 0;
+}
+
+bool InputPort::fill()
+{
+    if (m_isAtEnd || isClosed()) {
+        return false;
+    }
+    // unread bytes move to the front, the buffer grows only when a single line fills all of it
+    if (m_begin != 0) {
+        std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if (m_end == m_buffer.size()) {
+        m_buffer.resize(m_buffer.size() * 2);
+    }
+    if (m_tied) {
+        m_tied->flush();
+    }
+    for (;;) {
+        const auto bytesRead = ::read(m_fd, m_buffer.data() + m_end, m_buffer.size() - m_end);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            m_isAtEnd = true;
+            return false;
+        }
+        m_end += static_cast<size_t>(bytesRead);
+        return true;
+    }
+}
+
+} // namespace mal
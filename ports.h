@@ -0,0 +1,96 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace mal {
+
+// Buffered output into a file descriptor. Writes are collected in a buffer that is written out with
+// a single syscall once it fills up, on flush and on close, nothing flushes per line.
+// NOTE: standard ports live until exit and flush then, a file port flushes when it is closed or dropped.
+// The stderr port is unbuffered and tied to stdout, which is flushed before every write to stderr,
+// so diagnostics go out right away and after the output printed before them.
+class OutputPort {
+public:
+    static constexpr size_t bufferSize = 64 * 1024;
+
+    // nullptr if the file couldn't be opened, it is truncated unless append is set
+    static std::shared_ptr<OutputPort> open(const std::string& path, bool append);
+    static const std::shared_ptr<OutputPort>& standardOutput();
+    static const std::shared_ptr<OutputPort>& standardError();
+
+    OutputPort(int fd, bool ownsDescriptor, std::string name, bool isUnbuffered = false, OutputPort* tied = nullptr);
+    ~OutputPort();
+
+    OutputPort(const OutputPort&) = delete;
+    OutputPort& operator=(const OutputPort&) = delete;
+
+    const std::string& name() const;
+    bool isClosed() const;
+
+    // Printer appends to the buffer directly and calls flushIfFull after every piece,
+    // an unbuffered port counts as full once it holds anything
+    std::string& buffer();
+    void write(std::string_view text);
+    void flushIfFull();
+    // false if the descriptor didn't take the whole buffer, what was not written is dropped
+    bool flush();
+    // Flushes and closes a port that owns its descriptor, standard ports are only flushed
+    bool close();
+
+private:
+    bool writeAll(std::string_view data);
+
+private:
+    int m_fd;
+    bool m_ownsDescriptor;
+    std::string m_name;
+    bool m_isUnbuffered;
+    OutputPort* m_tied;
+    std::string m_buffer;
+};
+
+// Buffered line input from a file descriptor, lines are cut out of a buffer that is refilled
+// with a single read of up to bufferSize bytes, grown only for lines longer than that.
+class InputPort {
+public:
+    static constexpr size_t bufferSize = 64 * 1024;
+
+    // nullptr if the file couldn't be opened
+    static std::shared_ptr<InputPort> open(const std::string& path);
+    // Tied to standard output, which is flushed before every read so prompts show up
+    static const std::shared_ptr<InputPort>& standardInput();
+
+    InputPort(int fd, bool ownsDescriptor, std::string name, OutputPort* tied = nullptr);
+    ~InputPort();
+
+    InputPort(const InputPort&) = delete;
+    InputPort& operator=(const InputPort&) = delete;
+
+    const std::string& name() const;
+    bool isClosed() const;
+
+    // Next line without "\n" or "\r\n", nullopt at the end of input.
+    // NOTE: the view is valid until the next read from the port
+    std::optional<std::string_view> readLine();
+    void close();
+
+private:
+    // Reads more input after the buffered bytes, false at the end of input or on error
+    bool fill();
+
+private:
+    int m_fd;
+    bool m_ownsDescriptor;
+    std::string m_name;
+    OutputPort* m_tied;
+    std::string m_buffer;
+    // unread input is m_buffer[m_begin, m_end)
+    size_t m_begin { 0 };
+    size_t m_end { 0 };
+    bool m_isAtEnd { false };
+};
+
+} // namespace mal
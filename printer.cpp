@@ -0,0 +1,79 @@
+#include "printer.h"
+
+#include "maltypes.h"
+#include "ports.h"
+#include "simd.h"
+
+namespace mal {
+
+Printer::Printer(std::string& out, bool readably, Limits limits)
+    : m_out(&out)
+    , m_readably(readably)
+    , m_limits(limits)
+{
+}
+
+Printer::Printer(OutputPort& port, bool readably, Limits limits)
+    : m_out(&port.buffer())
+    , m_port(&port)
+    , m_readably(readably)
+    , m_limits(limits)
+{
+}
+
+bool Printer::isReadable() const
+{
+    return m_readably;
+}
+
+const Printer::Limits& Printer::limits() const
+{
+    return m_limits;
+}
+
+void Printer::print(const MalType& value)
+{
+    value.print(*this);
+}
+
+void Printer::write(std::string_view text)
+{
+    // a port writes big pieces out right away instead of copying them through its buffer
+    if (m_port) {
+        m_port->write(text);
+        return;
+    }
+    *m_out += text;
+}
+
+void Printer::write(char symbol)
+{
+    *m_out += symbol;
+    flushIfFull();
+}
+
+void Printer::writeEscaped(std::string_view text)
+{
+    // runs without special bytes are copied at once, the classifier finds the next special byte
+    simd::TextClassifier classifier(text, { "\"\\\n" });
+    for (size_t position = 0; position < text.size();) {
+        const auto special = classifier.findFirstOf(position, 0);
+        *m_out += text.substr(position, special - position);
+        if (special == text.size()) {
+            break;
+        }
+        *m_out += text[special] == '\n' ? std::string_view("\\n") : text[special] == '"' ? std::string_view("\\\"") : std::string_view("\\\\");
+        position = special + 1;
+        flushIfFull();
+    }
+    flushIfFull();
+}
+
+void Printer::flushIfFull()
+{
+    if (m_port) {
+        m_port->flushIfFull();
+    }
+}
+
+} // namespace mal
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace mal {
+class MalType;
+class OutputPort;
+
+// Output of printed values. Values print themselves piece by piece, either right into a string
+// or into the buffer of an output port, which is written out whenever it fills up, so printing
+// a big structure to a port never builds its whole text.
+class Printer {
+public:
+    struct Limits {
+        // elements of a collection printed before "..."
+        std::optional<size_t> length;
+        // collections nested deeper than that are printed as "#"
+        std::optional<size_t> level;
+    };
+
+    // Appends to out, readably quotes and escapes strings
+    Printer(std::string& out, bool readably, Limits limits = {});
+    // Appends to the buffer of port, it is flushed only once full
+    Printer(OutputPort& port, bool readably, Limits limits = {});
+
+    Printer(const Printer&) = delete;
+    Printer& operator=(const Printer&) = delete;
+
+    bool isReadable() const;
+    const Limits& limits() const;
+
+    void print(const MalType& value);
+    void write(std::string_view text);
+    void write(char symbol);
+    // Escapes quotes, backslashes and newlines, the quotes around are up to the caller
+    void writeEscaped(std::string_view text);
+
+    // Prints open, elements separated by spaces and close, honoring limits. forEach(element) calls
+    // element(printElement) for every element of the collection and stops once it returns false,
+    // printElement() prints the element itself.
+    template <typename ForEach>
+    void printCollection(char open, char close, ForEach forEach)
+    {
+        if (m_limits.level && m_depth >= *m_limits.level) {
+            write('#');
+            return;
+        }
+        ++m_depth;
+        write(open);
+        size_t printedCount = 0;
+        forEach([&](auto printElement) {
+            if (printedCount != 0) {
+                write(' ');
+            }
+            if (m_limits.length && printedCount == *m_limits.length) {
+                write("...");
+                return false;
+            }
+            printElement();
+            ++printedCount;
+            return true;
+        });
+        write(close);
+        --m_depth;
+    }
+
+private:
+    void flushIfFull();
+
+private:
+    std::string* m_out;
+    OutputPort* m_port { nullptr };
+    bool m_readably;
+    Limits m_limits;
+    size_t m_depth { 0 };
+};
+
+} // namespace mal
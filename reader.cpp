@@ -1,34 +1,260 @@
-#include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "maltypes.h"
 #include "reader.h"
 
 namespace mal {
 
-Reader::Reader(const std::vector<Token>& tokens)
-    : m_tokens(tokens)
+Reader::Reader(std::string_view program, SourcePosition start)
+    : m_lexer(program, start)
+    , m_current(m_lexer.next())
 {
 }
 
-Token Reader::next() const
+Token Reader::next()
 {
-    return m_tokens[m_currentIndex++];
+    const auto current = m_current;
+    if (current.type != TokenType::LAST_TOKEN) {
+        m_current = m_lexer.next();
+    }
+    return current;
 }
 
 Token Reader::peek() const
 {
-    return m_tokens[m_currentIndex];
+    return m_current;
+}
+
+std::string Reader::positionOf(const Token& token) const
+{
+    const auto [line, column] = m_lexer.positionOf(token);
+    return "line " + std::to_string(line) + ", column " + std::to_string(column);
+}
+
+namespace {
+// Follows nesting of tokens to tell which of them end top level forms
+class FormBoundaries {
+public:
+    bool endsForm(const Token& token)
+    {
+        switch (token.type) {
+        case TokenType::LEFT_PAREN:
+        case TokenType::LEFT_SQUARE_BRACE:
+        case TokenType::LEFT_CURLY_BRACE:
+            ++m_depth;
+            return false;
+        case TokenType::RIGHT_PAREN:
+        case TokenType::RIGHT_SQUARE_BACE:
+        case TokenType::RIGHT_CURLY_BRACE:
+            m_depth -= m_depth > 0;
+            break;
+        case TokenType::MACRO:
+            if (m_depth == 0) {
+                // the macro itself is the form an outer macro waited for, ^ waits for metadata and a form
+                m_awaitedForms = m_awaitedForms - (m_awaitedForms > 0) + (token.token == "^" ? 2 : 1);
+            }
+            return false;
+        default:
+            break;
+        }
+        if (m_depth != 0) {
+            return false;
+        }
+        m_awaitedForms -= m_awaitedForms > 0;
+        return m_awaitedForms == 0;
+    }
+
+private:
+    size_t m_depth { 0 };
+    // forms a top level reader macro still waits for
+    size_t m_awaitedForms { 0 };
+};
+
+size_t endOf(std::string_view text, const Token& token)
+{
+    return token.token.data() + token.token.size() - text.data();
+}
+
+// End of the complete top level forms at the start of text, 0 if there are none. The last token is
+// never counted, it might be cut by the end of the buffer (a symbol, a number or a string that continues further).
+size_t completeFormsEnd(std::string_view text)
+{
+    Lexer lexer(text);
+    FormBoundaries boundaries;
+    size_t end = 0;
+    for (auto token = lexer.next(), nextToken = lexer.next(); nextToken.type != TokenType::LAST_TOKEN; token = nextToken, nextToken = lexer.next()) {
+        if (boundaries.endsForm(token)) {
+            end = endOf(text, token);
+        }
+    }
+    return end;
+}
+
+// Splits text into pieces of whole top level forms, at least minSize long except for the last one
+std::vector<std::string_view> splitIntoForms(std::string_view text, size_t minSize)
+{
+    std::vector<std::string_view> pieces;
+    Lexer lexer(text);
+    FormBoundaries boundaries;
+    size_t pieceStart = 0;
+    for (auto token = lexer.next(); token.type != TokenType::LAST_TOKEN; token = lexer.next()) {
+        if (const auto end = endOf(text, token); boundaries.endsForm(token) && end - pieceStart >= minSize) {
+            pieces.push_back(text.substr(pieceStart, end - pieceStart));
+            pieceStart = end;
+        }
+    }
+    if (pieceStart < text.size()) {
+        pieces.push_back(text.substr(pieceStart));
+    }
+    return pieces;
+}
+
+// Forms of a piece in order, reading stops at the first parse error, it is the last element then
+std::vector<std::shared_ptr<MalType>> readPiece(std::string_view piece, SourcePosition start)
+{
+    std::vector<std::shared_ptr<MalType>> forms;
+    Reader reader(piece, start);
+    while (reader.peek().type != TokenType::LAST_TOKEN) {
+        forms.push_back(readFrom(reader));
+        if (forms.back()->is<MalException>()) {
+            break;
+        }
+        reader.next();
+    }
+    return forms;
+}
+
+std::shared_ptr<MalType> unexpectedToken(const Reader& reader, const Token& token)
+{
+    return MalException::throwException("unexpected '" + std::string(token.token) + "' at " + reader.positionOf(token));
+}
+
+// Reads forms up to the closing token and passes them to addForm, the reader stays at the closing token
+template <typename AddForm>
+std::shared_ptr<MalType> readSequence(Reader& reader, TokenType closingType, std::string_view closing, AddForm addForm)
+{
+    const auto opening = reader.next();
+    while (reader.peek().type != closingType) {
+        if (reader.peek().type == TokenType::LAST_TOKEN) {
+            return MalException::throwException("unbalanced '" + std::string(opening.token) + "' at " + reader.positionOf(opening)
+                + ": expected '" + std::string(closing) + "', got EOF");
+        }
+        if (auto form = readFrom(reader); form->is<MalException>()) {
+            return form;
+        } else {
+            addForm(std::move(form));
+        }
+        reader.next();
+    }
+    return nullptr;
+}
+}
+
+FormReader::FormReader(std::istream& input)
+    : m_input(&input)
+{
+}
+
+FormReader::FormReader(std::string_view text)
+{
+    m_reader.emplace(text);
+}
+
+std::shared_ptr<MalType> FormReader::next()
+{
+    const bool hasForm = m_reader && m_reader->peek().type != TokenType::LAST_TOKEN;
+    if (!hasForm && !readForms()) {
+        return nullptr;
+    }
+    auto form = readFrom(*m_reader);
+    m_reader->next();
+    return form;
+}
+
+// Drops forms that were read and buffers input until it has at least one more complete form
+bool FormReader::readForms()
+{
+    if (!m_input) {
+        return false;
+    }
+    m_reader.reset();
+    m_bufferStart = positionAfter(m_bufferStart, std::string_view(m_buffer).substr(0, m_readerEnd));
+    m_buffer.erase(0, m_readerEnd);
+    m_readerEnd = 0;
+
+    // a form that doesn't fit into a chunk is lexed again after every read, reads grow to keep that linear
+    for (auto readSize = chunkSize;; readSize *= 2) {
+        const auto bufferedSize = m_buffer.size();
+        m_buffer.resize(bufferedSize + readSize);
+        m_input->read(m_buffer.data() + bufferedSize, readSize);
+        m_buffer.resize(bufferedSize + m_input->gcount());
+
+        if (!*m_input) {
+            if (Lexer(m_buffer).next().type == TokenType::LAST_TOKEN) {
+                m_buffer.clear();
+                return false;
+            }
+            m_readerEnd = m_buffer.size();
+        } else {
+            m_readerEnd = completeFormsEnd(m_buffer);
+        }
+        if (m_readerEnd > 0) {
+            m_reader.emplace(std::string_view(m_buffer).substr(0, m_readerEnd), m_bufferStart);
+            return true;
+        }
+    }
 }
 
 std::shared_ptr<MalType> readStr(std::string_view program)
 {
-    Lexer lexer(program);
-    Reader reader(lexer.tokenize());
+    Reader reader(program);
     return readFrom(reader);
 }
 
-std::shared_ptr<MalType> readFrom(const Reader& reader)
+std::shared_ptr<MalType> readAll(std::string_view text)
+{
+    // the split is one lexer pass, reading builds values and takes most of the time
+    const auto pieces = splitIntoForms(text, parallelReadPieceSize);
+    std::vector<SourcePosition> starts(pieces.size());
+    for (size_t pieceIndex = 1; pieceIndex < pieces.size(); ++pieceIndex) {
+        starts[pieceIndex] = positionAfter(starts[pieceIndex - 1], pieces[pieceIndex - 1]);
+    }
+
+    std::vector<std::vector<std::shared_ptr<MalType>>> pieceForms(pieces.size());
+    std::atomic<size_t> nextPiece { 0 };
+    auto readPieces = [&]() {
+        for (auto pieceIndex = nextPiece++; pieceIndex < pieces.size(); pieceIndex = nextPiece++) {
+            pieceForms[pieceIndex] = readPiece(pieces[pieceIndex], starts[pieceIndex]);
+        }
+    };
+    const auto threadsCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), pieces.size());
+    std::vector<std::thread> threads;
+    for (size_t threadIndex = 1; threadIndex < threadsCount; ++threadIndex) {
+        threads.emplace_back(readPieces);
+    }
+    readPieces();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto forms = std::make_shared<MalVector>();
+    for (auto& piece : pieceForms) {
+        for (auto& form : piece) {
+            if (form->is<MalException>()) {
+                return form;
+            }
+            forms->append(std::move(form));
+        }
+    }
+    return forms;
+}
+
+std::shared_ptr<MalType> readFrom(Reader& reader)
 {
     const auto currentTokenType = reader.peek().type;
     switch (currentTokenType) {
@@ -40,87 +266,72 @@ std::shared_ptr<MalType> readFrom(const Reader& reader)
         return readHashMap(reader);
     case TokenType::MACRO:
         return readMacro(reader);
+    case TokenType::RIGHT_PAREN:
+    case TokenType::RIGHT_SQUARE_BACE:
+    case TokenType::RIGHT_CURLY_BRACE:
+        return unexpectedToken(reader, reader.peek());
     default:
         return readAtom(reader);
     }
 }
 
 // NOTE: We could return raw pointer, that will be adopted by callers
-std::shared_ptr<MalType> readAtom(const Reader& reader)
+std::shared_ptr<MalType> readAtom(Reader& reader)
 {
     const auto currentToken = reader.peek();
     switch (currentToken.type) {
     case TokenType::NUMBER:
-        return std::make_shared<MalNumber>(currentToken.token);
+        return MalNumber::fromString(currentToken.token);
     case TokenType::STRING:
-        return std::make_shared<MalString>(currentToken.token);
+        return std::make_shared<MalString>(MalString::unEscapeString(currentToken.token.substr(1, currentToken.token.size() - 2)));
     case TokenType::BOOLEAN:
         return std::make_shared<MalBoolean>(currentToken.token);
     case TokenType::NIL:
         return std::make_shared<MalNil>();
     case TokenType::KEYWORD:
-        return std::make_shared<MalSymbol>(currentToken.token, MalSymbol::SymbolType::KEYWORD);
+        return MalSymbol::intern(currentToken.token, MalSymbol::SymbolType::KEYWORD);
     case TokenType::ERROR_UNTERMINATED_STRING:
-        return std::make_shared<MalException>("Unterminated String");
+        return MalException::throwException("unbalanced string at " + reader.positionOf(currentToken) + ": expected '\"', got EOF");
     default:
-        return std::make_shared<MalSymbol>(currentToken.token);
+        return MalSymbol::intern(currentToken.token);
     }
 }
 
-std::shared_ptr<MalList> readList(const Reader& reader)
+std::shared_ptr<MalType> readList(Reader& reader)
 {
     auto malList = std::make_shared<MalList>();
-    // skip left paren
-    reader.next();
-
-    while (reader.peek().type != TokenType::RIGHT_PAREN
-        && reader.peek().type != TokenType::LAST_TOKEN) {
-        // TODO: do error checking
-        malList->append(readFrom(reader));
-        reader.next();
-    }
-    if (reader.peek().type == TokenType::LAST_TOKEN) {
-        std::cout << "unbalanced" << std::endl;
-        return std::make_shared<MalList>();
+    if (auto error = readSequence(reader, TokenType::RIGHT_PAREN, ")", [&](auto form) { malList->append(std::move(form)); }); error) {
+        return error;
     }
     return malList;
 }
 
-std::shared_ptr<MalVector> readVector(const Reader& reader)
+std::shared_ptr<MalType> readVector(Reader& reader)
 {
     auto malVector = std::make_shared<MalVector>();
-    reader.next();
-
-    while (reader.peek().type != TokenType::RIGHT_SQUARE_BACE
-        && reader.peek().type != TokenType::LAST_TOKEN) {
-        // TODO: do error checking
-        malVector->append(readFrom(reader));
-        reader.next();
-    }
-    if (reader.peek().type == TokenType::LAST_TOKEN) {
-        std::cout << "unbalanced" << std::endl;
-        return std::make_shared<MalVector>();
+    if (auto error = readSequence(reader, TokenType::RIGHT_SQUARE_BACE, "]", [&](auto form) { malVector->append(std::move(form)); }); error) {
+        return error;
     }
     return malVector;
 }
 
-std::shared_ptr<MalHashMap> readHashMap(const Reader& reader)
+std::shared_ptr<MalType> readHashMap(Reader& reader)
 {
     auto malHashMap = std::make_shared<MalHashMap>();
-    reader.next();
-
-    while (reader.peek().type != TokenType::RIGHT_CURLY_BRACE
-        && reader.peek().type != TokenType::LAST_TOKEN) {
-        // TODO: do error checking
-        const std::string key = readAtom(reader)->asString();
-        reader.next();
-        auto value = readFrom(reader);
-        malHashMap->insert(key, value);
-        reader.next();
+    std::shared_ptr<MalType> key;
+    auto addForm = [&](auto form) {
+        if (!key) {
+            key = std::move(form);
+        } else {
+            malHashMap->insert(std::exchange(key, nullptr), std::move(form));
+        }
+    };
+    const auto opening = reader.peek();
+    if (auto error = readSequence(reader, TokenType::RIGHT_CURLY_BRACE, "}", addForm); error) {
+        return error;
     }
-    if (reader.peek().type == TokenType::LAST_TOKEN) {
-        std::cout << "unbalanced" << std::endl;
-        return std::make_shared<MalHashMap>();
+    if (key) {
+        return MalException::throwException("odd number of forms in the map at " + reader.positionOf(opening));
     }
     return malHashMap;
 }
@@ -153,25 +364,39 @@ std::string expandMacro(const Token& currentToken)
     }
 }
 
-std::shared_ptr<MalType> readMacro(const Reader& reader)
+std::shared_ptr<MalType> readMacro(Reader& reader)
 {
     const auto currentToken = reader.next();
-    if (reader.peek().type == TokenType::LAST_TOKEN) {
-        const std::string error = " expect an arugment"; 
-        return MalException::throwException(currentToken.token.data() + error);
-    }
+    auto readArgument = [&]() -> std::shared_ptr<MalType> {
+        if (reader.peek().type == TokenType::LAST_TOKEN) {
+            const std::string macro(currentToken.token);
+            return MalException::throwException("reader macro " + macro + " at " + reader.positionOf(currentToken) + " expects an argument, got EOF");
+        }
+        return readFrom(reader);
+    };
 
     auto macroExpandedList = std::make_shared<MalList>();
-    macroExpandedList->append(std::make_shared<MalSymbol>(expandMacro(currentToken)));
+    macroExpandedList->append(MalSymbol::intern(expandMacro(currentToken)));
     if (currentToken.token == "^") {
-        auto metaInfo = readFrom(reader);
+        auto metaInfo = readArgument();
+        if (metaInfo->is<MalException>()) {
+            return metaInfo;
+        }
         reader.next();
-        macroExpandedList->append(readFrom(reader));
+        auto form = readArgument();
+        if (form->is<MalException>()) {
+            return form;
+        }
+        macroExpandedList->append(form);
         macroExpandedList->append(metaInfo);
     } else {
-        macroExpandedList->append(readFrom(reader));
+        auto form = readArgument();
+        if (form->is<MalException>()) {
+            return form;
+        }
+        macroExpandedList->append(form);
     }
     return macroExpandedList;
 }
 
-} // mal
\ No newline at end of file
+} // mal
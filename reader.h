@@ -1,7 +1,9 @@
 #pragma once
 
-#include <vector>
+#include <istream>
 #include <memory>
+#include <optional>
+#include <string>
 
 #include "lexer.h"
 
@@ -12,27 +14,62 @@ class MalList;
 class MalVector;
 class MalHashMap;
 
+// Pulls tokens from the lexer one at a time, the parser looks at the current token only
 class Reader {
 public:
-    Reader(const std::vector<Token>& tokens);
+    Reader(std::string_view program, SourcePosition start = {});
 
-    Token next() const;
+    // Returns the current token and moves to the next one
+    Token next();
     Token peek() const;
 
+    // "line L, column C" of a token, for parse errors
+    std::string positionOf(const Token& token) const;
+
 private:
-    const std::vector<Token> m_tokens;
-    mutable size_t m_currentIndex { 0 };
+    Lexer m_lexer;
+    Token m_current;
+};
+
+// Reads top level forms one at a time, so each of them could be evaluated before the next one is read.
+// Stream input is buffered in chunks, only the text of forms that are not read yet is kept.
+class FormReader {
+public:
+    static constexpr size_t chunkSize = 64 * 1024;
+
+    FormReader(std::istream& input);
+    // Text stays in place (a mapped file), forms are read right from it
+    FormReader(std::string_view text);
+
+    // nullptr once the input is over
+    std::shared_ptr<MalType> next();
+
+private:
+    bool readForms();
+
+private:
+    std::istream* m_input { nullptr };
+    std::string m_buffer;
+    // position of the start of the buffer in the input
+    SourcePosition m_bufferStart;
+    // reads complete forms at the start of the buffer, its tokens point into the buffer
+    std::optional<Reader> m_reader;
+    size_t m_readerEnd { 0 };
 };
 
 std::shared_ptr<MalType> readStr(std::string_view program);
 
-std::shared_ptr<MalType> readFrom(const Reader& reader);
-std::shared_ptr<MalType> readAtom(const Reader& reader);
-std::shared_ptr<MalList> readSymobl(const Reader& reader);
-std::shared_ptr<MalType> readMacro(const Reader& reader);
+// Text is split into pieces of whole top level forms that are read in parallel
+constexpr size_t parallelReadPieceSize = 1024 * 1024;
+// Vector of all top level forms of the text in order, the first parse error otherwise
+std::shared_ptr<MalType> readAll(std::string_view text);
+
+// Parse errors are returned as exceptions, readers stop at the last token of the form they read
+std::shared_ptr<MalType> readFrom(Reader& reader);
+std::shared_ptr<MalType> readAtom(Reader& reader);
+std::shared_ptr<MalType> readMacro(Reader& reader);
 
-// TODO: make one function for that
-std::shared_ptr<MalList> readList(const Reader& reader);
-std::shared_ptr<MalVector> readVector(const Reader& reader);
-std::shared_ptr<MalHashMap> readHashMap(const Reader& reader);
+std::shared_ptr<MalType> readList(Reader& reader);
+std::shared_ptr<MalType> readVector(Reader& reader);
+std::shared_ptr<MalType> readHashMap(Reader& reader);
 } // namespace mal
@@ -0,0 +1,344 @@
+#include "simd.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <experimental/simd>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MAL_SIMD_X86
+#endif
+
+namespace mal::simd {
+
+namespace {
+
+namespace stdx = std::experimental;
+
+template <typename T>
+using Batch = stdx::native_simd<T>;
+
+constexpr auto unaligned = stdx::element_aligned;
+
+// NOTE: integers are added as unsigned, so lanes wrap around instead of hitting undefined behaviour,
+// signed overflow of a + b = r shows up in the sign bit of (a ^ r) & (b ^ r)
+using Lanes = Batch<uint64_t>;
+
+const uint64_t* asUnsigned(const int64_t* values)
+{
+    return reinterpret_cast<const uint64_t*>(values);
+}
+
+bool signBitSet(const Lanes& lanes)
+{
+    return stdx::any_of((lanes >> 63) != 0);
+}
+
+template <typename T, typename Operation>
+void elementwise(const T* lhs, const T* rhs, T* out, size_t size, Operation operation)
+{
+    size_t index = 0;
+    for (; index + Batch<T>::size() <= size; index += Batch<T>::size()) {
+        operation(Batch<T>(lhs + index, unaligned), Batch<T>(rhs + index, unaligned)).copy_to(out + index, unaligned);
+    }
+    for (; index < size; ++index) {
+        out[index] = operation(lhs[index], rhs[index]);
+    }
+}
+
+template <typename T, typename Fold, typename Reduce>
+T fold(const T* values, size_t size, T initial, Fold foldBatch, Reduce reduce)
+{
+    Batch<T> accumulator = initial;
+    size_t index = 0;
+    for (; index + Batch<T>::size() <= size; index += Batch<T>::size()) {
+        accumulator = foldBatch(accumulator, Batch<T>(values + index, unaligned));
+    }
+    T result = reduce(accumulator);
+    for (; index < size; ++index) {
+        result = foldBatch(Batch<T>(result), Batch<T>(values[index]))[0];
+    }
+    return result;
+}
+
+template <typename T>
+void compareElements(const T* lhs, const T* rhs, int64_t* out, size_t size, Comparison comparison)
+{
+    using Flags = stdx::rebind_simd_t<int64_t, Batch<T>>;
+    auto holds = [comparison](const auto& lhsValue, const auto& rhsValue) {
+        switch (comparison) {
+        case Comparison::LESS:
+            return lhsValue < rhsValue;
+        case Comparison::GREATER:
+            return lhsValue > rhsValue;
+        default:
+            return lhsValue == rhsValue;
+        }
+    };
+
+    size_t index = 0;
+    for (; index + Batch<T>::size() <= size; index += Batch<T>::size()) {
+        Batch<T> flags = 0;
+        stdx::where(holds(Batch<T>(lhs + index, unaligned), Batch<T>(rhs + index, unaligned)), flags) = 1;
+        stdx::static_simd_cast<Flags>(flags).copy_to(out + index, unaligned);
+    }
+    for (; index < size; ++index) {
+        out[index] = holds(lhs[index], rhs[index]);
+    }
+}
+
+using Masks = std::array<uint64_t, TextClassifier::maxSets>;
+
+#ifndef MAL_SIMD_X86
+void classifyScalar(const char* block, const std::string_view* sets, size_t setCount, Masks& masks)
+{
+    for (size_t setIndex = 0; setIndex < setCount; ++setIndex) {
+        uint64_t mask = 0;
+        for (size_t byteIndex = 0; byteIndex < TextClassifier::blockSize; ++byteIndex) {
+            mask |= uint64_t { sets[setIndex].find(block[byteIndex]) != std::string_view::npos } << byteIndex;
+        }
+        masks[setIndex] = mask;
+    }
+}
+#endif
+
+#ifdef MAL_SIMD_X86
+void classifySse2(const char* block, const std::string_view* sets, size_t setCount, Masks& masks)
+{
+    __m128i bytes[TextClassifier::blockSize / sizeof(__m128i)];
+    for (size_t part = 0; part < std::size(bytes); ++part) {
+        bytes[part] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block) + part);
+    }
+    for (size_t setIndex = 0; setIndex < setCount; ++setIndex) {
+        __m128i matches[std::size(bytes)] = {};
+        for (const char setByte : sets[setIndex]) {
+            const auto needle = _mm_set1_epi8(setByte);
+            for (size_t part = 0; part < std::size(bytes); ++part) {
+                matches[part] = _mm_or_si128(matches[part], _mm_cmpeq_epi8(bytes[part], needle));
+            }
+        }
+        uint64_t mask = 0;
+        for (size_t part = 0; part < std::size(bytes); ++part) {
+            mask |= uint64_t { static_cast<uint16_t>(_mm_movemask_epi8(matches[part])) } << (part * sizeof(__m128i));
+        }
+        masks[setIndex] = mask;
+    }
+}
+
+__attribute__((target("avx2"))) void classifyAvx2(const char* block, const std::string_view* sets, size_t setCount, Masks& masks)
+{
+    const auto low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    const auto high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block) + 1);
+    for (size_t setIndex = 0; setIndex < setCount; ++setIndex) {
+        auto lowMatches = _mm256_setzero_si256();
+        auto highMatches = _mm256_setzero_si256();
+        for (const char setByte : sets[setIndex]) {
+            const auto needle = _mm256_set1_epi8(setByte);
+            lowMatches = _mm256_or_si256(lowMatches, _mm256_cmpeq_epi8(low, needle));
+            highMatches = _mm256_or_si256(highMatches, _mm256_cmpeq_epi8(high, needle));
+        }
+        masks[setIndex] = uint64_t { static_cast<uint32_t>(_mm256_movemask_epi8(lowMatches)) }
+            | uint64_t { static_cast<uint32_t>(_mm256_movemask_epi8(highMatches)) } << 32;
+    }
+}
+#endif
+
+using Classifier = void (*)(const char*, const std::string_view*, size_t, Masks&);
+
+Classifier classifier()
+{
+    // NOTE: picked once, on the first use
+    static const Classifier selected = [] {
+#ifdef MAL_SIMD_X86
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? classifyAvx2 : classifySse2;
+#else
+        return classifyScalar;
+#endif
+    }();
+    return selected;
+}
+
+} // namespace
+
+TextClassifier::TextClassifier(std::string_view text, std::initializer_list<std::string_view> sets)
+    : m_text(text)
+{
+    assert(sets.size() <= maxSets);
+    for (const auto set : sets) {
+        assert(set.size() <= maxSetSize);
+        m_sets[m_setCount++] = set;
+    }
+}
+
+const std::array<uint64_t, TextClassifier::maxSets>& TextClassifier::masksOf(size_t block)
+{
+    if (block == m_classifiedBlock) {
+        return m_masks;
+    }
+    const auto offset = block * blockSize;
+    if (offset + blockSize <= m_text.size()) {
+        classifier()(m_text.data() + offset, m_sets.data(), m_setCount, m_masks);
+    } else {
+        // last block is padded with zero bytes, they are never a part of a set
+        char padded[blockSize] = {};
+        std::copy(m_text.begin() + offset, m_text.end(), padded);
+        classifier()(padded, m_sets.data(), m_setCount, m_masks);
+    }
+    m_classifiedBlock = block;
+    return m_masks;
+}
+
+size_t TextClassifier::find(size_t from, size_t set, bool inSet)
+{
+    while (from < m_text.size()) {
+        const auto block = from / blockSize;
+        const auto mask = inSet ? masksOf(block)[set] : ~masksOf(block)[set];
+        if (const auto candidates = mask >> (from % blockSize); candidates) {
+            return std::min(from + std::countr_zero(candidates), m_text.size());
+        }
+        from = (block + 1) * blockSize;
+    }
+    return m_text.size();
+}
+
+size_t TextClassifier::findFirstOf(size_t from, size_t set)
+{
+    return find(from, set, true);
+}
+
+size_t TextClassifier::findFirstNotOf(size_t from, size_t set)
+{
+    return find(from, set, false);
+}
+
+bool add(const int64_t* lhs, const int64_t* rhs, int64_t* out, size_t size)
+{
+    Lanes overflow = 0;
+    size_t index = 0;
+    for (; index + Lanes::size() <= size; index += Lanes::size()) {
+        const Lanes left(asUnsigned(lhs) + index, unaligned);
+        const Lanes right(asUnsigned(rhs) + index, unaligned);
+        const Lanes result = left + right;
+        overflow |= (left ^ result) & (right ^ result);
+        result.copy_to(reinterpret_cast<uint64_t*>(out) + index, unaligned);
+    }
+    bool overflowed = signBitSet(overflow);
+    for (; index < size; ++index) {
+        overflowed |= __builtin_add_overflow(lhs[index], rhs[index], &out[index]);
+    }
+    return !overflowed;
+}
+
+void add(const double* lhs, const double* rhs, double* out, size_t size)
+{
+    elementwise(lhs, rhs, out, size, [](const auto& left, const auto& right) { return left + right; });
+}
+
+bool multiply(const int64_t* lhs, const int64_t* rhs, int64_t* out, size_t size)
+{
+    // NOTE: there is no 64-bit lane multiplication before AVX-512, and it couldn't report overflow anyway
+    bool overflowed = false;
+    for (size_t index = 0; index < size; ++index) {
+        overflowed |= __builtin_mul_overflow(lhs[index], rhs[index], &out[index]);
+    }
+    return !overflowed;
+}
+
+void multiply(const double* lhs, const double* rhs, double* out, size_t size)
+{
+    elementwise(lhs, rhs, out, size, [](const auto& left, const auto& right) { return left * right; });
+}
+
+std::optional<int64_t> sum(const int64_t* values, size_t size)
+{
+    // every lane keeps its own partial sum, lanes are added up at the end
+    Lanes partialSums = 0;
+    Lanes overflow = 0;
+    size_t index = 0;
+    for (; index + Lanes::size() <= size; index += Lanes::size()) {
+        const Lanes batch(asUnsigned(values) + index, unaligned);
+        const Lanes result = partialSums + batch;
+        overflow |= (partialSums ^ result) & (batch ^ result);
+        partialSums = result;
+    }
+    if (signBitSet(overflow)) {
+        return std::nullopt;
+    }
+    int64_t result = 0;
+    for (size_t lane = 0; lane < Lanes::size(); ++lane) {
+        if (__builtin_add_overflow(result, static_cast<int64_t>(partialSums[lane]), &result)) {
+            return std::nullopt;
+        }
+    }
+    for (; index < size; ++index) {
+        if (__builtin_add_overflow(result, values[index], &result)) {
+            return std::nullopt;
+        }
+    }
+    return result;
+}
+
+double sum(const double* values, size_t size)
+{
+    return fold(values, size, 0.0, [](const auto& lhs, const auto& rhs) { return lhs + rhs; }, [](const auto& lanes) { return stdx::reduce(lanes); });
+}
+
+std::optional<int64_t> dot(const int64_t* lhs, const int64_t* rhs, size_t size)
+{
+    int64_t result = 0;
+    for (size_t index = 0; index < size; ++index) {
+        int64_t product = 0;
+        if (__builtin_mul_overflow(lhs[index], rhs[index], &product) || __builtin_add_overflow(result, product, &result)) {
+            return std::nullopt;
+        }
+    }
+    return result;
+}
+
+double dot(const double* lhs, const double* rhs, size_t size)
+{
+    Batch<double> accumulator = 0.0;
+    size_t index = 0;
+    for (; index + Batch<double>::size() <= size; index += Batch<double>::size()) {
+        accumulator += Batch<double>(lhs + index, unaligned) * Batch<double>(rhs + index, unaligned);
+    }
+    double result = stdx::reduce(accumulator);
+    for (; index < size; ++index) {
+        result += lhs[index] * rhs[index];
+    }
+    return result;
+}
+
+int64_t min(const int64_t* values, size_t size)
+{
+    return fold(values, size, values[0], [](const auto& lhs, const auto& rhs) { return stdx::min(lhs, rhs); }, [](const auto& lanes) { return stdx::hmin(lanes); });
+}
+
+double min(const double* values, size_t size)
+{
+    return fold(values, size, values[0], [](const auto& lhs, const auto& rhs) { return stdx::min(lhs, rhs); }, [](const auto& lanes) { return stdx::hmin(lanes); });
+}
+
+int64_t max(const int64_t* values, size_t size)
+{
+    return fold(values, size, values[0], [](const auto& lhs, const auto& rhs) { return stdx::max(lhs, rhs); }, [](const auto& lanes) { return stdx::hmax(lanes); });
+}
+
+double max(const double* values, size_t size)
+{
+    return fold(values, size, values[0], [](const auto& lhs, const auto& rhs) { return stdx::max(lhs, rhs); }, [](const auto& lanes) { return stdx::hmax(lanes); });
+}
+
+void compare(const int64_t* lhs, const int64_t* rhs, int64_t* out, size_t size, Comparison comparison)
+{
+    compareElements(lhs, rhs, out, size, comparison);
+}
+
+void compare(const double* lhs, const double* rhs, int64_t* out, size_t size, Comparison comparison)
+{
+    compareElements(lhs, rhs, out, size, comparison);
+}
+
+} // namespace mal::simd
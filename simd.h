@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string_view>
+
+// Kernels over contiguous numeric arrays, vectorized with the widest SIMD registers the build targets
+// (build with -march=native to get more than SSE2 on x86-64). Integer kernels don't wrap around,
+// they report overflow so the caller could redo the work with big integers.
+namespace mal::simd {
+
+enum class Comparison : uint8_t {
+    LESS,
+    GREATER,
+    EQUAL
+};
+
+// out[i] = lhs[i] + rhs[i], false if any element overflowed
+bool add(const int64_t* lhs, const int64_t* rhs, int64_t* out, size_t size);
+void add(const double* lhs, const double* rhs, double* out, size_t size);
+
+// out[i] = lhs[i] * rhs[i], false if any element overflowed
+bool multiply(const int64_t* lhs, const int64_t* rhs, int64_t* out, size_t size);
+void multiply(const double* lhs, const double* rhs, double* out, size_t size);
+
+// Nothing if the sum doesn't fit into int64_t
+std::optional<int64_t> sum(const int64_t* values, size_t size);
+double sum(const double* values, size_t size);
+
+std::optional<int64_t> dot(const int64_t* lhs, const int64_t* rhs, size_t size);
+double dot(const double* lhs, const double* rhs, size_t size);
+
+// Expects at least one value
+int64_t min(const int64_t* values, size_t size);
+double min(const double* values, size_t size);
+int64_t max(const int64_t* values, size_t size);
+double max(const double* values, size_t size);
+
+// out[i] = 1 if comparison of lhs[i] and rhs[i] holds, 0 otherwise
+void compare(const int64_t* lhs, const int64_t* rhs, int64_t* out, size_t size, Comparison comparison);
+void compare(const double* lhs, const double* rhs, int64_t* out, size_t size, Comparison comparison);
+
+// Marks bytes of text that belong to each of a few byte sets, 64 bytes at a time with 16 (SSE2) or
+// 32 (AVX2, when the CPU has it) byte compares. Lexer asks for the next byte of a set, that becomes
+// a bit scan over the masks of the current block, every block is classified once when reached.
+class TextClassifier {
+public:
+    static constexpr size_t blockSize = 64;
+    static constexpr size_t maxSets = 4;
+    static constexpr size_t maxSetSize = 8;
+
+    TextClassifier(std::string_view text, std::initializer_list<std::string_view> sets);
+
+    // Index of the first byte at or after from that is in the set, text size if there is none
+    size_t findFirstOf(size_t from, size_t set);
+    // Index of the first byte at or after from that is not in the set, text size if there is none
+    size_t findFirstNotOf(size_t from, size_t set);
+
+private:
+    const std::array<uint64_t, maxSets>& masksOf(size_t block);
+    size_t find(size_t from, size_t set, bool inSet);
+
+private:
+    std::string_view m_text;
+    std::array<std::string_view, maxSets> m_sets;
+    size_t m_setCount { 0 };
+
+    size_t m_classifiedBlock { SIZE_MAX };
+    std::array<uint64_t, maxSets> m_masks {};
+};
+
+} // namespace mal::simd
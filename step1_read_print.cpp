@@ -1,9 +1,9 @@
-#include <iostream>
 #include <string>
 #include <string_view>
 
 #include "eval_ast.h"
 #include "maltypes.h"
+#include "ports.h"
 #include "reader.h"
 
 using MalType = mal::MalType;
@@ -35,9 +35,11 @@ rep(std::string_view program, mal::Env& env)
 int main()
 {
     static mal::Env env;
-    std::cout << "user> ";
-    for (std::string currentLine; std::getline(std::cin, currentLine);) {
-        std::cout << rep(currentLine, env) << "\n";
-        std::cout << "user> ";
+    // builtins print into the stdout port too, it is flushed before every line is read
+    const auto& output = mal::OutputPort::standardOutput();
+    output->write("user> ");
+    while (const auto currentLine = mal::InputPort::standardInput()->readLine()) {
+        output->write(rep(*currentLine, env) + '\n');
+        output->write("user> ");
     }
 }   
\ No newline at end of file
@@ -1,10 +1,10 @@
-#include <iostream>
 #include <string>
 #include <string_view>
 #include <sstream>
 
 #include "eval_ast.h"
 #include "maltypes.h"
+#include "ports.h"
 #include "reader.h"
 
 using MalType = mal::MalType;
@@ -33,7 +33,7 @@ rep(std::string_view program, mal::Env& env)
     return print(eval(read(program), env));
 }
 
-bool startWithComment(const std::string& line)
+bool startWithComment(std::string_view line)
 {
     for (auto ch : line) {
         if (ch != ' ') {
@@ -47,18 +47,20 @@ int main(int argc, char* argv[])
 {
     mal::GlobalEnv::the().setUpArgv(argc, argv);
     static mal::Env env;
+    // builtins print into the stdout port too, it is flushed before every line is read
+    const auto& output = mal::OutputPort::standardOutput();
 
     if (argc > 1) {
         std::ostringstream malProgramToLoadFile;
         malProgramToLoadFile << "(load-file " << '"' << argv[1] << "\")";
-        std::cout << rep(malProgramToLoadFile.str(), env) << '\n';
+        output->write(rep(malProgramToLoadFile.str(), env) + '\n');
     } else {
-        std::cout << "user> ";
-        for (std::string currentLine; std::getline(std::cin, currentLine);) {
-            if (!currentLine.empty() && !startWithComment(currentLine)) {
-                std::cout << rep(currentLine, env) << '\n';
+        output->write("user> ");
+        while (const auto currentLine = mal::InputPort::standardInput()->readLine()) {
+            if (!currentLine->empty() && !startWithComment(*currentLine)) {
+                output->write(rep(*currentLine, env) + '\n');
             }
-            std::cout << "user> ";
+            output->write("user> ");
         }
     }
 }
\ No newline at end of file
@@ -1,10 +1,13 @@
-#include <iostream>
 #include <string>
 #include <string_view>
 #include <sstream>
 
+#include "buildins.h"
 #include "eval_ast.h"
+#include "heapimage.h"
 #include "maltypes.h"
+#include "ports.h"
+#include "printer.h"
 #include "reader.h"
 
 using MalType = mal::MalType;
@@ -21,19 +24,22 @@ eval(std::shared_ptr<MalType> ast, mal::Env& env)
     return EVAL(ast, env);
 }
 
-std::string
-print(std::shared_ptr<MalType> program)
+// Prints straight into the stdout port, so a big result is never built as one string
+void
+print(std::shared_ptr<MalType> program, mal::Env& env)
 {
-    return program->asString();
+    mal::Printer printer(*mal::OutputPort::standardOutput(), true, mal::printLimits(env));
+    printer.print(*program);
+    printer.write('\n');
 }
 
-std::string
+void
 rep(std::string_view program, mal::Env& env)
 {
-    return print(eval(read(program), env));
+    print(eval(read(program), env), env);
 }
 
-bool startWithComment(const std::string& line)
+bool startWithComment(std::string_view line)
 {
     for (auto ch : line) {
         if (ch != ' ') {
@@ -43,23 +49,60 @@ bool startWithComment(const std::string& line)
     return false;
 }
 
+// stepA_mal [--image FILE] [--dump-image FILE] [script args...]
+// --image starts with the environment the image holds, --dump-image saves the environment
+// once the script is loaded and exits instead of starting the REPL
 int main(int argc, char* argv[])
 {
+    std::string imagePath;
+    std::string dumpImagePath;
+    int argIndex = 1;
+    for (; argIndex + 1 < argc; argIndex += 2) {
+        const std::string_view option = argv[argIndex];
+        if (option == "--image") {
+            imagePath = argv[argIndex + 1];
+        } else if (option == "--dump-image") {
+            dumpImagePath = argv[argIndex + 1];
+        } else {
+            break;
+        }
+    }
+    // the script becomes argv[1], as if there were no options
+    argc -= argIndex - 1;
+    argv += argIndex - 1;
+
     mal::GlobalEnv::the().setUpArgv(argc, argv);
     static mal::Env env;
 
+    if (!imagePath.empty()) {
+        if (auto restored = mal::heapimage::restore(env, imagePath); restored->is<mal::MalException>()) {
+            mal::OutputPort::standardError()->write(restored->asString() + '\n');
+            return 1;
+        }
+    }
+
     if (argc > 1) {
         std::ostringstream malProgramToLoadFile;
         malProgramToLoadFile << "(load-file " << '"' << argv[1] << "\")";
-        std::cout << rep(malProgramToLoadFile.str(), env) << '\n';
-    } else {
-        rep("(println (str \"Mal [\" *host-language* \"]\"))", env);
-        std::cout << "user> ";
-        for (std::string currentLine; std::getline(std::cin, currentLine);) {
-            if (!currentLine.empty() && !startWithComment(currentLine)) {
-                std::cout << rep(currentLine, env) << '\n';
+        rep(malProgramToLoadFile.str(), env);
+    }
+    if (!dumpImagePath.empty()) {
+        if (auto dumped = mal::heapimage::dump(env, dumpImagePath); dumped->is<mal::MalException>()) {
+            mal::OutputPort::standardError()->write(dumped->asString() + '\n');
+            return 1;
+        }
+        return 0;
+    }
+    if (argc <= 1) {
+        eval(read("(println (str \"Mal [\" *host-language* \"]\"))"), env);
+        // stdin is tied to stdout, every prompt is flushed before the next line is read
+        const auto& output = mal::OutputPort::standardOutput();
+        output->write("user> ");
+        while (const auto currentLine = mal::InputPort::standardInput()->readLine()) {
+            if (!currentLine->empty() && !startWithComment(*currentLine)) {
+                rep(*currentLine, env);
             }
-            std::cout << "user> ";
+            output->write("user> ");
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,15 @@
+# Top level atoms that straddle the 64 KiB read chunk of load-file must be read whole.
+# Usage: cmake -DMAL=<stepA_mal> -DWORK_DIR=<dir> -P chunk_boundary.cmake
+
+# a comment line pads the file so the last form starts a few bytes before offset 65536
+string(REPEAT ";" 65530 padding)
+string(REPEAT "x" 40 longString)
+
+foreach(form "\"${longString}\"" "123456789012345")
+    set(source "${WORK_DIR}/chunk_boundary.mal")
+    file(WRITE "${source}" "${padding}\n${form}\n")
+    execute_process(COMMAND "${MAL}" "${source}" OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+    if (NOT result EQUAL 0 OR NOT output MATCHES "^${form}\n")
+        message(FATAL_ERROR "form across the chunk boundary was read as:\n${output}")
+    endif()
+endforeach()
@@ -0,0 +1,42 @@
+# An environment dumped with --dump-image must come back whole with --image.
+# Usage: cmake -DMAL=<stepA_mal> -DWORK_DIR=<dir> -P heap_image.cmake
+
+set(prelude "${WORK_DIR}/heap_image_prelude.mal")
+set(script "${WORK_DIR}/heap_image_check.mal")
+set(image "${WORK_DIR}/heap_image.img")
+
+file(WRITE "${prelude}" "
+(def! inc2 (fn* (x) (+ x 2)))
+(def! counter (atom 41))
+(def! tagged (with-meta [1 2 3] {:tag \"vec\"}))
+(def! plain [4 5])
+(def! shared (list plain plain))
+(defmacro! unless2 (fn* (c a b) (list 'if c b a)))
+(def! big 123456789012345678901234567890)
+")
+file(WRITE "${script}" "
+(def! check (fn* (name actual expected)
+  (if (= actual expected)
+    nil
+    (throw (str name \": expected \" (pr-str expected) \", got \" (pr-str actual))))))
+
+(check \"closure\" (inc2 40) 42)
+(check \"atom\" (swap! counter (fn* (x) (+ x 1))) 42)
+(check \"metadata\" (meta tagged) {:tag \"vec\"})
+(check \"no metadata\" (meta plain) nil)
+(check \"shared\" (first shared) plain)
+(check \"macro\" (unless2 false 1 2) 1)
+(check \"bignum\" big 123456789012345678901234567890)
+(println \"restored\")
+")
+
+file(REMOVE "${image}")
+execute_process(COMMAND "${MAL}" --dump-image "${image}" "${prelude}" OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+if (NOT result EQUAL 0 OR NOT EXISTS "${image}")
+    message(FATAL_ERROR "dumping the image failed:\n${output}")
+endif()
+
+execute_process(COMMAND "${MAL}" --image "${image}" "${script}" OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+if (NOT result EQUAL 0 OR NOT output MATCHES "^restored\n")
+    message(FATAL_ERROR "restored environment differs:\n${output}")
+endif()
@@ -0,0 +1,38 @@
+# Images with damaged counts or sizes must be rejected as damaged, not trusted for allocations.
+# Usage: cmake -DMAL=<stepA_mal> -DWORK_DIR=<dir> -P heap_image_damaged.cmake
+
+set(prelude "${WORK_DIR}/heap_image_damaged.mal")
+set(image "${WORK_DIR}/heap_image_damaged.img")
+set(damaged "${WORK_DIR}/heap_image_damaged_copy.img")
+
+# one symbol "v" bound to one object, so the layout is fixed: a 24 byte header, the symbol
+# (type byte, name length, name) at 24 and the numeric vector (type byte, size) at 30
+file(WRITE "${prelude}" "(def! v (ivec [1 2 3]))\n")
+file(REMOVE "${image}")
+execute_process(COMMAND "${MAL}" --dump-image "${image}" "${prelude}" OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+if (NOT result EQUAL 0 OR NOT EXISTS "${image}")
+    message(FATAL_ERROR "dumping the image failed:\n${output}")
+endif()
+
+# offset of a count in the image and what the count is, each is replaced by a huge number
+set(counts "8:symbols count" "12:objects count" "31:numeric vector size")
+foreach(entry ${counts})
+    string(REPLACE ":" ";" entry "${entry}")
+    list(GET entry 0 offset)
+    list(GET entry 1 name)
+    execute_process(COMMAND sh -c "cp '${image}' '${damaged}' && printf '\\360\\377\\377\\177' | dd of='${damaged}' bs=1 seek=${offset} conv=notrunc 2>/dev/null" RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "couldn't damage ${name}")
+    endif()
+    execute_process(COMMAND "${MAL}" --image "${damaged}" OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+    if (NOT result EQUAL 1 OR NOT output MATCHES "Damaged image")
+        message(FATAL_ERROR "image with a huge ${name} wasn't rejected as damaged (${result}):\n${output}")
+    endif()
+endforeach()
+
+# an image cut in the middle
+execute_process(COMMAND sh -c "head -c 40 '${image}' > '${damaged}'")
+execute_process(COMMAND "${MAL}" --image "${damaged}" OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+if (NOT result EQUAL 1 OR NOT output MATCHES "Damaged image")
+    message(FATAL_ERROR "truncated image wasn't rejected as damaged (${result}):\n${output}")
+endif()
@@ -0,0 +1,22 @@
+# The lexer reads views that have no NUL after them, it must not look past their end.
+# Usage: cmake -DMAL=<stepA_mal> -DWORK_DIR=<dir> -P lexer_bounds.cmake
+
+# a string sharing its buffer with a longer one is followed by the longer one's characters,
+# read-string of it must not see the "5"
+set(forms "(def! a \"-\")\n(def! b (str a \"5\"))\n(prn (symbol? (read-string a)))\n")
+
+# the file is mapped as is, it fills a whole page and its last byte is the start of a token
+string(LENGTH "${forms}" formsLength)
+math(EXPR paddingLength "4096 - ${formsLength} - 2")
+string(REPEAT ";" ${paddingLength} padding)
+set(source "${WORK_DIR}/lexer_bounds.mal")
+file(WRITE "${source}" "${forms}${padding}\n-")
+file(SIZE "${source}" sourceSize)
+if (NOT sourceSize EQUAL 4096)
+    message(FATAL_ERROR "expected a 4096 byte file, got ${sourceSize}")
+endif()
+
+execute_process(COMMAND "${MAL}" "${source}" OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+if (NOT result EQUAL 0 OR NOT output MATCHES "^true\n" OR output MATCHES "Exception")
+    message(FATAL_ERROR "lexer read past the end of the text:\n${output}")
+endif()
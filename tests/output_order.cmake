@@ -0,0 +1,11 @@
+# stdout is buffered and stderr is not, stderr flushes stdout first so both keep the order they were written in.
+# Usage: cmake -DMAL=<stepA_mal> -DWORK_DIR=<dir> -P output_order.cmake
+
+set(source "${WORK_DIR}/output_order.mal")
+file(WRITE "${source}" "(prn 1)\n(write *err* \"e1\\n\")\n(prn 2)\n(write *err* \"e2\\n\")\n")
+
+# the same variable for both pipes merges them in the order the output was produced
+execute_process(COMMAND "${MAL}" "${source}" OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+if (NOT result EQUAL 0 OR NOT output MATCHES "^1\ne1\n2\ne2\n")
+    message(FATAL_ERROR "stdout and stderr came out of order:\n${output}")
+endif()